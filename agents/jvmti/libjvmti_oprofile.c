@@ -35,6 +35,7 @@
 #include "opagent.h"
 
 static int debug = 0;
+static int buffered = 0;
 static int can_get_line_numbers = 0;
 static op_agent_t agent_hdl;
 
@@ -234,6 +235,43 @@ static void JNICALL cb_dynamic_code_generated(jvmtiEnv * jvmti_env,
 }
 
 
+/**
+ * Parse the comma-separated list of agent options, return -1 if the agent
+ * must not be loaded
+ */
+static int parse_options(char const * options)
+{
+	char * list, * option, * next;
+	int rc = 0;
+
+	if (!options)
+		return 0;
+
+	list = strdup(options);
+	if (!list) {
+		perror("Error: jvmti_oprofile options");
+		return -1;
+	}
+	for (option = strtok_r(list, ",", &next); option;
+	     option = strtok_r(NULL, ",", &next)) {
+		if (!strcmp("version", option)) {
+			fprintf(stderr, "jvmti_oprofile: current libopagent version %i.%i.\n",
+			        op_major_version(), op_minor_version());
+			rc = -1;
+		} else if (!strcmp("debug", option)) {
+			debug = 1;
+		} else if (!strcmp("buffered", option)) {
+			buffered = 1;
+		} else {
+			fprintf(stderr, "jvmti_oprofile: unknown option %s ignored\n",
+			        option);
+		}
+	}
+	free(list);
+	return rc;
+}
+
+
 JNIEXPORT jint JNICALL
 Agent_OnLoad(JavaVM * jvm, char * options, void * reserved)
 {
@@ -247,19 +285,13 @@ Agent_OnLoad(JavaVM * jvm, char * options, void * reserved)
 	/* shut up compiler warning */
 	reserved = reserved;
 
-	if (options && !strcmp("version", options)) {
-		fprintf(stderr, "jvmti_oprofile: current libopagent version %i.%i.\n",
-		        op_major_version(), op_minor_version());
+	if (parse_options(options))
 		return -1;
-	}
-
-	if (options && !strcmp("debug", options))
-		debug = 1;
 
 	if (debug)
 		fprintf(stderr, "jvmti_oprofile: agent activated\n");
 
-	agent_hdl = op_open_agent();
+	agent_hdl = buffered ? op_open_agent_buffered() : op_open_agent();
 	if (!agent_hdl) {
 		perror("Error: op_open_agent()");
 		return -1;
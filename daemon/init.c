@@ -32,6 +32,7 @@
 #include "op_get_time.h"
 #include "op_libiberty.h"
 #include "op_fileio.h"
+#include "op_session_index.h"
 
 #include <fcntl.h>
 #include <stdio.h>
@@ -41,6 +42,7 @@
 #include <sys/time.h>
 #include <wait.h>
 #include <string.h>
+#include <unistd.h>
 
 size_t kernel_pointer_size;
 
@@ -57,6 +59,23 @@ static void opd_sigterm(void);
 static void opd_sigchild(void);
 static void opd_do_jitdumps(void);
 
+/**
+ * opd_remove_session_index - drop the index of an operf session
+ *
+ * The pp tools take the index as the full list of sample files, the
+ * sample files we are about to write would not appear in it.
+ */
+static void opd_remove_session_index(void)
+{
+	char index[PATH_MAX];
+
+	snprintf(index, sizeof(index), "%s%s", op_samples_current_dir,
+	         OP_SESSION_INDEX_FILE);
+	if (unlink(index) && errno != ENOENT)
+		perror("oprofiled: couldn't remove session index: ");
+}
+
+
 /**
  * opd_open_files - open necessary files
  *
@@ -89,6 +108,7 @@ static void opd_open_files(void)
 
 	opd_open_logfile();
 	opd_create_pipe();
+	opd_remove_session_index();
 
 	printf("oprofiled started %s", op_get_time());
 	printf("kernel pointer size: %lu\n",
@@ -0,0 +1,59 @@
+/**
+ * @file op_session_index.h
+ * Session summary index format
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef OP_SESSION_INDEX_H
+#define OP_SESSION_INDEX_H
+
+#include <sys/stat.h>
+
+#include "op_types.h"
+
+/** name of the index file, relative to the samples current dir */
+#define OP_SESSION_INDEX_FILE "summary.index"
+
+#define OP_SESSION_INDEX_MAGIC "OPSI"
+#define OP_SESSION_INDEX_VERSION 2
+
+/**
+ * The index is written by the converter once all sample files are closed.
+ * It lists each sample file it wrote with the sum of its sample counts,
+ * so a summary can be reported without opening the sample files, and the
+ * sample files can be found without walking the samples dir. The layout
+ * is, in host byte order:
+ *
+ *  struct op_session_index_header
+ *  u64 total[nr_entries]     sum of the node values of the sample file
+ *  u64 size[nr_entries]      st_size of the sample file
+ *  u64 mtime[nr_entries]     st_mtim of the sample file, in ns
+ *  u32 name[nr_entries]      offset of the file name in the string table
+ *  char strings[strings_size]
+ *
+ * Entries are sorted by name. Names are relative to the samples current
+ * dir, e.g. "{root}/bin/ls/{dep}/{root}/bin/ls/CYCLES.100000.0.all.all.all"
+ * and are NUL terminated. size and mtime let a reader detect a sample
+ * file modified after the index was written. File times have a coarse
+ * granularity, so a sample file whose mtime is not older than the mtime
+ * of the index itself may have been modified after it, and its entry
+ * can't be trusted.
+ */
+struct op_session_index_header {
+	u8 magic[4];
+	u32 version;
+	u32 nr_entries;
+	u32 strings_size;
+};
+
+/** the mtime of st, in ns, as stored in the index */
+static inline u64 op_session_index_mtime(struct stat const * st)
+{
+	return (u64)st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+}
+
+#endif /* OP_SESSION_INDEX_H */
@@ -52,6 +52,7 @@
 
 #include "config.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <stdint.h>
@@ -59,9 +60,13 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/file.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/uio.h>
 #include <bfd.h>
 
 #include "opagent.h"
@@ -117,13 +122,376 @@ static int define_bfd_vars(void)
  * Define the version of the opagent library.
  */
 #define OP_MAJOR_VERSION 1
-#define OP_MINOR_VERSION 0
+#define OP_MINOR_VERSION 1
 
 #define TMP_OPROFILE_DIR "/tmp/.oprofile"
 #define JITDUMP_DIR TMP_OPROFILE_DIR "/jitdump"
 
 #define MSG_MAXLEN 20
 
+/* Size of the ring buffer of op_open_agent_buffered(), a power of two. */
+#define OP_AGENT_BUFFER_SIZE (1024 * 1024)
+/* Time the writer thread collects records before writing them out. */
+#define OP_AGENT_BATCH_NSECS (10 * 1000 * 1000)
+/* Time op_close_agent() waits for the records being written by other
+ * threads, or for opjitconv to release the dump file.
+ */
+#define OP_AGENT_CLOSE_USECS (1000 * 1000)
+/* Records are 8 byte aligned in the ring, so a slot header never wraps. */
+#define OP_AGENT_ALIGN(x) (((x) + 7) & ~7UL)
+
+/*
+ * The dump file of op_open_agent_buffered(). Records are appended to a ring
+ * buffer without taking any lock, and a writer thread writes all complete
+ * records with one write() at a time, holding the dump file flock() as
+ * unbuffered agents do around every record.
+ *
+ * Each record in the ring is preceded by a slot header. A writer reserves
+ * room by advancing head, copies the record and then sets the slot size,
+ * which tells the writer thread the record is complete. The writer thread
+ * clears the slot headers it wrote and advances tail, which frees the room.
+ * head and tail only grow; their difference is the space in use.
+ */
+struct op_agent_slot {
+	uint32_t size;
+	uint32_t reserved;
+};
+
+static struct {
+	FILE * dumpfile;
+	char * ring;
+	/* the records written by the writer thread are collected here */
+	char * out;
+	unsigned long volatile head;
+	unsigned long volatile tail;
+	/* the writer thread waits for a record */
+	int volatile waiting;
+	/* the writer thread collects records to write them together */
+	int volatile batching;
+	int volatile stop;
+	/* the threads in buffer_record(), buffer_close() waits for them */
+	int volatile active;
+	/* buffer_close() gave up on the records left in the ring */
+	int volatile closed;
+	sem_t wakeup;
+	/* serializes emptying the ring */
+	pthread_mutex_t flush_lock;
+	pthread_t writer;
+} agent_buffer = { .flush_lock = PTHREAD_MUTEX_INITIALIZER };
+
+static struct op_agent_slot * buffer_slot(unsigned long pos)
+{
+	return (struct op_agent_slot *)
+		(agent_buffer.ring + (pos & (OP_AGENT_BUFFER_SIZE - 1)));
+}
+
+/* Copy len bytes between the ring at pos and buf, wrapping around. */
+static void buffer_copy(unsigned long pos, void * buf, size_t len, int to_ring)
+{
+	size_t offset = pos & (OP_AGENT_BUFFER_SIZE - 1);
+	size_t first = OP_AGENT_BUFFER_SIZE - offset;
+
+	if (first > len)
+		first = len;
+	if (to_ring) {
+		memcpy(agent_buffer.ring + offset, buf, first);
+		memcpy(agent_buffer.ring, buf + first, len - first);
+	} else {
+		memcpy(buf, agent_buffer.ring + offset, first);
+		memcpy(buf + first, agent_buffer.ring, len - first);
+	}
+}
+
+static void buffer_clear(unsigned long pos, size_t len)
+{
+	size_t offset = pos & (OP_AGENT_BUFFER_SIZE - 1);
+	size_t first = OP_AGENT_BUFFER_SIZE - offset;
+
+	if (first > len)
+		first = len;
+	memset(agent_buffer.ring + offset, '\0', first);
+	memset(agent_buffer.ring, '\0', len - first);
+}
+
+static int lock_dumpfile(int dumpfd)
+{
+#define OP_JITCONV_USECS_TO_WAIT 1000
+	unsigned int usecs_waited = 0;
+
+	/* We need OS-level file locking here because the opjitconv process may need to
+	 * copy the dumpfile while the JIT agent is still writing to it. */
+	while (flock(dumpfd, LOCK_EX | LOCK_NB)) {
+		if (usecs_waited >= OP_JITCONV_USECS_TO_WAIT)
+			return -1;
+		usleep(100);
+		usecs_waited += 100;
+	}
+#undef OP_JITCONV_USECS_TO_WAIT
+	return 0;
+}
+
+static int write_all(int fd, void const * buf, size_t len)
+{
+	ssize_t count;
+
+	while (len) {
+		count = write(fd, buf, len);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += count;
+		len -= count;
+	}
+	return 0;
+}
+
+/* Write all complete records from the ring to the dump file. Returns -1 if
+ * the dump file is locked by opjitconv, the records are then kept for the
+ * next try. Called with flush_lock held.
+ */
+static int buffer_flush(void)
+{
+	int dumpfd = fileno(agent_buffer.dumpfile);
+	unsigned long tail = agent_buffer.tail;
+	unsigned long pos = tail;
+	size_t len = 0;
+	int rc = 0;
+
+	while (pos != agent_buffer.head) {
+		struct op_agent_slot * slot = buffer_slot(pos);
+		uint32_t size = slot->size;
+		if (!size)
+			break;
+		// read the record only after its size
+		__sync_synchronize();
+		buffer_copy(pos + sizeof(*slot), agent_buffer.out + len, size, 0);
+		len += size;
+		pos += sizeof(*slot) + OP_AGENT_ALIGN(size);
+	}
+	if (!len)
+		return 0;
+
+	if (lock_dumpfile(dumpfd))
+		return -1;
+	if (write_all(dumpfd, agent_buffer.out, len)) {
+		// the records are lost, don't block the writers forever
+		perror("opagent: Unable to write JIT dumpfile");
+		rc = -1;
+	}
+	flock(dumpfd, LOCK_UN);
+
+	/* Free the room only once it is read. It is cleared, as the next
+	 * slot headers may be anywhere in it.
+	 */
+	buffer_clear(tail, pos - tail);
+	__sync_synchronize();
+	agent_buffer.tail = pos;
+	return rc;
+}
+
+static void * buffer_writer(void * arg __attribute__((unused)))
+{
+	struct timespec batch_end;
+
+	for (;;) {
+		agent_buffer.waiting = 1;
+		__sync_synchronize();
+		if (agent_buffer.head == agent_buffer.tail && !agent_buffer.stop) {
+			while (sem_wait(&agent_buffer.wakeup) && errno == EINTR)
+				;
+		}
+		agent_buffer.waiting = 0;
+		if (agent_buffer.stop)
+			break;
+
+		/* Let more records come in, so they are written together,
+		 * unless the ring fills up meanwhile.
+		 */
+		clock_gettime(CLOCK_REALTIME, &batch_end);
+		batch_end.tv_nsec += OP_AGENT_BATCH_NSECS;
+		if (batch_end.tv_nsec >= 1000000000) {
+			batch_end.tv_sec++;
+			batch_end.tv_nsec -= 1000000000;
+		}
+		agent_buffer.batching = 1;
+		__sync_synchronize();
+		if (agent_buffer.head - agent_buffer.tail < OP_AGENT_BUFFER_SIZE / 2) {
+			while (sem_timedwait(&agent_buffer.wakeup, &batch_end) &&
+			       errno == EINTR)
+				;
+		}
+		agent_buffer.batching = 0;
+
+		pthread_mutex_lock(&agent_buffer.flush_lock);
+		buffer_flush();
+		pthread_mutex_unlock(&agent_buffer.flush_lock);
+	}
+	return NULL;
+}
+
+/* Wake up the writer thread if it waits for records, or if it collects
+ * records and the ring is half full.
+ */
+static void buffer_wakeup(void)
+{
+	__sync_synchronize();
+	// the writer thread is gone
+	if (agent_buffer.stop)
+		return;
+	if ((agent_buffer.waiting &&
+	     __sync_bool_compare_and_swap(&agent_buffer.waiting, 1, 0)) ||
+	    (agent_buffer.batching &&
+	     agent_buffer.head - agent_buffer.tail >= OP_AGENT_BUFFER_SIZE / 2 &&
+	     __sync_bool_compare_and_swap(&agent_buffer.batching, 1, 0)))
+		sem_post(&agent_buffer.wakeup);
+}
+
+/* Write a record, given as the iov_cnt pieces of iov, the buffered way.
+ * Records that don't fit into the ring are written directly, after the
+ * ones already in the ring. Called with active raised and stop clear.
+ */
+static int buffer_add_record(struct iovec const * iov, int iov_cnt)
+{
+	struct op_agent_slot * slot;
+	unsigned long head, pos;
+	size_t size = 0, room;
+	int i, rc = 0;
+
+	for (i = 0; i < iov_cnt; i++)
+		size += iov[i].iov_len;
+	room = sizeof(*slot) + OP_AGENT_ALIGN(size);
+
+	if (room > OP_AGENT_BUFFER_SIZE / 2) {
+		int dumpfd;
+		pthread_mutex_lock(&agent_buffer.flush_lock);
+		// buffer_close() may have given up on us meanwhile
+		if (agent_buffer.closed) {
+			pthread_mutex_unlock(&agent_buffer.flush_lock);
+			errno = EBADF;
+			return -1;
+		}
+		dumpfd = fileno(agent_buffer.dumpfile);
+		while (buffer_flush())
+			usleep(100);
+		if (lock_dumpfile(dumpfd)) {
+			printf("opagent: Unable to obtain lock on JIT dumpfile\n");
+			rc = -1;
+		} else {
+			for (i = 0; i < iov_cnt && !rc; i++)
+				rc = write_all(dumpfd, iov[i].iov_base, iov[i].iov_len);
+			flock(dumpfd, LOCK_UN);
+		}
+		pthread_mutex_unlock(&agent_buffer.flush_lock);
+		return rc;
+	}
+
+	for (;;) {
+		head = agent_buffer.head;
+		if (head + room - agent_buffer.tail > OP_AGENT_BUFFER_SIZE) {
+			// nobody empties the ring any more
+			if (agent_buffer.closed) {
+				errno = EBADF;
+				return -1;
+			}
+			// full, wait for the writer thread, or buffer_close()
+			buffer_wakeup();
+			usleep(100);
+			continue;
+		}
+		// don't overwrite a slot the writer thread is still reading
+		__sync_synchronize();
+		if (__sync_bool_compare_and_swap(&agent_buffer.head, head,
+						 head + room))
+			break;
+	}
+
+	slot = buffer_slot(head);
+	pos = head + sizeof(*slot);
+	for (i = 0; i < iov_cnt; i++) {
+		buffer_copy(pos, iov[i].iov_base, iov[i].iov_len, 1);
+		pos += iov[i].iov_len;
+	}
+	// publish the record only once it is complete
+	__sync_synchronize();
+	slot->size = size;
+	buffer_wakeup();
+	return 0;
+}
+
+static int buffer_record(struct iovec const * iov, int iov_cnt)
+{
+	int rc;
+
+	/* Raise active before looking at stop, buffer_close() does it the
+	 * other way around: either it waits for this record, or the record
+	 * is refused.
+	 */
+	__sync_add_and_fetch(&agent_buffer.active, 1);
+	if (agent_buffer.stop) {
+		errno = EBADF;
+		rc = -1;
+	} else {
+		rc = buffer_add_record(iov, iov_cnt);
+	}
+	__sync_sub_and_fetch(&agent_buffer.active, 1);
+	return rc;
+}
+
+/* Stop the writer thread and write out the records left in the ring, once
+ * the threads still in buffer_record() are done. Returns -1 if there are
+ * records left when the time is up: they are lost, and so is the ring, which
+ * those threads may still be writing to.
+ */
+static int buffer_close(void)
+{
+	unsigned int usecs_waited = 0;
+	unsigned long lost;
+	int active;
+
+	agent_buffer.stop = 1;
+	__sync_synchronize();
+	sem_post(&agent_buffer.wakeup);
+	pthread_join(agent_buffer.writer, NULL);
+
+	pthread_mutex_lock(&agent_buffer.flush_lock);
+	for (;;) {
+		buffer_flush();
+		__sync_synchronize();
+		active = agent_buffer.active;
+		lost = agent_buffer.head - agent_buffer.tail;
+		if ((!lost && !active) || usecs_waited >= OP_AGENT_CLOSE_USECS)
+			break;
+		// let the writers of records too large for the ring in
+		pthread_mutex_unlock(&agent_buffer.flush_lock);
+		usleep(100);
+		usecs_waited += 100;
+		pthread_mutex_lock(&agent_buffer.flush_lock);
+	}
+	if (lost || active)
+		agent_buffer.closed = 1;
+	pthread_mutex_unlock(&agent_buffer.flush_lock);
+
+	agent_buffer.dumpfile = NULL;
+	if (agent_buffer.closed) {
+		fprintf(stderr, "opagent: %lu bytes of JIT records, and those of "
+		        "%d threads still writing, could not be written to the "
+		        "JIT dumpfile\n", lost, active);
+		/* Threads may still be writing to the ring and waking up the
+		 * writer thread: keep both, and keep op_open_agent_buffered()
+		 * from using them again.
+		 */
+		return -1;
+	}
+
+	sem_destroy(&agent_buffer.wakeup);
+	free(agent_buffer.ring);
+	free(agent_buffer.out);
+	agent_buffer.ring = agent_buffer.out = NULL;
+	return 0;
+}
+
 op_agent_t op_open_agent(void)
 {
 #define OP_JITCONV_USECS_TO_WAIT 1000
@@ -259,11 +627,50 @@ again:
 }
 
 
+op_agent_t op_open_agent_buffered(void)
+{
+	op_agent_t hdl;
+
+	// there is one dump file per process, and one ring
+	if (agent_buffer.dumpfile || agent_buffer.ring) {
+		errno = EBUSY;
+		return NULL;
+	}
+	hdl = op_open_agent();
+	if (!hdl)
+		return NULL;
+
+	agent_buffer.ring = calloc(1, OP_AGENT_BUFFER_SIZE);
+	agent_buffer.out = malloc(OP_AGENT_BUFFER_SIZE);
+	if (!agent_buffer.ring || !agent_buffer.out)
+		goto unbuffered;
+	if (sem_init(&agent_buffer.wakeup, 0, 0))
+		goto unbuffered;
+	agent_buffer.head = agent_buffer.tail = 0;
+	agent_buffer.waiting = agent_buffer.batching = 0;
+	agent_buffer.stop = agent_buffer.closed = 0;
+	agent_buffer.dumpfile = (FILE *)hdl;
+	if (pthread_create(&agent_buffer.writer, NULL, buffer_writer, NULL)) {
+		agent_buffer.dumpfile = NULL;
+		sem_destroy(&agent_buffer.wakeup);
+		goto unbuffered;
+	}
+	return hdl;
+
+unbuffered:
+	fprintf(stderr, "opagent: Unable to set up buffering, writing the JIT dumpfile unbuffered\n");
+	free(agent_buffer.ring);
+	free(agent_buffer.out);
+	agent_buffer.ring = agent_buffer.out = NULL;
+	return hdl;
+}
+
+
 int op_close_agent(op_agent_t hdl)
 {
 #define OP_JITCONV_USECS_TO_WAIT 1000
 	unsigned int usecs_waited = 0;
-	int dumpfd, rc;
+	int dumpfd, rc, buffer_rc = 0;
 	struct jr_code_close rec;
 	struct timeval tv;
 	FILE * dumpfile = (FILE *) hdl;
@@ -279,6 +686,14 @@ int op_close_agent(op_agent_t hdl)
 	}
 	rec.timestamp = tv.tv_sec;
 
+	// all buffered records go to the file ahead of the close record
+	if (dumpfile == agent_buffer.dumpfile)
+		buffer_rc = buffer_close();
+
+	if ((dumpfd = fileno(dumpfile)) < 0) {
+		fprintf(stderr, "opagent: Unable to get file descriptor for JIT dumpfile\n");
+		return -1;
+	}
 again:
 	/* We need OS-level file locking here because the opjitconv process may need to
 	 * copy the dumpfile while the JIT agent is still writing to it. */
@@ -300,6 +715,10 @@ again:
 	flock(dumpfd, LOCK_UN);
 #undef OP_JITCONV_USECS_TO_WAIT
 	dumpfile = NULL;
+	if (buffer_rc) {
+		errno = EIO;
+		return -1;
+	}
 	return 0;
 }
 
@@ -340,6 +759,19 @@ int op_write_native_code(op_agent_t hdl, char const * symbol_name,
 
 	rec.timestamp = tv.tv_sec;
 
+	if (dumpfile == agent_buffer.dumpfile) {
+		struct iovec iov[4];
+		iov[0].iov_base = &rec;
+		iov[0].iov_len = sizeof(rec);
+		iov[1].iov_base = (void *)symbol_name;
+		iov[1].iov_len = sz_symb_name;
+		iov[2].iov_base = (void *)code;
+		iov[2].iov_len = code ? size : 0;
+		iov[3].iov_base = pad_bytes;
+		iov[3].iov_len = padding_count;
+		return buffer_record(iov, 4);
+	}
+
 	if ((dumpfd = fileno(dumpfile)) < 0) {
 		fprintf(stderr, "opagent: Unable to get file descriptor for JIT dumpfile\n");
 		return -1;
@@ -387,6 +819,45 @@ again:
 }
 
 
+/* The buffered op_write_debug_line_info(), which knows the record size
+ * before writing it.
+ */
+static int buffer_debug_line_info(struct jr_code_debug_info * rec,
+				  size_t nr_entry,
+				  struct debug_line_info const * compile_map)
+{
+	char padd_bytes[7] = {0, 0, 0, 0, 0, 0, 0};
+	struct iovec * iov = malloc((nr_entry * 3 + 2) * sizeof(*iov));
+	size_t i, padding_count;
+	int rc;
+
+	if (!iov)
+		return -1;
+	iov[0].iov_base = rec;
+	iov[0].iov_len = sizeof(*rec);
+	rec->total_size = sizeof(*rec);
+	for (i = 0; i < nr_entry; ++i) {
+		struct iovec * entry = &iov[1 + i * 3];
+		entry[0].iov_base = (void *)&compile_map[i].vma;
+		entry[0].iov_len = sizeof(compile_map[i].vma);
+		entry[1].iov_base = (void *)&compile_map[i].lineno;
+		entry[1].iov_len = sizeof(compile_map[i].lineno);
+		entry[2].iov_base = (void *)compile_map[i].filename;
+		entry[2].iov_len = strlen(compile_map[i].filename) + 1;
+		rec->total_size += entry[0].iov_len + entry[1].iov_len +
+			entry[2].iov_len;
+	}
+	padding_count = PADDING_8ALIGNED(rec->total_size);
+	rec->total_size += padding_count;
+	iov[nr_entry * 3 + 1].iov_base = padd_bytes;
+	iov[nr_entry * 3 + 1].iov_len = padding_count;
+
+	rc = buffer_record(iov, nr_entry * 3 + 2);
+	free(iov);
+	return rc;
+}
+
+
 int op_write_debug_line_info(op_agent_t hdl, void const * code,
 			     size_t nr_entry,
 			     struct debug_line_info const * compile_map)
@@ -424,6 +895,9 @@ int op_write_debug_line_info(op_agent_t hdl, void const * code,
 
 	rec.timestamp = tv.tv_sec;
 
+	if (dumpfile == agent_buffer.dumpfile)
+		return buffer_debug_line_info(&rec, nr_entry, compile_map);
+
 	if ((dumpfd = fileno(dumpfile)) < 0) {
 		fprintf(stderr, "opagent: Unable to get file descriptor for JIT dumpfile\n");
 		return -1;
@@ -512,6 +986,13 @@ int op_unload_native_code(op_agent_t hdl, uint64_t vma)
 	}
 	rec.timestamp = tv.tv_sec;
 
+	if (dumpfile == agent_buffer.dumpfile) {
+		struct iovec iov;
+		iov.iov_base = &rec;
+		iov.iov_len = sizeof(rec);
+		return buffer_record(&iov, 1);
+	}
+
 	if ((dumpfd = fileno(dumpfile)) < 0) {
 		fprintf(stderr, "opagent: Unable to get file descriptor for JIT dumpfile\n");
 		return -1;
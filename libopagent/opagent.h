@@ -55,6 +55,24 @@ typedef void * op_agent_t;
  **/
 op_agent_t op_open_agent(void);
 
+/**
+ * Like op_open_agent(), but the records are collected in memory without
+ * locking and written to the JIT dump file in batches by a background
+ * thread, which is much cheaper for a VM that compiles a lot of code.
+ * Records written within about the last 10 milliseconds are lost if the
+ * process ends without calling op_close_agent(). Only one agent per
+ * process can be open in this mode.
+ *
+ * op_close_agent() waits up to 1 second for the records other threads are
+ * still writing. Those not written by then are dropped, and op_close_agent()
+ * returns -1 with errno set to EIO; no agent can be opened in this mode
+ * again in the process.
+ *
+ * Returns a valid op_agent_t handle or NULL.  If NULL is returned, errno
+ * is set to indicate the nature of the error.
+ **/
+op_agent_t op_open_agent_buffered(void);
+
 /**
  * Frees all resources and closes open file handles.
  *
@@ -0,0 +1,243 @@
+/**
+ * @file opagent_buffer_tests.c
+ * Tests for the buffered mode of libopagent
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "opagent.h"
+#include "jitdump.h"
+
+#define JITDUMP_DIR "/tmp/.oprofile/jitdump"
+#define MAX_THREADS 8
+/* larger than half the ring, so it is written directly */
+#define BIG_CODE_SIZE (700 * 1024)
+
+/* also counted by the writer threads */
+static int nr_error;
+
+#define thread_error() __sync_add_and_fetch(&nr_error, 1)
+
+/* what the writer threads do */
+static op_agent_t agent;
+static int nr_threads;
+static int nr_methods;
+static char big_code[BIG_CODE_SIZE];
+
+/* the vma of method m of thread t */
+static uint64_t method_vma(long t, int m)
+{
+	return ((uint64_t)t << 32) + m * 256;
+}
+
+static void * write_methods(void * arg)
+{
+	long t = (long)arg;
+	unsigned char code[200];
+	char name[64];
+	int m;
+
+	memset(code, t, sizeof(code));
+	for (m = 0; m < nr_methods; m++) {
+		uint64_t vma = method_vma(t, m);
+
+		snprintf(name, sizeof(name), "T%ld.m%d", t, m);
+		if (op_write_native_code(agent, name, vma, code, 1 + m % sizeof(code)))
+			thread_error();
+		if (m % 10 == 0) {
+			struct debug_line_info lines[2] = {
+				{ vma, m, "A.java" },
+				{ vma + 4, m + 1, "B.java" }
+			};
+			if (op_write_debug_line_info(agent, code, 2, lines))
+				thread_error();
+		}
+		if (m % 7 == 0 && op_unload_native_code(agent, vma))
+			thread_error();
+		if (t == 0 && m == nr_methods / 2 &&
+		    op_write_native_code(agent, "big", 1, big_code, sizeof(big_code)))
+			thread_error();
+	}
+	return NULL;
+}
+
+/* Run the writer threads on a new agent, return the time they took. */
+static double run_agent(int buffered, int threads, int methods)
+{
+	pthread_t thread[MAX_THREADS];
+	struct timespec start, end;
+	long t;
+
+	nr_threads = threads;
+	nr_methods = methods;
+	agent = buffered ? op_open_agent_buffered() : op_open_agent();
+	if (!agent) {
+		fprintf(stderr, "unable to open the agent\n");
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (t = 0; t < nr_threads; t++)
+		pthread_create(&thread[t], NULL, write_methods, (void *)t);
+	for (t = 0; t < nr_threads; t++)
+		pthread_join(thread[t], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (op_close_agent(agent)) {
+		fprintf(stderr, "op_close_agent failed\n");
+		nr_error++;
+	}
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1E9;
+}
+
+/* Check the records of a code load written by write_methods(). */
+static void check_code_load(struct jr_code_load const * load, int * next_method)
+{
+	char const * name = (char const *)(load + 1);
+	unsigned char const * code;
+	unsigned int i;
+	long t;
+	int m;
+
+	if (!strcmp(name, "big")) {
+		if (load->code_size != BIG_CODE_SIZE) {
+			printf("bad size %u for the big method\n", load->code_size);
+			nr_error++;
+		}
+		return;
+	}
+	if (sscanf(name, "T%ld.m%d", &t, &m) != 2 || t < 0 || t >= nr_threads) {
+		printf("unexpected method %s\n", name);
+		nr_error++;
+		return;
+	}
+	/* the records of a thread must stay in order */
+	if (m != next_method[t] || load->vma != method_vma(t, m)) {
+		printf("method %s out of order, expected m%d\n", name, next_method[t]);
+		nr_error++;
+	}
+	next_method[t] = m + 1;
+
+	code = (unsigned char const *)name + strlen(name) + 1;
+	for (i = 0; i < load->code_size; i++) {
+		if (code[i] != t) {
+			printf("bad code for method %s\n", name);
+			nr_error++;
+			break;
+		}
+	}
+}
+
+/* Check the dump file written by the last run_agent(). */
+static void check_dump(void)
+{
+	int next_method[MAX_THREADS] = { 0 };
+	int nr_records[JIT_CODE_DEBUG_INFO + 1] = { 0 };
+	char path[PATH_MAX];
+	struct stat st;
+	char * start, * end, * pos;
+	int fd, t;
+
+	snprintf(path, sizeof(path), "%s/%i.dump", JITDUMP_DIR, getpid());
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		printf("unable to open %s\n", path);
+		nr_error++;
+		return;
+	}
+	start = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (start == MAP_FAILED) {
+		printf("unable to map %s\n", path);
+		nr_error++;
+		return;
+	}
+
+	end = start + st.st_size;
+	pos = start + ((struct jitheader *)start)->totalsize;
+	while (pos + sizeof(struct jr_prefix) <= end) {
+		struct jr_prefix const * record = (struct jr_prefix const *)pos;
+
+		if (record->total_size < sizeof(*record) ||
+		    record->id > JIT_CODE_DEBUG_INFO ||
+		    pos + record->total_size > end)
+			break;
+		nr_records[record->id]++;
+		if (record->id == JIT_CODE_LOAD)
+			check_code_load((struct jr_code_load const *)pos, next_method);
+		pos += record->total_size;
+	}
+
+	if (pos != end) {
+		printf("bad record at offset %ld\n", (long)(pos - start));
+		nr_error++;
+	}
+	for (t = 0; t < nr_threads; t++) {
+		if (next_method[t] != nr_methods) {
+			printf("thread %d: %d methods written, %d expected\n",
+			       t, next_method[t], nr_methods);
+			nr_error++;
+		}
+	}
+	if (nr_records[JIT_CODE_LOAD] != nr_threads * nr_methods + 1 ||
+	    nr_records[JIT_CODE_CLOSE] != 1) {
+		printf("%d code loads and %d close records\n",
+		       nr_records[JIT_CODE_LOAD], nr_records[JIT_CODE_CLOSE]);
+		nr_error++;
+	}
+
+	munmap(start, st.st_size);
+	unlink(path);
+}
+
+static void do_test(void)
+{
+	run_agent(1, 4, 20000);
+	check_dump();
+
+	/* a second buffered agent can be opened once the first is closed */
+	run_agent(1, 1, 1000);
+	check_dump();
+}
+
+static void do_speed_test(void)
+{
+	double unbuffered, buffered;
+
+	unbuffered = run_agent(0, MAX_THREADS, 50000);
+	check_dump();
+	buffered = run_agent(1, MAX_THREADS, 50000);
+	check_dump();
+
+	printf("%d threads writing %d methods each: unbuffered %.3f s, "
+	       "buffered %.3f s\n", MAX_THREADS, 50000, unbuffered, buffered);
+}
+
+int main(int argc, char * argv[])
+{
+	do_test();
+
+	if (argc > 1 && !strcmp(argv[1], "--speed"))
+		do_speed_test();
+
+	if (nr_error)
+		printf("%d error occured\n", nr_error);
+
+	return nr_error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -14,8 +14,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/stat.h>
 #include <iostream>
+#include <fstream>
 #include <sstream>
+#include <string>
+#include <vector>
+#include <map>
 
 #include "operf_sfile.h"
 #include "operf_kernel.h"
@@ -25,6 +30,8 @@
 #include "operf_mangling.h"
 #include "operf_stats.h"
 #include "op_libiberty.h"
+#include "op_config.h"
+#include "op_session_index.h"
 
 #define HASH_SIZE 2048
 #define HASH_BITS (HASH_SIZE - 1)
@@ -35,6 +42,9 @@ static struct list_head hashes[HASH_SIZE];
 /** All sfiles are on this list. */
 static LIST_HEAD(lru_list);
 
+/** sample count of each sample file closed so far, by file name */
+static std::map<std::string, u64> sfile_totals;
+
 
 static unsigned long
 sfile_hash(struct operf_transient const * trans, struct operf_kernel_image * ki)
@@ -413,13 +423,30 @@ void operf_sfile_log_sample_count(struct operf_transient const * trans,
 }
 
 
+/** remember the sample count of an open sample file for the summary index */
+static void record_total(odb_t const * file)
+{
+	odb_node_nr_t node_nr, pos;
+	odb_node_t * node = odb_get_iterator(file, &node_nr);
+	u64 total = 0;
+
+	for (pos = 0; pos < node_nr; ++pos)
+		total += node[pos].value;
+
+	sfile_totals[file->data->filename] = total;
+}
+
+
 static int close_sfile(struct operf_sfile * sf, void * data __attribute__((unused)))
 {
 	size_t i;
 
 	/* it's OK to close a non-open odb file */
-	for (i = 0; i < op_nr_events; ++i)
+	for (i = 0; i < op_nr_events; ++i) {
+		if (odb_open_count(&sf->files[i]))
+			record_total(&sf->files[i]);
 		odb_close(&sf->files[i]);
+	}
 
 	// TODO: handle extended
 	//opd_ext_operf_sfile_close(sf);
@@ -519,6 +546,139 @@ void operf_sfile_close_files(void)
 }
 
 
+namespace {
+
+/** an index entry, see op_session_index.h */
+struct index_entry {
+	u64 total;
+	u64 size;
+	u64 mtime;
+};
+
+}
+
+
+/**
+ * load the index left by a previous conversion into this samples dir,
+ * return false if there is none or it is malformed
+ */
+static bool read_index(string const & filename, map<string, index_entry> & entries)
+{
+	ifstream in(filename.c_str(), ios::in | ios::binary);
+	struct op_session_index_header header;
+	struct stat st;
+
+	if (stat(filename.c_str(), &st) ||
+	    !in.read((char *)&header, sizeof(header)) ||
+	    memcmp(header.magic, OP_SESSION_INDEX_MAGIC, sizeof(header.magic)) ||
+	    header.version != OP_SESSION_INDEX_VERSION)
+		return false;
+
+	size_t const nr = header.nr_entries;
+	vector<u64> columns(3 * nr);
+	vector<u32> names(nr);
+	vector<char> strings(header.strings_size + 1);
+	if (nr && !in.read((char *)&columns[0], columns.size() * sizeof(u64)))
+		return false;
+	if (nr && !in.read((char *)&names[0], names.size() * sizeof(u32)))
+		return false;
+	if (!in.read(&strings[0], header.strings_size))
+		return false;
+
+	for (size_t i = 0; i < nr; ++i) {
+		if (names[i] >= header.strings_size)
+			return false;
+		index_entry entry = {
+			columns[i], columns[nr + i], columns[2 * nr + i]
+		};
+		/*
+		 * The previous index couldn't vouch for a file that wasn't
+		 * older than itself; keep it listed but never up to date.
+		 */
+		if (entry.mtime >= op_session_index_mtime(&st))
+			entry.mtime = 0;
+		entries[&strings[names[i]]] = entry;
+	}
+
+	return true;
+}
+
+
+template <typename T>
+static void write_column(ofstream & out, vector<T> const & column)
+{
+	if (!column.empty())
+		out.write((char const *)&column[0], column.size() * sizeof(T));
+}
+
+
+void operf_sfile_write_index(void)
+{
+	string const dir = op_samples_current_dir;
+	string const index = dir + OP_SESSION_INDEX_FILE;
+	map<string, index_entry> entries;
+
+	/*
+	 * With --append the files we didn't touch must be carried over from
+	 * the previous index. Without one we can't know them, and we would
+	 * hide them from the pp tools, so we don't write any index.
+	 */
+	if (operf_options::append && !read_index(index, entries)) {
+		remove(index.c_str());
+		sfile_totals.clear();
+		return;
+	}
+
+	map<string, u64>::const_iterator it;
+	for (it = sfile_totals.begin(); it != sfile_totals.end(); ++it) {
+		struct stat st;
+		if (it->first.compare(0, dir.length(), dir) ||
+		    stat(it->first.c_str(), &st))
+			continue;
+		index_entry const entry = { it->second, u64(st.st_size),
+		                            op_session_index_mtime(&st) };
+		entries[it->first.substr(dir.length())] = entry;
+	}
+	sfile_totals.clear();
+
+	/* entries is sorted by name, so is the index */
+	vector<u64> totals, sizes, mtimes;
+	vector<u32> names;
+	string strings;
+	map<string, index_entry>::const_iterator eit;
+	for (eit = entries.begin(); eit != entries.end(); ++eit) {
+		totals.push_back(eit->second.total);
+		sizes.push_back(eit->second.size);
+		mtimes.push_back(eit->second.mtime);
+		names.push_back(strings.length());
+		strings += eit->first;
+		strings += '\0';
+	}
+
+	struct op_session_index_header header;
+	memcpy(header.magic, OP_SESSION_INDEX_MAGIC, sizeof(header.magic));
+	header.version = OP_SESSION_INDEX_VERSION;
+	header.nr_entries = names.size();
+	header.strings_size = strings.length();
+
+	/* a reader must never see a partially written index */
+	string const tmp = index + ".tmp";
+	ofstream out(tmp.c_str(), ios::out | ios::binary);
+	out.write((char const *)&header, sizeof(header));
+	write_column(out, totals);
+	write_column(out, sizes);
+	write_column(out, mtimes);
+	write_column(out, names);
+	out.write(strings.data(), strings.length());
+	out.close();
+
+	if (!out || rename(tmp.c_str(), index.c_str())) {
+		cverb << vsfile << "Unable to write " << index << endl;
+		remove(tmp.c_str());
+	}
+}
+
+
 static int always_true(void)
 {
 	return 1;
@@ -116,6 +116,12 @@ void operf_sfile_sync_files(void);
 /** close sample files */
 void operf_sfile_close_files(void);
 
+/**
+ * write the summary index of the sample files closed so far, see
+ * op_session_index.h. Must be called after operf_sfile_close_files()
+ */
+void operf_sfile_write_index(void);
+
 /** clear out a certain amount of LRU entries
  * return non-zero if the lru is already empty */
 int operf_sfile_lru_clear(void);
@@ -870,6 +870,7 @@ void OP_perf_utils::op_release_resources(void)
 	delete kernel_mmap;
 
 	operf_sfile_close_files();
+	operf_sfile_write_index();
 	operf_free_modules_list();
 
 }
@@ -26,6 +26,7 @@
 
 namespace operf_options {
 extern bool system_wide;
+extern bool append;
 extern int pid;
 extern int mmap_pages_mult;
 extern std::string session_dir;
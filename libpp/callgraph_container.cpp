@@ -27,6 +27,8 @@
 #include "populate.h"
 #include "string_filter.h"
 #include "op_bfd.h"
+#include "op_bfd_cache.h"
+#include "op_parallel.h"
 #include "op_sample_file.h"
 #include "locate_images.h"
 #include "utility.h"
@@ -34,8 +36,51 @@
 
 using namespace std;
 
+extern verbose vbfd;
+
+
+/**
+ * The arcs of one cg file. Arcs are extracted from the sample file on
+ * worker threads, which only read the profile and the op_bfd symbols.
+ * The arc symbols are then created and recorded in cg file order. The
+ * images are only opened for the batch of cg files being processed.
+ */
+struct cg_file_arcs : noncopyable {
+	struct arc {
+		symbol_index_t caller;
+		symbol_index_t callee;
+		count_type count;
+	};
+
+	std::string filename;
+	std::string app_name;
+	size_t pclass;
+	scoped_ptr<shared_op_bfd> caller_bfd;
+	bool caller_bfd_ok;
+	scoped_ptr<shared_op_bfd> callee_bfd;
+	/// false if the sample file can't be used
+	bool usable;
+	u32 caller_offset;
+	u32 callee_offset;
+	/// sorted by caller
+	std::vector<arc> arcs;
+};
+
+
 namespace {
 
+/// libdb keeps a global list of opened sample files
+op_mutex odb_mutex;
+/// serialize warnings from the worker threads
+op_mutex output_mutex;
+
+/**
+ * nr. of cg files per thread processed at once. Their op_bfd stay
+ * referenced until their arcs are recorded, so this bounds the nr. of
+ * images open beside the unused ones kept by op_bfd_cache.
+ */
+size_t const cg_files_per_thread = 4;
+
 // we store {caller,callee} inside a single u64
 odb_key_t caller_to_key(u32 value)
 {
@@ -105,6 +150,7 @@ get_symbol_by_filepos(op_bfd const & bfd, u32 bfd_offset,
 	u32 const end_offset = it->size() + it->filepos();
 
 	if (offset >= end_offset) {
+		op_lock lock(output_mutex);
 		// let's be verbose for now
 		cerr << "warning: dropping hyperspace sample at offset "
 		     << hex << offset << " >= " << end_offset
@@ -117,14 +163,13 @@ get_symbol_by_filepos(op_bfd const & bfd, u32 bfd_offset,
 }
 
 
-/// temporary caller and callee data held during processing
+/// build the caller and callee symbols of the arcs of a cg file
 class call_data {
 public:
-	call_data(profile_container const & p, profile_t const & pr,
-	          op_bfd const & bfd, u32 boff, image_name_id iid,
-	          image_name_id aid, bool debug_info)
-		: callee_end(0), pc(p), profile(pr), b(bfd), boffset(boff),
-		  image(iid), app(aid), debug(debug_info) {}
+	call_data(profile_container const & p, op_bfd const & bfd, u32 boff,
+	          image_name_id iid, image_name_id aid, bool debug_info)
+		: pc(p), b(bfd), boffset(boff), image(iid), app(aid),
+		  debug(debug_info) {}
 
 	/// point to a caller symbol
 	void caller_sym(symbol_index_t i) {
@@ -134,29 +179,6 @@ public:
 		unsigned long long end;
 		b.get_symbol_range(i, start, end);
 
-		samples.clear();
-
-		// see profile_t::samples_range() for why we need this check
-		if (start > boffset) {
-			profile_t::iterator_pair p_it = profile.samples_range(
-				caller_to_key(start - boffset),
-				caller_to_key(end - boffset));
-
-			// Our odb_key_t contain (from_eip << 32 | to_eip),
-			// the range of keys we selected above contains one
-			// caller but different callees, and due to the
-			// ordering callee offsets are not consecutive: so
-			// we must sort them first.
-
-			for (; p_it.first != p_it.second; ++p_it.first) {
-				samples.push_back(make_pair(p_it.first.vma(),
-					p_it.first.count()));
-			}
-
-			sort(samples.begin(), samples.end(),
-			     compare_by_callee_vma);
-		}
-
 		sym.size = end - start;
 		sym.name = symbol_names.create(b.syms[i].name());
 		sym.sample.vma = b.syms[i].vma();
@@ -171,32 +193,24 @@ public:
 	}
 
 	/// point to a callee symbol
-	bool callee_sym(u32 off) {
+	void callee_sym(symbol_index_t i) {
 		sym = symbol_entry();
 
-		symbol_index_t i = 0;
-		op_bfd_symbol const * bfdsym =
-			get_symbol_by_filepos(b, boffset, off, i);
-
-		if (!bfdsym)
-			return false;
-
-		callee_end = bfdsym->size() + bfdsym->filepos() - boffset;
+		op_bfd_symbol const & bfdsym = b.syms[i];
 
-		sym.size = bfdsym->size();
-		sym.name = symbol_names.create(bfdsym->name());
-		sym.sample.vma = bfdsym->vma();
+		sym.size = bfdsym.size();
+		sym.name = symbol_names.create(bfdsym.name());
+		sym.sample.vma = bfdsym.vma();
 
-		finish_sym(i, bfdsym->filepos());
+		finish_sym(i, bfdsym.filepos());
 
 		if (cverb << vdebug) {
 			cverb << vdebug << hex << "Callee sym: "
-			      << bfdsym->name() << " filepos "
-			      << bfdsym->filepos() << "-"
-			      << (bfdsym->filepos() + bfdsym->size())
+			      << bfdsym.name() << " filepos "
+			      << bfdsym.filepos() << "-"
+			      << (bfdsym.filepos() + bfdsym.size())
 			      << dec << endl;
 		}
-		return true;
 	}
 
 	void verbose_bfd(string const & prefix) const {
@@ -205,13 +219,7 @@ public:
 		      << image_names.name(app) << endl;
 	}
 
-	typedef vector<pair<odb_key_t, count_type> > samples_t;
-
-	typedef samples_t::const_iterator const_iterator;
-
-	samples_t samples;
 	symbol_entry sym;
-	u32 callee_end;
 
 private:
 	/// fill in the rest of the sym
@@ -231,7 +239,6 @@ private:
 	}
 
 	profile_container const & pc;
-	profile_t const & profile;
 	op_bfd const & b;
 	u32 boffset;
 	image_name_id image;
@@ -240,13 +247,16 @@ private:
 };
 
 
+typedef vector<pair<odb_key_t, count_type> > samples_t;
+
+
 /// accumulate all samples for a given caller/callee pair
 count_type
-accumulate_callee(call_data::const_iterator & it, call_data::const_iterator end,
+accumulate_callee(samples_t::const_iterator & it, samples_t::const_iterator end,
                   u32 callee_end)
 {
 	count_type count = 0;
-	call_data::const_iterator const start = it;
+	samples_t::const_iterator const start = it;
 
 	while (it != end) {
 		u32 offset = key_to_callee(it->first);
@@ -275,24 +285,229 @@ accumulate_callee(call_data::const_iterator & it, call_data::const_iterator end,
 }
 
 
+/// extract the arcs of one cg file, this runs on worker threads
+void extract_arcs(cg_file_arcs & file)
+{
+	profile_t profile;
+	{
+		op_lock lock(odb_mutex);
+		// We can't use start_offset support in profile_t, give
+		// it a zero offset and we will fix that below
+		profile.add_sample_file(file.filename);
+	}
+
+	op_bfd const & caller_bfd = **file.caller_bfd;
+	op_bfd const & callee_bfd = **file.callee_bfd;
+	opd_header const & header = profile.get_header();
+
+	// We can't use kernel sample file w/o the binary else we will
+	// use it with a zero offset, the code below will abort because
+	// we will get incorrect callee sub-range and out of range
+	// callee vma. FIXME
+	if (header.is_kernel && !file.caller_bfd_ok)
+		return;
+
+	file.usable = true;
+
+	// We must handle start_offset, this offset can be different for the
+	// caller and the callee: kernel sample traversing the syscall barrier.
+	if (header.is_kernel)
+		file.caller_offset = caller_bfd.get_start_offset(0);
+	else
+		file.caller_offset = header.anon_start;
+
+	if (header.cg_to_is_kernel)
+		file.callee_offset = callee_bfd.get_start_offset(0);
+	else
+		file.callee_offset = header.cg_to_anon_start;
+
+	samples_t samples;
+
+	// For each symbol in the caller bfd, process all arcs to
+	// callee bfd symbols
+	for (symbol_index_t i = 0; i < caller_bfd.syms.size(); ++i) {
+		unsigned long long start;
+		unsigned long long end;
+		caller_bfd.get_symbol_range(i, start, end);
+
+		// see profile_t::samples_range() for why we need this check
+		if (start <= file.caller_offset)
+			continue;
+
+		profile_t::iterator_pair p_it = profile.samples_range(
+			caller_to_key(start - file.caller_offset),
+			caller_to_key(end - file.caller_offset));
+
+		// Our odb_key_t contain (from_eip << 32 | to_eip),
+		// the range of keys we selected above contains one
+		// caller but different callees, and due to the
+		// ordering callee offsets are not consecutive: so
+		// we must sort them first.
+		samples.clear();
+		for (; p_it.first != p_it.second; ++p_it.first) {
+			samples.push_back(make_pair(p_it.first.vma(),
+				p_it.first.count()));
+		}
+
+		sort(samples.begin(), samples.end(), compare_by_callee_vma);
+
+		samples_t::const_iterator dit = samples.begin();
+		samples_t::const_iterator const dend = samples.end();
+		while (dit != dend) {
+			symbol_index_t callee = 0;
+			op_bfd_symbol const * bfdsym = get_symbol_by_filepos(
+				callee_bfd, file.callee_offset,
+				key_to_callee(dit->first), callee);
+
+			// if we can't find the callee, skip an arc
+			if (!bfdsym) {
+				++dit;
+				continue;
+			}
+
+			u32 const callee_end = bfdsym->size()
+				+ bfdsym->filepos() - file.callee_offset;
+
+			cg_file_arcs::arc const arc = {
+				i, callee, accumulate_callee(dit, dend, callee_end)
+			};
+			file.arcs.push_back(arc);
+		}
+	}
+}
+
+
+struct extract_arcs_task : parallel_task {
+	extract_arcs_task(vector<cg_file_arcs *> const & f) : files(f) {}
+
+	void run(size_t i) { extract_arcs(*files[i]); }
+
+	vector<cg_file_arcs *> const & files;
+};
+
+
+/// owner of the cg files of a callgraph_container::populate()
+struct cg_file_list : noncopyable {
+	~cg_file_list() {
+		for (size_t i = 0; i < files.size(); ++i)
+			delete files[i];
+	}
+
+	vector<cg_file_arcs *> files;
+};
+
+
 } // anonymous namespace
 
 
+struct arc_recorder::less_arc_ids {
+	bool operator()(arc const & lhs, arc const & rhs) const {
+		if (lhs.caller != rhs.caller)
+			return lhs.caller < rhs.caller;
+		if (lhs.callee != rhs.callee)
+			return lhs.callee < rhs.callee;
+		return lhs.pclass < rhs.pclass;
+	}
+};
+
+
+struct arc_recorder::less_arc_callers {
+	less_arc_callers(vector<u32> const & r) : rank(r) {}
+
+	bool operator()(arc const & lhs, arc const & rhs) const {
+		if (lhs.caller != rhs.caller)
+			return rank[lhs.caller] < rank[rhs.caller];
+		if (lhs.callee != rhs.callee)
+			return rank[lhs.callee] < rank[rhs.callee];
+		return lhs.pclass < rhs.pclass;
+	}
+
+	vector<u32> const & rank;
+};
+
+
+struct arc_recorder::less_arc_callees {
+	less_arc_callees(vector<arc> const & a, vector<u32> const & r)
+		: arcs(a), rank(r) {}
+
+	bool operator()(size_t lhs, size_t rhs) const {
+		arc const & l = arcs[lhs];
+		arc const & r = arcs[rhs];
+		if (l.callee != r.callee)
+			return rank[l.callee] < rank[r.callee];
+		if (l.caller != r.caller)
+			return rank[l.caller] < rank[r.caller];
+		return l.pclass < r.pclass;
+	}
+
+	vector<arc> const & arcs;
+	vector<u32> const & rank;
+};
+
+
+u32 arc_recorder::symbol_id(symbol_entry const & sym)
+{
+	pair<symbol_ids_t::iterator, bool> res =
+		symbol_ids.insert(make_pair(sym, u32(symbols.size())));
+	if (res.second)
+		symbols.push_back(&res.first->first);
+	return res.first->second;
+}
+
+
+void arc_recorder::compact_arcs()
+{
+	sort(arcs.begin(), arcs.end(), less_arc_ids());
+
+	vector<arc>::iterator out = arcs.begin();
+	vector<arc>::const_iterator it = arcs.begin();
+	vector<arc>::const_iterator const end = arcs.end();
+	for (; it != end; ++it) {
+		if (out != arcs.begin() && out[-1].caller == it->caller &&
+		    out[-1].callee == it->callee &&
+		    out[-1].pclass == it->pclass)
+			out[-1].count += it->count;
+		else
+			*out++ = *it;
+	}
+	arcs.erase(out, arcs.end());
+
+	compacted_size = arcs.size();
+}
+
+
 void arc_recorder::
 add(symbol_entry const & caller, symbol_entry const * callee,
     count_array_t const & arc_count)
 {
-	cg_data & data = sym_map[caller];
-
-	// If we have a callee, add it to the caller's list, then
-	// add the caller to the callee's list.
-	if (callee) {
-		data.callees[*callee] += arc_count;
-
-		cg_data & callee_data = sym_map[*callee];
+	u32 const caller_id = symbol_id(caller);
+	if (!callee)
+		return;
 
-		callee_data.callers[caller] += arc_count;
+	arc new_arc;
+	new_arc.caller = caller_id;
+	new_arc.callee = symbol_id(*callee);
+	new_arc.pclass = 0;
+	new_arc.count = 0;
+
+	// one arc per non empty profile class, but at least one so the
+	// caller and callee are recorded as related
+	size_t const nr_classes = arc_count.size();
+	size_t const old_size = arcs.size();
+	for (size_t i = 0; i < nr_classes; ++i) {
+		if (!arc_count[i])
+			continue;
+		new_arc.pclass = i;
+		new_arc.count = arc_count[i];
+		arcs.push_back(new_arc);
 	}
+	if (arcs.size() == old_size)
+		arcs.push_back(new_arc);
+
+	// the same arcs come back for each sample file of an image, merge
+	// them from time to time to bound the memory used
+	if (arcs.size() >= 2 * compacted_size + 65536)
+		compact_arcs();
 }
 
 
@@ -338,12 +553,47 @@ void arc_recorder::
 process(count_array_t total, double threshold,
         string_filter const & sym_filter)
 {
-	map_t::const_iterator it;
-	map_t::const_iterator end = sym_map.end();
+	compact_arcs();
+
+	size_t const nr_symbols = symbols.size();
+
+	// the output is in symbol order, not in id order
+	vector<u32> rank(nr_symbols);
+	symbol_ids_t::const_iterator sit = symbol_ids.begin();
+	for (u32 r = 0; sit != symbol_ids.end(); ++sit, ++r)
+		rank[sit->second] = r;
+
+	// arcs sorted by caller, callees of the symbol of rank r are in
+	// [callees_start[r], callees_start[r + 1])
+	sort(arcs.begin(), arcs.end(), less_arc_callers(rank));
+	vector<size_t> callees_start(nr_symbols + 1, 0);
+	for (size_t i = 0; i < arcs.size(); ++i)
+		++callees_start[rank[arcs[i].caller] + 1];
+	partial_sum(callees_start.begin(), callees_start.end(),
+	            callees_start.begin());
+
+	// the same by callee, through a permutation of arcs
+	vector<size_t> by_callee(arcs.size());
+	for (size_t i = 0; i < by_callee.size(); ++i)
+		by_callee[i] = i;
+	sort(by_callee.begin(), by_callee.end(), less_arc_callees(arcs, rank));
+	vector<size_t> callers_start(nr_symbols + 1, 0);
+	for (size_t i = 0; i < arcs.size(); ++i)
+		++callers_start[rank[arcs[i].callee] + 1];
+	partial_sum(callers_start.begin(), callers_start.end(),
+	            callers_start.begin());
+
+	// the filter below needs the names of the symbols above threshold
+	vector<symbol_name_id> names;
+	for (size_t i = 0; i < nr_symbols; ++i) {
+		if (op_ratio(symbols[i]->sample.counts[0], total[0]) >= threshold)
+			names.push_back(symbols[i]->name);
+	}
+	symbol_names.demangle(names);
 
-	for (it = sym_map.begin(); it != end; ++it) {
-		cg_symbol sym((*it).first);
-		cg_data const & data = (*it).second;
+	u32 r = 0;
+	for (sit = symbol_ids.begin(); sit != symbol_ids.end(); ++sit, ++r) {
+		cg_symbol sym(sit->first);
 
 		// threshold out the main symbol if needed
 		if (op_ratio(sym.sample.counts[0], total[0]) < threshold)
@@ -353,23 +603,30 @@ process(count_array_t total, double threshold,
 		if (!sym_filter.match(symbol_names.demangle(sym.name)))
 			continue;
 
-		cg_data::children::const_iterator cit;
-		cg_data::children::const_iterator cend = data.callers.end();
-
-		for (cit = data.callers.begin(); cit != cend; ++cit) {
-			symbol_entry csym = cit->first;
-			csym.sample.counts = cit->second;
+		// arcs for the same pair of symbols are adjacent, one per
+		// profile class
+		for (size_t i = callers_start[r]; i != callers_start[r + 1]; ) {
+			u32 const caller = arcs[by_callee[i]].caller;
+			symbol_entry csym = *symbols[caller];
+			csym.sample.counts = count_array_t();
+			for (; i != callers_start[r + 1] &&
+			       arcs[by_callee[i]].caller == caller; ++i) {
+				arc const & a = arcs[by_callee[i]];
+				csym.sample.counts[a.pclass] += a.count;
+			}
 			sym.callers.push_back(csym);
-			sym.total_caller_count += cit->second;
+			sym.total_caller_count += csym.sample.counts;
 		}
 
-		cend = data.callees.end();
-
-		for (cit = data.callees.begin(); cit != cend; ++cit) {
-			symbol_entry csym = cit->first;
-			csym.sample.counts = cit->second;
+		for (size_t i = callees_start[r]; i != callees_start[r + 1]; ) {
+			u32 const callee = arcs[i].callee;
+			symbol_entry csym = *symbols[callee];
+			csym.sample.counts = count_array_t();
+			for (; i != callees_start[r + 1] &&
+			       arcs[i].callee == callee; ++i)
+				csym.sample.counts[arcs[i].pclass] += arcs[i].count;
 			sym.callees.push_back(csym);
-			sym.total_callee_count += cit->second;
+			sym.total_callee_count += csym.sample.counts;
 		}
 
 		process_children(sym, threshold);
@@ -407,10 +664,36 @@ void callgraph_container::populate(list<inverted_profile> const & iprofiles,
 
 	total_count = pc.samples_count();
 
+	cg_file_list cg_files;
 	for (it = iprofiles.begin(); it != end; ++it) {
 		for (size_t i = 0; i < it->groups.size(); ++i) {
 			populate(it->groups[i], it->image,
-				i, pc, debug_info, merge_lib);
+				i, merge_lib, cg_files.files);
+		}
+	}
+
+	// cverb isn't thread safe
+	size_t nr_threads = op_nr_cpus();
+	if ((cverb << vdebug) || (cverb << vbfd))
+		nr_threads = 1;
+
+	vector<cg_file_arcs *> & files = cg_files.files;
+	size_t const batch_size = nr_threads * cg_files_per_thread;
+	for (size_t first = 0; first < files.size(); first += batch_size) {
+		vector<cg_file_arcs *> const batch(files.begin() + first,
+			files.begin() + min(files.size(), first + batch_size));
+
+		for (size_t i = 0; i < batch.size(); ++i)
+			open_cg_file(*batch[i]);
+
+		extract_arcs_task task(batch);
+		parallel_for(batch.size(), task, nr_threads);
+
+		// release the images and arcs as soon as they are recorded
+		for (size_t i = 0; i < batch.size(); ++i) {
+			add(*batch[i], pc, debug_info);
+			delete batch[i];
+			files[first + i] = 0;
 		}
 	}
 
@@ -419,8 +702,8 @@ void callgraph_container::populate(list<inverted_profile> const & iprofiles,
 
 
 void callgraph_container::populate(list<image_set> const & lset,
-	string const & app_image, size_t pclass,
-	profile_container const & pc, bool debug_info, bool merge_lib)
+	string const & app_image, size_t pclass, bool merge_lib,
+	vector<cg_file_arcs *> & files)
 {
 	list<image_set>::const_iterator lit;
 	list<image_set>::const_iterator const lend = lset.end();
@@ -429,155 +712,104 @@ void callgraph_container::populate(list<image_set> const & lset,
 		list<profile_sample_files>::const_iterator pend
 			= lit->files.end();
 		for (pit = lit->files.begin(); pit != pend; ++pit) {
-			populate(pit->cg_files, app_image,
-				 pclass, pc, debug_info, merge_lib);
+			list<string>::const_iterator it;
+			list<string>::const_iterator const end
+				= pit->cg_files.end();
+			for (it = pit->cg_files.begin(); it != end; ++it) {
+				cg_file_arcs * file = new cg_file_arcs;
+				file->filename = *it;
+				file->pclass = pclass;
+				file->app_name = merge_lib ? app_image
+					: parse_filename(*it,
+					      extra_found_images).image;
+				file->usable = false;
+				file->caller_offset = 0;
+				file->callee_offset = 0;
+				files.push_back(file);
+			}
 		}
 	}
 }
 
 
-void callgraph_container::populate(list<string> const & cg_files,
-	string const & app_image, size_t pclass,
-	profile_container const & pc, bool debug_info, bool merge_lib)
+void callgraph_container::open_cg_file(cg_file_arcs & file)
 {
-	list<string>::const_iterator it;
-	list<string>::const_iterator const end = cg_files.end();
-	for (it = cg_files.begin(); it != end; ++it) {
-		cverb << vdebug << "samples file : " << *it << endl;
-		op_bfd *caller_bfd;
-		op_bfd *callee_bfd;
-
-		parsed_filename caller_file =
-			parse_filename(*it, extra_found_images);
-		string const app_name = caller_file.image;
+	cverb << vdebug << "samples file : " << file.filename << endl;
 
-		image_error error;
-		extra_found_images.find_image_path(caller_file.lib_image,
-				error, false);
+	parsed_filename caller_file =
+		parse_filename(file.filename, extra_found_images);
 
-		if (error != image_ok)
-			report_image_error(caller_file.lib_image,
-					   error, false, extra_found_images);
+	image_error error;
+	extra_found_images.find_image_path(caller_file.lib_image,
+			error, false);
 
-		bool caller_bfd_ok = true;
+	if (error != image_ok)
+		report_image_error(caller_file.lib_image,
+				   error, false, extra_found_images);
 
-		if (strncmp(caller_file.lib_image.c_str(), KALL_SYM_FILE,
-			    strlen(caller_file.lib_image.c_str())) == 0)
-			caller_bfd = new op_bfd(caller_file.lib_image, extra_found_images);
+	file.caller_bfd_ok = true;
+	file.caller_bfd.reset(new shared_op_bfd(caller_file.lib_image,
+		string_filter(), extra_found_images, file.caller_bfd_ok));
 
-		else
-			caller_bfd = new op_bfd(caller_file.lib_image, string_filter(),
-						extra_found_images, caller_bfd_ok);
+	if (!file.caller_bfd_ok)
+		report_image_error(caller_file.lib_image,
+		                   image_format_failure, false,
+				   extra_found_images);
 
-		if (!caller_bfd_ok)
-			report_image_error(caller_file.lib_image,
-			                   image_format_failure, false,
-					   extra_found_images);
+	parsed_filename callee_file =
+		parse_filename(file.filename, extra_found_images);
 
-		parsed_filename callee_file =
-			parse_filename(*it, extra_found_images);
+	extra_found_images.find_image_path(callee_file.cg_image,
+			error, false);
+	if (error != image_ok)
+		report_image_error(callee_file.cg_image,
+				   error, false, extra_found_images);
 
-		extra_found_images.find_image_path(callee_file.cg_image,
-				error, false);
-		if (error != image_ok)
-			report_image_error(callee_file.cg_image,
-					   error, false, extra_found_images);
+	bool callee_bfd_ok = true;
+	file.callee_bfd.reset(new shared_op_bfd(callee_file.cg_image,
+		string_filter(), extra_found_images, callee_bfd_ok));
 
-		bool callee_bfd_ok = true;
-		if (strncmp(callee_file.cg_image.c_str(), KALL_SYM_FILE,
-			    strlen(callee_file.lib_image.c_str())) == 0)
-			callee_bfd = new op_bfd(callee_file.cg_image, extra_found_images);
-
-		else
-			callee_bfd = new op_bfd(callee_file.cg_image, string_filter(),
-						extra_found_images, callee_bfd_ok);
-
-		if (!callee_bfd_ok)
-			report_image_error(callee_file.cg_image,
-		                           image_format_failure, false,
-					   extra_found_images);
-
-		profile_t profile;
-		// We can't use start_offset support in profile_t, give
-		// it a zero offset and we will fix that in add()
-		profile.add_sample_file(*it);
-
-		add(profile, *caller_bfd, caller_bfd_ok, *callee_bfd,
-		    merge_lib ? app_image : app_name, pc,
-		    debug_info, pclass);
-
-		delete caller_bfd;
-		delete callee_bfd;
-	}
+	if (!callee_bfd_ok)
+		report_image_error(callee_file.cg_image,
+	                           image_format_failure, false,
+				   extra_found_images);
 }
 
 
 void callgraph_container::
-add(profile_t const & profile, op_bfd const & caller_bfd, bool caller_bfd_ok,
-   op_bfd const & callee_bfd, string const & app_name,
-   profile_container const & pc, bool debug_info, size_t pclass)
+add(cg_file_arcs const & file, profile_container const & pc, bool debug_info)
 {
-	string const image_name = caller_bfd.get_filename();
-
-	opd_header const & header = profile.get_header();
-
-	// We can't use kernel sample file w/o the binary else we will
-	// use it with a zero offset, the code below will abort because
-	// we will get incorrect callee sub-range and out of range
-	// callee vma. FIXME
-	if (header.is_kernel && !caller_bfd_ok)
+	if (!file.usable)
 		return;
 
-	// We must handle start_offset, this offset can be different for the
-	// caller and the callee: kernel sample traversing the syscall barrier.
-	u32 caller_offset;
-	if (header.is_kernel)
-		caller_offset = caller_bfd.get_start_offset(0);
-	else
-		caller_offset = header.anon_start;
+	op_bfd const & caller_bfd = **file.caller_bfd;
+	op_bfd const & callee_bfd = **file.callee_bfd;
 
-	u32 callee_offset;
-	if (header.cg_to_is_kernel)
-		callee_offset = callee_bfd.get_start_offset(0);
-	else
-		callee_offset = header.cg_to_anon_start;
-
-	image_name_id image_id = image_names.create(image_name);
+	image_name_id image_id = image_names.create(caller_bfd.get_filename());
 	image_name_id callee_image_id = image_names.create(callee_bfd.get_filename());
-	image_name_id app_id = image_names.create(app_name);
+	image_name_id app_id = image_names.create(file.app_name);
 
-	call_data caller(pc, profile, caller_bfd, caller_offset, image_id,
-	                   app_id, debug_info);
-	call_data callee(pc, profile, callee_bfd, callee_offset,
-	                   callee_image_id, app_id, debug_info);
+	call_data caller(pc, caller_bfd, file.caller_offset, image_id,
+	                 app_id, debug_info);
+	call_data callee(pc, callee_bfd, file.callee_offset,
+	                 callee_image_id, app_id, debug_info);
 
 	if (cverb << vdebug) {
 		caller.verbose_bfd("Caller:");
 		callee.verbose_bfd("Callee:");
 	}
 
-	// For each symbol in the caller bfd, process all arcs to
-	// callee bfd symbols
+	vector<cg_file_arcs::arc>::const_iterator it = file.arcs.begin();
+	vector<cg_file_arcs::arc>::const_iterator const end = file.arcs.end();
+	for (; it != end; ++it) {
+		if (it == file.arcs.begin() || it[-1].caller != it->caller)
+			caller.caller_sym(it->caller);
+		callee.callee_sym(it->callee);
 
-	for (symbol_index_t i = 0; i < caller_bfd.syms.size(); ++i) {
-
-		caller.caller_sym(i);
-
-		call_data::const_iterator dit = caller.samples.begin();
-		call_data::const_iterator dend = caller.samples.end();
-		while (dit != dend) {
-			// if we can't find the callee, skip an arc
-			if (!callee.callee_sym(key_to_callee(dit->first))) {
-				++dit;
-				continue;
-			}
+		count_array_t arc_count;
+		arc_count[file.pclass] = it->count;
 
-			count_array_t arc_count;
-			arc_count[pclass] =
-				accumulate_callee(dit, dend, callee.callee_end);
-
-			recorder.add(caller.sym, &callee.sym, arc_count);
-		}
+		recorder.add(caller.sym, &callee.sym, arc_count);
 	}
 }
 
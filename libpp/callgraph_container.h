@@ -26,6 +26,7 @@ class inverted_profile;
 class profile_t;
 class image_set;
 class op_bfd;
+struct cg_file_arcs;
 
 
 /**
@@ -37,6 +38,7 @@ class op_bfd;
  */
 class arc_recorder {
 public:
+	arc_recorder() : compacted_size(0) {}
 	~arc_recorder() {}
 
 	/**
@@ -64,31 +66,48 @@ public:
 
 private:
 	/**
-	 * Internal structure used during collation. We use a map to
-	 * allow quick lookup of children (we'll do this several times
-	 * if we have more than one profile class). Each child maps from
-	 * the symbol to the relevant arc data.
+	 * An arc for one profile class between two symbols, symbols are
+	 * interned so an arc is a few integers rather than two copies of
+	 * symbol_entry.
 	 */
-	struct cg_data {
-		cg_data() {}
+	struct arc {
+		u32 caller;
+		u32 callee;
+		u32 pclass;
+		count_type count;
+	};
 
-		typedef std::map<symbol_entry, count_array_t, less_symbol> children;
+	/// order arcs by caller, callee and profile class ids
+	struct less_arc_ids;
+	/// order arcs by caller then callee in symbol order
+	struct less_arc_callers;
+	/// order arcs by callee then caller in symbol order
+	struct less_arc_callees;
 
-		/// callers of this symbol
-		children callers;
-		/// callees of this symbol
-		children callees;
-	};
+	/// return the id of sym, interning it on first use
+	u32 symbol_id(symbol_entry const & sym);
+
+	/// sort the arcs by ids and merge the duplicated ones
+	void compact_arcs();
 
 	/**
 	 * Sort and threshold callers and callees.
 	 */
 	void process_children(cg_symbol & sym, double threshold);
 
-	typedef std::map<symbol_entry, cg_data, less_symbol> map_t;
+	typedef std::map<symbol_entry, u32, less_symbol> symbol_ids_t;
+
+	/// all the symbols, iterating gives the ids in symbol order
+	symbol_ids_t symbol_ids;
 
-	/// all the symbols (used during processing)
-	map_t sym_map;
+	/// interned symbols by id, these point into symbol_ids
+	std::vector<symbol_entry const *> symbols;
+
+	/// all the arcs (used during processing)
+	std::vector<arc> arcs;
+
+	/// size of arcs after the last compact_arcs()
+	size_t compacted_size;
 
 	/// symbol objects pointed to by pointers in vector cg_syms
 	cg_collection_objs cg_syms_objs;
@@ -130,30 +149,25 @@ public:
 	symbol_collection const & get_symbols() const;
 
 private:
+	/// queue the cg files of lset, the arcs are extracted later
+	void populate(std::list<image_set> const & lset,
+		      std::string const & app_image, size_t pclass,
+		      bool merge_lib, std::vector<cg_file_arcs *> & files);
+
+	/**
+	 * Open the caller and callee images of a queued cg file. Image
+	 * errors are reported here.
+	 */
+	void open_cg_file(cg_file_arcs & file);
+
 	/**
 	 * Record caller/callee for one cg file
-	 * @param profile  one callgraph file stored in a profile_t
-	 * @param caller_bfd  the caller bfd
-	 * @param bfd_caller_ok  true if we succefully open the binary
-	 * @param callee_bfd  the callee bfd
-	 * @param app_name  the owning application
+	 * @param file  the cg file and the arcs extracted from it
 	 * @param pc  the profile_container holding all non cg samples.
 	 * @param debug_info  record linenr debug information
-	 * @param pclass  profile class nr
 	 */
-	void add(profile_t const & profile, op_bfd const & caller_bfd,
-	         bool bfd_caller_ok, op_bfd const & callee_bfd,
-		 std::string const & app_name, profile_container const & pc,
-		 bool debug_info, size_t pclass);
-
-	void populate(std::list<image_set> const & lset,
-		      std::string const & app_image,
-		      size_t pclass, profile_container const & pc,
-		      bool debug_info, bool merge_lib);
-	void populate(std::list<std::string> const & cg_files,
-		      std::string const & app_image,
-		      size_t pclass, profile_container const & pc,
-		      bool debug_info, bool merge_lib);
+	void add(cg_file_arcs const & file, profile_container const & pc,
+	         bool debug_info);
 
 	/// record all main symbols
 	void add_symbols(profile_container const & pc);
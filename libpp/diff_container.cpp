@@ -17,6 +17,7 @@
 #include "diff_container.h"
 
 #include <cmath>
+#include <algorithm>
 
 using namespace std;
 
@@ -104,8 +105,22 @@ void symbol_diff(diff_collection & syms,
 }; // namespace anon
 
 
-diff_container::diff_container(profile_container const & c1,
-                               profile_container const & c2)
+void diff_summary::add(profile_container const & pc)
+{
+	symbols.insert(symbols.end(), pc.begin_symbol(), pc.end_symbol());
+	total += pc.samples_count();
+}
+
+
+void diff_summary::sort()
+{
+	// each profile_container added is already in rough_less() order
+	stable_sort(symbols.begin(), symbols.end(), rough_less);
+}
+
+
+diff_container::diff_container(diff_summary const & c1,
+                               diff_summary const & c2)
 	: pc1(c1), pc2(c2),
 	  total1(pc1.samples_count()), total2(pc2.samples_count())
 {
@@ -119,15 +134,15 @@ diff_container::get_symbols(profile_container::symbol_choice & choice) const
 
 	/*
 	 * Do a pairwise comparison of the two symbol sets. We're
-	 * relying here on the symbol container being sorted such
-	 * that rough_less() is suitable for iterating through the
-	 * two lists (see less_symbol).
+	 * relying here on the summaries being sorted such that
+	 * rough_less() is suitable for iterating through the two
+	 * lists (see diff_summary::sort()).
 	 */
 
-	symbol_container::symbols_t::iterator it1 = pc1.begin_symbol();
-	symbol_container::symbols_t::iterator end1 = pc1.end_symbol();
-	symbol_container::symbols_t::iterator it2 = pc2.begin_symbol();
-	symbol_container::symbols_t::iterator end2 = pc2.end_symbol();
+	diff_summary::const_iterator it1 = pc1.begin();
+	diff_summary::const_iterator const end1 = pc1.end();
+	diff_summary::const_iterator it2 = pc2.begin();
+	diff_summary::const_iterator const end2 = pc2.end();
 
 	while (it1 != end1 && it2 != end2) {
 		if (rough_less(*it1, *it2)) {
@@ -149,6 +164,11 @@ diff_container::get_symbols(profile_container::symbol_choice & choice) const
 	for (; it2 != end2; ++it2)
 		symbol_new(syms, *it2, choice);
 
+	vector<symbol_name_id> names(syms.size());
+	for (size_t i = 0; i < syms.size(); ++i)
+		names[i] = syms[i].name;
+	symbol_names.demangle(names);
+
 	return syms;
 }
 
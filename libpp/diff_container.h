@@ -12,17 +12,52 @@
 #ifndef DIFF_CONTAINER_H
 #define DIFF_CONTAINER_H
 
+#include <vector>
+
 #include "profile_container.h"
 
 
+/**
+ * The symbols of a profile, the only information needed to diff it
+ * against another one. A profile is summarized one image at a time, so
+ * only the profile_container of one image is alive at once.
+ */
+class diff_summary : noncopyable {
+public:
+	typedef std::vector<symbol_entry>::const_iterator const_iterator;
+
+	diff_summary() {}
+
+	/// add the symbols and the samples count of pc
+	void add(profile_container const & pc);
+
+	/**
+	 * Sort the symbols for diffing, once all are added. Symbols with
+	 * the same image, application and name keep their order.
+	 */
+	void sort();
+
+	const_iterator begin() const { return symbols.begin(); }
+	const_iterator end() const { return symbols.end(); }
+
+	/// total count of the profile
+	count_array_t const & samples_count() const { return total; }
+
+private:
+	std::vector<symbol_entry> symbols;
+
+	count_array_t total;
+};
+
+
 /**
  * Store two profiles for diffing.
  */
 class diff_container : noncopyable {
 public:
-	/// populate the collection of diffed symbols
-	diff_container(profile_container const & pc1,
-	               profile_container const & pc2);
+	/// populate the collection of diffed symbols, see diff_summary::sort()
+	diff_container(diff_summary const & old_profile,
+	               diff_summary const & new_profile);
 
 	~diff_container() {}
  
@@ -35,10 +70,10 @@ public:
 
 private:
 	/// first profile
-	profile_container const & pc1;
+	diff_summary const & pc1;
 
 	/// second profile
-	profile_container const & pc2;
+	diff_summary const & pc2;
 
 	/// samples count for pc1
 	count_array_t total1;
@@ -570,21 +570,54 @@ void diff_formatter::output(ostream & out, diff_collection const & syms)
 }
 
 // local variables used in generation of XML
-// buffer details for output later
-ostringstream bytes_out;
+
+/**
+ * A symbol is identified by its image, once resolved through the extra
+ * images, and its name. The image is numbered by image_index().
+ */
+typedef pair<size_t, symbol_name_id> symbol_key;
+
+// resolved image name to image nr., and a cache of it by image_name_id
+map<string, size_t> image_table;
+map<image_name_id, size_t> image_ids;
 
 // module+symbol table for detecting duplicate symbols
-map<string, size_t> symbol_data_table;
+map<symbol_key, size_t> symbol_data_table;
 size_t symbol_data_index = 0;
 
+// symbols and their table id, to output in the bytesTable
+vector<pair<symbol_entry const *, size_t> > symbol_bytes;
+
+
+size_t image_index(image_name_id id, extra_images const & extra)
+{
+	map<image_name_id, size_t>::const_iterator it = image_ids.find(id);
+	if (it != image_ids.end())
+		return it->second;
+
+	string const & image = get_image_name(id,
+		image_name_storage::int_filename, extra);
+	size_t const index = image_table.insert(
+		make_pair(image, image_table.size())).first->second;
+	image_ids[id] = index;
+	return index;
+}
+
+
+symbol_key get_symbol_key(symbol_entry const & symb, extra_images const & extra)
+{
+	return symbol_key(image_index(symb.image_name, extra), symb.name);
+}
+
+
 /* Return any existing index or add to the table */
-size_t xml_get_symbol_index(string const & name)
+size_t xml_get_symbol_index(symbol_key const & key)
 {
 	size_t index = symbol_data_index;
-	map<string, size_t>::iterator it = symbol_data_table.find(name);
+	map<symbol_key, size_t>::iterator it = symbol_data_table.find(key);
 
 	if (it == symbol_data_table.end()) {
-		symbol_data_table[name] = symbol_data_index++;
+		symbol_data_table[key] = symbol_data_index++;
 		return index;
 	}
 
@@ -592,13 +625,21 @@ size_t xml_get_symbol_index(string const & name)
 }
 
 
+/// the samples of a symbol in a range of profile classes
+struct detail_range {
+	symbol_entry const * symb;
+	size_t lo;
+	size_t hi;
+};
+
 class symbol_details_t {
 public:
 	symbol_details_t() { size = index = 0; id = -1; }
 	int id;
 	size_t size;
 	size_t index;
-	string details;
+	/// the detailData are output from these after the symbolTable
+	vector<detail_range> ranges;
 };
 
 typedef growable_vector<symbol_details_t> symbol_details_array_t;
@@ -636,27 +677,32 @@ void xml_formatter::output(ostream & out)
 	xml_support->output_program_structure(out);
 	output_symbol_data(out);
 	if (need_details) {
-		out << open_element(DETAIL_TABLE);
+		open_element(out, DETAIL_TABLE);
 		for (size_t i = 0; i < symbol_details.size(); ++i) {
-			int id = symbol_details[i].id;
-
-			if (id >= 0) {
-				out << open_element(SYMBOL_DETAILS, true);
-				out << init_attr(TABLE_ID, (size_t)id);
-				out << close_element(NONE, true);
-				out << symbol_details[i].details;
-				out << close_element(SYMBOL_DETAILS);
+			symbol_details_t & sd = symbol_details[i];
+
+			if (sd.id >= 0) {
+				open_element(out, SYMBOL_DETAILS, true);
+				init_attr(out, TABLE_ID, (size_t)sd.id);
+				close_element(out, NONE, true);
+				size_t detail_index = 0;
+				for (size_t r = 0; r < sd.ranges.size(); ++r) {
+					detail_range const & range = sd.ranges[r];
+					output_symbol_details(out, range.symb,
+						detail_index, range.lo, range.hi);
+				}
+				close_element(out, SYMBOL_DETAILS);
 			}
 		}
-		out << close_element(DETAIL_TABLE);
+		close_element(out, DETAIL_TABLE);
 
 		// output bytesTable
-		out << open_element(BYTES_TABLE);
-		out << bytes_out.str();
-		out << close_element(BYTES_TABLE);
+		open_element(out, BYTES_TABLE);
+		output_symbol_bytes(out);
+		close_element(out, BYTES_TABLE);
 	}
 
-	out << close_element(PROFILE);
+	close_element(out, PROFILE);
 }
 
 bool
@@ -698,20 +744,18 @@ xml_formatter::get_bfd_object(symbol_entry const * symb, op_bfd * & abfd) const
 }
 
 void xml_formatter::
-output_the_symbol_data(ostream & out, symbol_entry const * symb, op_bfd * & abfd)
+output_the_symbol_data(ostream & out, symbol_entry const * symb)
 {
-	string const name = symbol_names.name(symb->name);
+	string const & name = symbol_names.name(symb->name);
 	assert(name.size() > 0);
 
-	string const image = get_image_name(symb->image_name,
-		image_name_storage::int_filename, extra_found_images);
-	string const qname = image + ":" + name;
-	map<string, size_t>::iterator sd_it = symbol_data_table.find(qname);
+	map<symbol_key, size_t>::iterator sd_it =
+		symbol_data_table.find(get_symbol_key(*symb, extra_found_images));
 
 	if (sd_it != symbol_data_table.end()) {
 		// first time we've seen this symbol
-		out << open_element(SYMBOL_DATA, true);
-		out << init_attr(TABLE_ID, sd_it->second);
+		open_element(out, SYMBOL_DATA, true);
+		init_attr(out, TABLE_ID, sd_it->second);
 
 		field_datum datum(*symb, symb->sample, 0, counts,
 				  extra_found_images);
@@ -726,72 +770,101 @@ output_the_symbol_data(ostream & out, symbol_entry const * symb, op_bfd * & abfd
 		if (name.size() > 0 && name[0] != '?') {
 			output_attribute(out, datum, ff_vma, STARTING_ADDR);
 
-			if (need_details) {
-				get_bfd_object(symb, abfd);
-				if (abfd && abfd->symbol_has_contents(symb->sym_index))
-					xml_support->output_symbol_bytes(bytes_out, symb, sd_it->second, *abfd);
-			}
+			// the bytes are read once the symbolTable is output
+			if (need_details)
+				symbol_bytes.push_back(
+					make_pair(symb, sd_it->second));
 		}
-		out << close_element();
+		close_element(out);
 
 		// seen so remove (otherwise get several "no symbols")
-		symbol_data_table.erase(qname);
+		symbol_data_table.erase(sd_it);
 	}
 }
 
 void xml_formatter::output_cg_children(ostream & out, 
-	cg_symbol::children const cg_symb, op_bfd * & abfd)
+	cg_symbol::children const & cg_symb)
 {
 	cg_symbol::children::const_iterator cit;
 	cg_symbol::children::const_iterator cend = cg_symb.end();
 
-	for (cit = cg_symb.begin(); cit != cend; ++cit) {
-		string const name = symbol_names.name(cit->name);
-		string const image = get_image_name(cit->image_name,
-			image_name_storage::int_filename, extra_found_images);
-		string const qname = image + ":" + name;
-		map<string, size_t>::iterator sd_it = symbol_data_table.find(qname);
-
-		if (sd_it != symbol_data_table.end()) {
-			symbol_entry const * child = &(*cit);
-			output_the_symbol_data(out, child, abfd);
-		}
-	}
+	for (cit = cg_symb.begin(); cit != cend; ++cit)
+		output_the_symbol_data(out, &(*cit));
 }
 
 void xml_formatter::output_symbol_data(ostream & out)
 {
-	op_bfd * abfd = NULL;
 	sym_iterator it = symbols.begin();
 	sym_iterator end = symbols.end();
 
-	out << open_element(SYMBOL_TABLE);
+	open_element(out, SYMBOL_TABLE);
 	for ( ; it != end; ++it) {
 		symbol_entry const * symb = *it;
 		cg_symbol const * cg_symb = dynamic_cast<cg_symbol const *>(symb);
-		output_the_symbol_data(out, symb, abfd);
+		output_the_symbol_data(out, symb);
 		if (cg_symb) {
 			/* make sure callers/callees are included in SYMBOL_TABLE */
-			output_cg_children(out, cg_symb->callers, abfd);
-			output_cg_children(out, cg_symb->callees, abfd);
+			output_cg_children(out, cg_symb->callers);
+			output_cg_children(out, cg_symb->callees);
 		}
 	}
-	out << close_element(SYMBOL_TABLE);
+	close_element(out, SYMBOL_TABLE);
+}
+
+
+void xml_formatter::output_symbol_bytes(ostream & out)
+{
+	op_bfd * abfd = NULL;
+
+	for (size_t i = 0; i < symbol_bytes.size(); ++i) {
+		symbol_entry const * symb = symbol_bytes[i].first;
+
+		get_bfd_object(symb, abfd);
+		if (abfd && abfd->symbol_has_contents(symb->sym_index))
+			xml_support->output_symbol_bytes(out, symb,
+				symbol_bytes[i].second, *abfd);
+	}
 
 	delete abfd;
 }
 
-string  xml_formatter::
-output_symbol_details(symbol_entry const * symb,
+
+size_t xml_formatter::
+count_symbol_details(symbol_entry const * symb, size_t lo, size_t hi) const
+{
+	if (!has_sample_counts(symb->sample.counts, lo, hi))
+		return 0;
+
+	sample_container::samples_iterator it = profile->begin(symb);
+	sample_container::samples_iterator end = profile->end(symb);
+
+	size_t nr = 0;
+	for (; it != end; ++it) {
+		for (size_t p = lo; p <= hi; ++p)  {
+			if (it->second.counts[p] != 0)
+				++nr;
+		}
+	}
+	return nr;
+}
+
+
+void xml_formatter::
+output_symbol_details(ostream & out, symbol_entry const * symb,
     size_t & detail_index, size_t const lo, size_t const hi)
 {
 	if (!has_sample_counts(symb->sample.counts, lo, hi))
-		return "";
+		return;
 
 	sample_container::samples_iterator it = profile->begin(symb);
 	sample_container::samples_iterator end = profile->end(symb);
 
-	ostringstream str;
+	string sym_file;
+	size_t sym_line;
+	string const sym_info = get_linenr_info(symb->sample.file_loc, true);
+	bool const has_sym_file =
+		extract_linenr_info(sym_info, sym_file, sym_line);
+
 	for (; it != end; ++it) {
 		counts_t c;
 
@@ -800,113 +873,92 @@ output_symbol_details(symbol_entry const * symb,
 
 			if (count == 0) continue;
 
-			str << open_element(DETAIL_DATA, true);
-			str << init_attr(TABLE_ID, detail_index++);
+			open_element(out, DETAIL_DATA, true);
+			init_attr(out, TABLE_ID, detail_index++);
 
 			// first output the vma field
 			field_datum datum(*symb, it->second, 0, c, 
 					  extra_found_images, 0.0);
-			output_attribute(str, datum, ff_vma, VMA);
+			output_attribute(out, datum, ff_vma, VMA);
 			if (ff_linenr_info) {
-				string sym_file;
-				size_t sym_line;
 				string samp_file;
 				size_t samp_line;
-				string sym_info = get_linenr_info(symb->sample.file_loc, true);
 				string samp_info = get_linenr_info(it->second.file_loc, true);
 
 				if (extract_linenr_info(samp_info, samp_file, samp_line)) {
-					if (extract_linenr_info(sym_info, sym_file, sym_line)) {
+					if (has_sym_file) {
 						// only output source_file if it is different than the symbol's 
 						// source file.  this can happen with inlined functions in
 						// #included header files
 						if (sym_file != samp_file)
-							str << init_attr(SOURCE_FILE, samp_file);
+							init_attr(out, SOURCE_FILE, samp_file);
 					}
-					str << init_attr(SOURCE_LINE, samp_line);
+					init_attr(out, SOURCE_LINE, samp_line);
 				}
 			}
-			str << close_element(NONE, true);
+			close_element(out, NONE, true);
 
 			// output buffered sample data
-			output_sample_data(str, it->second, p);
+			output_sample_data(out, it->second, p);
 
-			str << close_element(DETAIL_DATA);
+			close_element(out, DETAIL_DATA);
 		}
 	}
-	return str.str();
 }
 
 void xml_formatter::
 output_symbol(ostream & out,
 	symbol_entry const * symb, size_t lo, size_t hi, bool is_module)
 {
-	ostringstream str;
 	// pointless reference to is_module, remove insane compiler warning
 	size_t indx = is_module ? 0 : 1;
 
-	// output symbol's summary data for each profile class
-	bool got_samples = false;
-
-	for (size_t p = lo; p <= hi; ++p) {
-		got_samples |= xml_support->output_summary_data(str,
-		    symb->sample.counts, p);
-	}
-
-	if (!got_samples)
+	// output only symbols with summary data for one of the profile class
+	if (!has_sample_counts(symb->sample.counts, lo, hi))
 		return;
 
 	if (cverb << vxml)
 		out << "<!-- symbol_ref=" << symbol_names.name(symb->name) <<
 			" -->" << endl;
 
-	out << open_element(SYMBOL, true);
+	open_element(out, SYMBOL, true);
 
-	string const name = symbol_names.name(symb->name);
-	assert(name.size() > 0);
-	
-	string const image = get_image_name(symb->image_name,
-		image_name_storage::int_filename, extra_found_images);
-	string const qname = image + ":" + name;
+	assert(symbol_names.name(symb->name).size() > 0);
 
-	indx = xml_get_symbol_index(qname);
+	indx = xml_get_symbol_index(get_symbol_key(*symb, extra_found_images));
 
-	out << init_attr(ID_REF, indx);
+	init_attr(out, ID_REF, indx);
 
 	if (need_details) {
-		ostringstream details;
 		symbol_details_t & sd = symbol_details[indx];
-		size_t const detail_lo = sd.index;
+		size_t const nr_details = count_symbol_details(symb, lo, hi);
 
-		string detail_str = output_symbol_details(symb, sd.index, lo, hi);
-
-		if (detail_str.size() > 0) {
+		if (nr_details > 0) {
 			if (sd.id < 0)
 				sd.id = indx;
-			details << detail_str;
-		}
-
-		if (sd.index > detail_lo) {
-			sd.details = sd.details + details.str();
-			out << init_attr(DETAIL_LO, detail_lo);
-			out << init_attr(DETAIL_HI, sd.index-1);
+			detail_range const range = { symb, lo, hi };
+			sd.ranges.push_back(range);
+			init_attr(out, DETAIL_LO, sd.index);
+			init_attr(out, DETAIL_HI, sd.index + nr_details - 1);
+			sd.index += nr_details;
 		}
 	}
-	out << close_element(NONE, true);
+	close_element(out, NONE, true);
 	// output summary
-	out << str.str();
-	out << close_element(SYMBOL);
+	for (size_t p = lo; p <= hi; ++p)
+		xml_support->output_summary_data(out, symb->sample.counts, p);
+	close_element(out, SYMBOL);
 }
 
 
 void xml_formatter::
 output_sample_data(ostream & out, sample_entry const & sample, size_t pclass)
 {
-	out << open_element(COUNT, true);
-	out << init_attr(CLASS, classes.v[pclass].name);
-	out << close_element(NONE, true);
+	open_element(out, COUNT, true);
+	init_attr(out, CLASS, classes.v[pclass].name);
+	close_element(out, NONE, true);
 	out << sample.counts[pclass];
-	out << close_element(COUNT);
+	close_element(out, COUNT);
 }
 
 
@@ -925,12 +977,14 @@ output_attribute(ostream & out, field_datum const & datum,
 
 			if (extract_linenr_info(str, file, line)) {
 				if (tag == SOURCE_LINE)
-					out << init_attr(tag, line);
+					init_attr(out, tag, line);
 				else
-					out << init_attr(tag, file);
+					init_attr(out, tag, file);
 			}
-		} else
-			out << " " << init_attr(tag, str);
+		} else {
+			out << " ";
+			init_attr(out, tag, str);
+		}
 	}
 }
 
@@ -945,8 +999,8 @@ xml_cg_formatter(callgraph_container const & cg, symbol_collection & s,
 }
 
 void xml_cg_formatter::
-output_symbol_core(ostream & out, cg_symbol::children const cg_symb,
-       string const selfname, string const qname,
+output_symbol_core(ostream & out, cg_symbol::children const & cg_symb,
+       string const & selfname, size_t self_indx,
        size_t lo, size_t hi, bool is_module, tag_t tag)
 {
 	cg_symbol::children::const_iterator cit;
@@ -956,48 +1010,45 @@ output_symbol_core(ostream & out, cg_symbol::children const cg_symb,
 		string const & module = get_image_name((cit)->image_name,
 			image_name_storage::int_filename, extra_found_images);
 		bool self = false;
-		ostringstream str;
 		size_t indx;
 
-		// output symbol's summary data for each profile class
-		for (size_t p = lo; p <= hi; ++p)
-			xml_support->output_summary_data(str, cit->sample.counts, p);
-
 		if (cverb << vxml)
 			out << "<!-- symbol_ref=" << symbol_names.name(cit->name) <<
 				" -->" << endl;
 
 		if (is_module) {
-			out << open_element(MODULE, true);
-			out << init_attr(NAME, module) << close_element(NONE, true);
+			open_element(out, MODULE, true);
+			init_attr(out, NAME, module);
+			close_element(out, NONE, true);
 		}
 
-		out << open_element(SYMBOL, true);
+		open_element(out, SYMBOL, true);
 
-		string const symname = symbol_names.name(cit->name);
+		string const & symname = symbol_names.name(cit->name);
 		assert(symname.size() > 0);
 
-		string const symqname = module + ":" + symname;
-
 		// Find any self references and handle
 		if ((symname == selfname) && (tag == CALLEES)) {
 			self = true;
-			indx = xml_get_symbol_index(qname);
+			indx = self_indx;
 		} else {
-			indx = xml_get_symbol_index(symqname);
+			indx = xml_get_symbol_index(
+				get_symbol_key(*cit, extra_found_images));
 		}
 
-		out << init_attr(ID_REF, indx);
+		init_attr(out, ID_REF, indx);
 
 		if (self)
-			out << init_attr(SELFREF, "true");
+			init_attr(out, SELFREF, "true");
 
-		out << close_element(NONE, true);
-		out << str.str();
-		out << close_element(SYMBOL);
+		close_element(out, NONE, true);
+		// output symbol's summary data for each profile class
+		for (size_t p = lo; p <= hi; ++p)
+			xml_support->output_summary_data(out, cit->sample.counts, p);
+		close_element(out, SYMBOL);
 
 		if (is_module)
-			out << close_element(MODULE);
+			close_element(out, MODULE);
 	}
 }
 
@@ -1007,48 +1058,39 @@ output_symbol(ostream & out,
 	symbol_entry const * symb, size_t lo, size_t hi, bool is_module)
 {
 	cg_symbol const * cg_symb = dynamic_cast<cg_symbol const *>(symb);
-	ostringstream str;
 	size_t indx;
 
-	// output symbol's summary data for each profile class
-	for (size_t p = lo; p <= hi; ++p)
-		xml_support->output_summary_data(str, symb->sample.counts, p);
-
 	if (cverb << vxml)
 		out << "<!-- symbol_ref=" << symbol_names.name(symb->name) <<
 			" -->" << endl;
 
-	out << open_element(SYMBOL, true);
+	open_element(out, SYMBOL, true);
 
-	string const name = symbol_names.name(symb->name);
-	assert(name.size() > 0);
-
-	string const image = get_image_name(symb->image_name,
-		image_name_storage::int_filename, extra_found_images);
-	string const qname = image + ":" + name;
+	assert(symbol_names.name(symb->name).size() > 0);
 
 	string const selfname = symbol_names.demangle(symb->name) + " [self]";
 
-	indx = xml_get_symbol_index(qname);
+	indx = xml_get_symbol_index(get_symbol_key(*symb, extra_found_images));
 
-	out << init_attr(ID_REF, indx);
+	init_attr(out, ID_REF, indx);
 
-	out << close_element(NONE, true);
+	close_element(out, NONE, true);
 
-	out << open_element(CALLERS);
+	open_element(out, CALLERS);
 	if (cg_symb)
-		output_symbol_core(out, cg_symb->callers, selfname, qname, lo, hi, is_module, CALLERS);
-	out << close_element(CALLERS);
+		output_symbol_core(out, cg_symb->callers, selfname, indx, lo, hi, is_module, CALLERS);
+	close_element(out, CALLERS);
 
-	out << open_element(CALLEES);
+	open_element(out, CALLEES);
 	if (cg_symb)
-		output_symbol_core(out, cg_symb->callees, selfname, qname, lo, hi, is_module, CALLEES);
+		output_symbol_core(out, cg_symb->callees, selfname, indx, lo, hi, is_module, CALLEES);
 
-	out << close_element(CALLEES);
+	close_element(out, CALLEES);
 
 	// output summary
-	out << str.str();
-	out << close_element(SYMBOL);
+	for (size_t p = lo; p <= hi; ++p)
+		xml_support->output_summary_data(out, symb->sample.counts, p);
+	close_element(out, SYMBOL);
 }
 
 } // namespace format_output
@@ -252,9 +252,14 @@ public:
 		symbol_entry const * symb, size_t lo, size_t hi,
 		bool is_module);
 
+	/// nr. of detailData output_symbol_details() writes for the symbol
+	size_t count_symbol_details(symbol_entry const * symb,
+		size_t lo, size_t hi) const;
+
 	/// output details for the symbol
-	std::string output_symbol_details(symbol_entry const * symb,
-		size_t & detail_index, size_t const lo, size_t const hi);
+	void output_symbol_details(std::ostream & out,
+		symbol_entry const * symb, size_t & detail_index,
+		size_t const lo, size_t const hi);
 
 	/// set the output_details boolean
 	void show_details(bool);
@@ -291,10 +296,14 @@ private:
 	bool get_bfd_object(symbol_entry const * symb, op_bfd * & abfd) const;
 
 	void output_the_symbol_data(std::ostream & out,
-		symbol_entry const * symb, op_bfd * & abfd);
+		symbol_entry const * symb);
 
 	void output_cg_children(std::ostream & out,
-		cg_symbol::children const cg_symb, op_bfd * & abfd);
+		cg_symbol::children const & cg_symb);
+
+	/// output the bytesTable content of the symbols seen in the
+	/// symbolTable
+	void output_symbol_bytes(std::ostream & out);
 };
 
 // callgraph XML output version
@@ -314,8 +323,8 @@ private:
 	callgraph_container const & callgraph;
 
 	void output_symbol_core(std::ostream & out,
-		cg_symbol::children const cg_symb,
-		std::string const selfname, std::string const qname,
+		cg_symbol::children const & cg_symb,
+		std::string const & selfname, size_t self_indx,
 		size_t lo, size_t hi, bool is_module, tag_t tag);
 };
 
@@ -12,11 +12,14 @@
 #include "file_manip.h"
 #include "locate_images.h"
 #include "string_manip.h"
+#include "op_parallel.h"
+#include "op_string.h"
 
 #include <cerrno>
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
+#include <list>
 
 using namespace std;
 
@@ -30,25 +33,49 @@ extra_images::extra_images()
 }
 
 
-void extra_images::populate(vector<string> const & paths,
-			    string const & prefix_path)
+namespace {
+
+/**
+ * Module filenames have their own special mangling rules in 2.6 kernels,
+ * '-' and ',' are interchangeable with '_', so they are hashed as '_'.
+ */
+size_t hash_basename(string const & name)
+{
+	string key(name);
+	for (string::size_type i = 0; i < key.length(); ++i) {
+		if (key[i] == '-' || key[i] == ',')
+			key[i] = '_';
+	}
+	return op_hash_string(key.c_str());
+}
+
+
+void add_dirs(vector<string> & dirs, vector<string> const & paths,
+              string const & prefix_path)
 {
 	vector<string>::const_iterator cit = paths.begin();
 	vector<string>::const_iterator end = paths.end();
-	for (; cit != end; ++cit) {
-		string const path = op_realpath(prefix_path + *cit);
-		list<string> file_list;
-		create_file_list(file_list, path, "*", true);
-		list<string>::const_iterator lit = file_list.begin();
-		list<string>::const_iterator lend = file_list.end();
-		for (; lit != lend; ++lit) {
-			value_type v(op_basename(*lit), op_dirname(*lit));
-			images.insert(v);
-		}
-	}
+	for (; cit != end; ++cit)
+		dirs.push_back(op_realpath(prefix_path + *cit));
 }
 
 
+/// list the files below each directory, a directory per parallel item
+struct list_files_task : parallel_task {
+	list_files_task(vector<string> const & d)
+		: dirs(d), files(d.size()) {}
+
+	void run(size_t i) {
+		create_file_list(files[i], dirs[i], "*", true);
+	}
+
+	vector<string> const & dirs;
+	vector<list<string> > files;
+};
+
+} // anon namespace
+
+
 void extra_images::populate(vector<string> const & paths,
 			    string const & archive_path_,
 			    string const & root_path_)
@@ -61,12 +88,51 @@ void extra_images::populate(vector<string> const & paths,
 	if (!root_path.empty())
 		root_path = op_realpath(root_path);
 
+	vector<string> dirs;
 	if (root_path.empty() && archive_path.empty())
-		populate(paths, "");
+		add_dirs(dirs, paths, "");
 	if (!archive_path.empty())
-		populate(paths, archive_path);
+		add_dirs(dirs, paths, archive_path);
 	if (!root_path.empty() && root_path != archive_path)
-		populate(paths, root_path);
+		add_dirs(dirs, paths, root_path);
+
+	// the walks are independent, the paths are often on different
+	// (and slow) filesystems
+	list_files_task task(dirs);
+	parallel_for(dirs.size(), task, op_nr_cpus());
+
+	for (size_t i = 0; i < task.files.size(); ++i) {
+		list<string>::const_iterator lit = task.files[i].begin();
+		list<string>::const_iterator lend = task.files[i].end();
+		for (; lit != lend; ++lit) {
+			value_type v(op_basename(*lit), op_dirname(*lit));
+			images.push_back(v);
+		}
+	}
+
+	build_index();
+}
+
+
+void extra_images::build_index()
+{
+	size_t nr_buckets = 1;
+	while (nr_buckets < images.size())
+		nr_buckets *= 2;
+
+	vector<size_t> hashes(images.size());
+	bucket_start.assign(nr_buckets + 1, 0);
+	for (size_t i = 0; i < images.size(); ++i) {
+		hashes[i] = hash_basename(images[i].first) & (nr_buckets - 1);
+		++bucket_start[hashes[i] + 1];
+	}
+	for (size_t i = 0; i < nr_buckets; ++i)
+		bucket_start[i + 1] += bucket_start[i];
+
+	vector<size_t> next(bucket_start.begin(), bucket_start.end() - 1);
+	bucket_images.resize(images.size());
+	for (size_t i = 0; i < images.size(); ++i)
+		bucket_images[next[hashes[i]]++] = i;
 }
 
 
@@ -82,12 +148,17 @@ extra_images::find(extra_images::matcher const & match) const
 {
 	vector<string> matches;
 
-	const_iterator cit = images.begin();
-	const_iterator end = images.end();
+	if (images.empty())
+		return matches;
+
+	size_t const bucket =
+		hash_basename(match.value) & (bucket_start.size() - 2);
 
-	for (; cit != end; ++cit) {
-		if (match(cit->first))
-			matches.push_back(cit->second + '/' + cit->first);
+	for (size_t i = bucket_start[bucket];
+	     i != bucket_start[bucket + 1]; ++i) {
+		value_type const & image = images[bucket_images[i]];
+		if (match(image.first))
+			matches.push_back(image.second + '/' + image.first);
 	}
 
 	return matches;
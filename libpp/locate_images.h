@@ -50,6 +50,10 @@ public:
 
 	/**
 	 * return a vector of all directories that match the functor
+	 *
+	 * Only the images whose basename is equal to match.value, once
+	 * '-' and ',' are replaced by '_' in both, are given to the
+	 * functor.
 	 */
 	std::vector<std::string> const find(matcher const & match) const;
 
@@ -80,18 +84,24 @@ public:
 	int get_uid() const { return uid; }
 
 private:
-	void populate(std::vector<std::string> const & paths,
-		      std::string const & prefix_path);
+	/// rebuild the basename index from images
+	void build_index();
 
 	std::string const locate_image(std::string const & image_name,
 				image_error & error, bool fixup) const;
 
-	typedef std::multimap<std::string, std::string> images_t;
-	typedef images_t::value_type value_type;
-	typedef images_t::const_iterator const_iterator;
+	typedef std::pair<std::string, std::string> value_type;
+	typedef std::vector<value_type> images_t;
 
-	/// map from image basename to owning directory
+	/// image basename and owning directory, in populate() order
 	images_t images;
+	/**
+	 * Hash table over the normalized basenames: the images hashing to
+	 * bucket i are images[bucket_images[j]] for j in
+	 * [bucket_start[i], bucket_start[i + 1])
+	 */
+	std::vector<size_t> bucket_start;
+	std::vector<size_t> bucket_images;
 	/// the archive path passed to populate the images name map.
 	std::string archive_path;
 	/// A prefix added to locate binaries if they can't be found
@@ -9,6 +9,8 @@
  * @author John Levon
  */
 
+#include <algorithm>
+
 #include "name_storage.h"
 #include "demangle_symbol.h"
 #include "file_manip.h"
@@ -100,3 +102,36 @@ string const & symbol_name_storage::demangle(symbol_name_id id) const
 	n.name_processed += ltrim(n.name, "?");
 	return n.name_processed;
 }
+
+
+void symbol_name_storage::demangle(vector<symbol_name_id> const & ids) const
+{
+	vector<symbol_name_id> sorted_ids(ids);
+	sort(sorted_ids.begin(), sorted_ids.end());
+	sorted_ids.erase(unique(sorted_ids.begin(), sorted_ids.end()),
+	                 sorted_ids.end());
+
+	vector<stored_name const *> todo;
+	vector<string> names;
+	for (size_t i = 0; i < sorted_ids.size(); ++i) {
+		stored_name const & n = get(sorted_ids[i]);
+		if (!n.name_processed.empty() || n.name.empty())
+			continue;
+		// the special names are cheap, see demangle(id)
+		if (n.name[0] == '?') {
+			demangle(sorted_ids[i]);
+			continue;
+		}
+		todo.push_back(&n);
+		names.push_back(n.name);
+	}
+
+	if (todo.empty())
+		return;
+
+	vector<string> demangled;
+	demangle_symbols(names, demangled);
+
+	for (size_t i = 0; i < todo.size(); ++i)
+		todo[i]->name_processed = demangled[i];
+}
@@ -13,6 +13,7 @@
 #define NAME_STORAGE_H
 
 #include <string>
+#include <vector>
 
 #include "unique_storage.h"
 
@@ -128,6 +129,12 @@ typedef name_storage<symbol_name_tag>::id_value symbol_name_id;
 struct symbol_name_storage : name_storage<symbol_name_tag> {
 	/// return the demangled name for the given ID
 	std::string const & demangle(symbol_name_id id) const;
+
+	/**
+	 * Demangle the given names ahead of the demangle() calls for them.
+	 * Names are demangled on several threads.
+	 */
+	void demangle(std::vector<symbol_name_id> const & ids) const;
 };
 
 
@@ -0,0 +1,124 @@
+/**
+ * @file op_bfd_cache.cpp
+ * Sharing of op_bfd instances between the pp tools passes
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <cstring>
+#include <list>
+#include <iostream>
+
+#include "op_bfd_cache.h"
+#include "op_bfd.h"
+#include "string_filter.h"
+#include "locate_images.h"
+#include "cverb.h"
+
+using namespace std;
+
+size_t op_bfd_cache::max_unused = 16;
+
+namespace {
+
+struct cache_entry {
+	string filename;
+	string filter;
+	int extra_uid;
+	/// the ok passed to op_bfd ctor
+	bool open;
+	/// and its value on return
+	bool ok;
+	op_bfd * abfd;
+	size_t refcount;
+};
+
+/// most recently used first
+list<cache_entry> entries;
+
+
+/// free the least recently used op_bfd above max_unused
+void trim()
+{
+	size_t unused = 0;
+	list<cache_entry>::iterator it = entries.begin();
+	while (it != entries.end()) {
+		if (it->refcount || ++unused <= op_bfd_cache::max_unused) {
+			++it;
+			continue;
+		}
+		cverb << vdebug << "op_bfd cache: dropping "
+		      << it->filename << endl;
+		delete it->abfd;
+		it = entries.erase(it);
+	}
+}
+
+} // anon namespace
+
+
+shared_op_bfd::shared_op_bfd(string const & filename,
+                             string_filter const & symbol_filter,
+                             extra_images const & extra_images, bool & ok)
+{
+	string const filter = symbol_filter.signature();
+
+	list<cache_entry>::iterator it = entries.begin();
+	for (; it != entries.end(); ++it) {
+		if (it->filename == filename && it->filter == filter &&
+		    it->extra_uid == extra_images.get_uid() &&
+		    it->open == ok)
+			break;
+	}
+
+	if (it != entries.end()) {
+		entries.splice(entries.begin(), entries, it);
+	} else {
+		cache_entry entry;
+		entry.filename = filename;
+		entry.filter = filter;
+		entry.extra_uid = extra_images.get_uid();
+		entry.open = ok;
+		entry.refcount = 0;
+
+		if (strncmp(filename.c_str(), KALL_SYM_FILE,
+		            strlen(filename.c_str())) == 0)
+			entry.abfd = new op_bfd(filename, extra_images);
+		else
+			entry.abfd = new op_bfd(filename, symbol_filter,
+			                        extra_images, ok);
+		entry.ok = ok;
+
+		entries.push_front(entry);
+	}
+
+	ok = entries.front().ok;
+	++entries.front().refcount;
+	abfd = entries.front().abfd;
+}
+
+
+shared_op_bfd::~shared_op_bfd()
+{
+	list<cache_entry>::iterator it = entries.begin();
+	for (; it != entries.end(); ++it) {
+		if (it->abfd == abfd) {
+			--it->refcount;
+			break;
+		}
+	}
+
+	trim();
+}
+
+
+void op_bfd_cache::clear()
+{
+	size_t const saved = max_unused;
+	max_unused = 0;
+	trim();
+	max_unused = saved;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file op_bfd_cache.h
+ * Sharing of op_bfd instances between the pp tools passes
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef OP_BFD_CACHE_H
+#define OP_BFD_CACHE_H
+
+#include <string>
+
+#include "utility.h"
+
+class op_bfd;
+class string_filter;
+class extra_images;
+
+/**
+ * A reference to an op_bfd shared with every other shared_op_bfd for the
+ * same image, symbol filter and extra_images. Opening an image and reading
+ * its symbols is the most expensive part of populating a profile; with
+ * callgraph the same few images are opened once per sample file.
+ *
+ * Instances are reference counted. Once unreferenced, the most recently
+ * used ones are kept (see op_bfd_cache::max_unused) so a following pass
+ * over the same image doesn't reload it.
+ */
+class shared_op_bfd : noncopyable {
+public:
+	/**
+	 * @param filename  the name of the image file
+	 * @param symbol_filter  filter to apply to symbols
+	 * @param extra_images container where all extra candidate filenames
+	 *    are stored
+	 * @param ok in-out parameter, see op_bfd::op_bfd()
+	 *
+	 * /proc/kallsyms is loaded through the kallsyms constructor of
+	 * op_bfd, symbol_filter is ignored in this case.
+	 */
+	shared_op_bfd(std::string const & filename,
+	              string_filter const & symbol_filter,
+	              extra_images const & extra_images, bool & ok);
+
+	~shared_op_bfd();
+
+	op_bfd & operator*() const { return *abfd; }
+	op_bfd * operator->() const { return abfd; }
+
+private:
+	op_bfd * abfd;
+};
+
+
+namespace op_bfd_cache {
+
+/// nr. of unreferenced op_bfd kept for later use
+extern size_t max_unused;
+
+/// free all unreferenced op_bfd
+void clear();
+
+}
+
+#endif /* !OP_BFD_CACHE_H */
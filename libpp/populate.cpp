@@ -16,6 +16,7 @@
 #include "profile_container.h"
 #include "arrange_profiles.h"
 #include "op_bfd.h"
+#include "op_bfd_cache.h"
 #include "op_header.h"
 #include "populate.h"
 #include "populate_for_spu.h"
@@ -61,22 +62,17 @@ void
 populate_for_image(profile_container & samples, inverted_profile const & ip,
 	string_filter const & symbol_filter, bool * has_debug_info)
 {
-	op_bfd *abfd;
-
 	if (is_spu_profile(ip)) {
 		populate_for_spu_image(samples, ip, symbol_filter,
 				       has_debug_info);
+		samples.select_new_symbols();
 		return;
 	}
 
 	bool ok = ip.error == image_ok;
 
-	if (strncmp(ip.image.c_str(), KALL_SYM_FILE, strlen(ip.image.c_str())) == 0)
-		abfd = new op_bfd(ip.image, samples.extra_found_images);
-
-	else
-		abfd = new op_bfd(ip.image, symbol_filter,
-				  samples.extra_found_images, ok);
+	shared_op_bfd abfd(ip.image, symbol_filter,
+	                   samples.extra_found_images, ok);
 
 	if (!ok && ip.error == image_ok)
 		ip.error = image_format_failure;
@@ -107,6 +103,8 @@ populate_for_image(profile_container & samples, inverted_profile const & ip,
 		}
 	}
 
+	samples.select_new_symbols();
+
 	if (found == true && ip.error == image_ok) {
 		image_error error;
 		string filename =
@@ -117,6 +115,4 @@ populate_for_image(profile_container & samples, inverted_profile const & ip,
 
 	if (has_debug_info)
 		*has_debug_info = abfd->has_debug_info();
-
-	delete abfd;
 }
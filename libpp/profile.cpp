@@ -28,6 +28,7 @@
 #include "op_bfd.h"
 #include "cverb.h"
 #include "populate_for_spu.h"
+#include "session_index.h"
 
 using namespace std;
 
@@ -40,12 +41,16 @@ profile_t::profile_t()
 // static member
 count_type profile_t::sample_count(string const & filename)
 {
+	count_type count = 0;
+
+	// the converter summary index saves opening the sample file
+	if (session_index::sample_count(filename, count))
+		return count;
+
 	odb_t samples_db;
 
 	open_sample_file(filename, samples_db);
 
-	count_type count = 0;
-
 	odb_node_nr_t node_nr, pos;
 	odb_node_t * node = odb_get_iterator(&samples_db, &node_nr);
 	for (pos = 0; pos < node_nr; ++pos)
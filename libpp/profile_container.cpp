@@ -57,11 +57,55 @@ profile_container::profile_container(bool debug_info_, bool need_details_,
 	samples(new sample_container),
 	debug_info(debug_info_),
 	need_details(need_details_),
+	symbol_threshold(0.0),
+	max_symbols(0),
 	extra_found_images(extra_)
 {
 }
 
 
+void profile_container::limit_symbols(double threshold, size_t max)
+{
+	symbol_threshold = threshold;
+	max_symbols = max;
+}
+
+
+void profile_container::add_to_top_symbols(symbol_entry const * symbol)
+{
+	top_symbols.push(make_pair(symbol->sample.counts[0], symbol));
+	if (top_symbols.size() <= max_symbols)
+		return;
+
+	symbol_entry const * worst = top_symbols.top().second;
+	top_symbols.pop();
+	samples->erase(worst);
+	symbols->erase(worst);
+}
+
+
+void profile_container::select_new_symbols()
+{
+	vector<symbol_entry const *>::const_iterator it = new_symbols.begin();
+	vector<symbol_entry const *>::const_iterator const end
+		= new_symbols.end();
+
+	for (; it != end; ++it) {
+		symbol_entry const * symbol = *it;
+		// total_count only grows so the ratio can only decrease
+		if (op_ratio(symbol->sample.counts[0], total_count[0])
+		    < symbol_threshold) {
+			samples->erase(symbol);
+			symbols->erase(symbol);
+		} else if (max_symbols) {
+			add_to_top_symbols(symbol);
+		}
+	}
+
+	new_symbols.clear();
+}
+
+
 profile_container::~profile_container()
 {
 }
@@ -104,6 +148,11 @@ void profile_container::add(profile_t const & profile,
 		symb_entry.sym_index = i;
 		symb_entry.vma_adj = abfd.get_vma_adj();
 
+		symb_entry.image_name = image_names.create(image_name);
+		symb_entry.app_name = image_names.create(app_name);
+
+		symb_entry.sample.vma = abfd.syms[i].vma();
+
 		symb_entry.sample.file_loc.linenr = 0;
 		if (debug_info) {
 			string filename;
@@ -113,11 +162,6 @@ void profile_container::add(profile_t const & profile,
 					debug_names.create(filename);
 			}
 		}
-
-		symb_entry.image_name = image_names.create(image_name);
-		symb_entry.app_name = image_names.create(app_name);
-
-		symb_entry.sample.vma = abfd.syms[i].vma();
 		if ((header.spu_profile == cell_spu_profile) &&
 		    header.embedded_offset) {
 			symb_entry.spu_offset = header.embedded_offset;
@@ -126,7 +170,11 @@ void profile_container::add(profile_t const & profile,
 		} else {
 			symb_entry.spu_offset = 0;
 		}
+		size_t const nr_symbols = symbols->size();
 		symbol_entry const * symbol = symbols->insert(symb_entry);
+		if ((symbol_threshold || max_symbols) &&
+		    symbols->size() != nr_symbols)
+			new_symbols.push_back(symbol);
 
 		if (need_details)
 			add_samples(abfd, i, p_it, symbol, pclass, start);
@@ -203,6 +251,12 @@ profile_container::select_symbols(symbol_choice & choice) const
 		}
 	}
 
+	// the names of the selected symbols will be needed for output
+	vector<symbol_name_id> names(result.size());
+	for (size_t i = 0; i < result.size(); ++i)
+		names[i] = result[i]->name;
+	symbol_names.demangle(names);
+
 	return result;
 }
 
@@ -309,6 +363,13 @@ count_array_t profile_container::samples_count(debug_name_id filename,
 }
 
 
+vector<count_array_t> const &
+profile_container::samples_count_by_line(debug_name_id filename) const
+{
+	return samples->accumulate_lines(filename);
+}
+
+
 sample_container::samples_iterator
 profile_container::begin(symbol_entry const * symbol) const
 {
@@ -14,6 +14,8 @@
 
 #include <string>
 #include <vector>
+#include <queue>
+#include <functional>
 
 #include "profile.h"
 #include "utility.h"
@@ -49,6 +51,24 @@ public:
 			  extra_images const & extra);
 
 	~profile_container();
+
+	/**
+	 * Only keep the symbols which can be part of a report limited to
+	 * symbols reaching threshold (a ratio, not a percentage) of the
+	 * samples of the first profile class, and to the max_symbols
+	 * symbols with most samples in this class if max_symbols is not
+	 * zero. Other symbols are dropped by select_new_symbols(), once
+	 * their counts are final. The total samples count is not affected.
+	 * Must be called before the first add().
+	 */
+	void limit_symbols(double threshold, size_t max_symbols);
+
+	/**
+	 * Apply limit_symbols() to the symbols recorded since the last
+	 * call. The samples of one image can be spread over several add(),
+	 * so populate_for_image() calls this once the whole image is added.
+	 */
+	void select_new_symbols();
  
 	/**
 	 * add() - record symbols/samples in the underlying container
@@ -124,6 +144,10 @@ public:
 	/// 0 if no samples found.
 	count_array_t samples_count(debug_name_id filename,
 			   size_t linenr) const;
+	/// Get the samples count of each line of filename, indexed by
+	/// line nr. Lines after the last one with samples are omitted.
+	std::vector<count_array_t> const &
+	samples_count_by_line(debug_name_id filename) const;
 
 	/// return an iterator to the first symbol
 	symbol_container::symbols_t::iterator begin_symbol() const;
@@ -147,6 +171,9 @@ private:
 	                 symbol_entry const * symbol, size_t pclass,
 			 unsigned long start);
 
+	/// record a new symbol in the max_symbols best ones
+	void add_to_top_symbols(symbol_entry const * symbol);
+
 	/**
 	 * create an unique artificial symbol for an offset range. The range
 	 * is only a hint of the maximum size of the created symbol. We
@@ -181,6 +208,21 @@ private:
 	bool need_details;
 	//@}
 
+	/// limit_symbols() parameters
+	//@{
+	double symbol_threshold;
+	size_t max_symbols;
+	//@}
+
+	typedef std::pair<count_type, symbol_entry const *> top_symbol_t;
+
+	/// symbols recorded since the last select_new_symbols()
+	std::vector<symbol_entry const *> new_symbols;
+
+	/// min-heap of the max_symbols best symbols selected so far
+	std::priority_queue<top_symbol_t, std::vector<top_symbol_t>,
+		std::greater<top_symbol_t> > top_symbols;
+
 public: // FIXME
 	extra_images extra_found_images;
 };
@@ -18,6 +18,7 @@
 #include "file_manip.h"
 #include "op_config.h"
 #include "profile_spec.h"
+#include "session_index.h"
 #include "string_manip.h"
 #include "glob_filter.h"
 #include "locate_images.h"
@@ -591,7 +592,15 @@ list<string> profile_spec::generate_file_list(bool exclude_dependent,
 		base_dir = op_realpath(base_dir);
 
 		list<string> files;
-		create_file_list(files, base_dir, "*", true);
+		session_index const & index = session_index::get(base_dir);
+		if (index.usable()) {
+			// the converter listed the sample files it wrote, no
+			// need to walk the samples dir
+			for (size_t i = 0; i < index.size(); ++i)
+				files.push_back(base_dir + "/" + index.name(i));
+		} else {
+			create_file_list(files, base_dir, "*", true);
+		}
 
 		if (!files.empty()) {
 			found_file = true;
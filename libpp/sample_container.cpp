@@ -9,28 +9,16 @@
  * @author John Levon
  */
 
-#include <climits>
-#include <set>
-#include <numeric>
-#include <algorithm>
 #include <vector>
+#include <map>
+#include <iostream>
 
 #include "sample_container.h"
+#include "cverb.h"
 
 using namespace std;
 
-namespace {
-
-// FIXME: efficiency ?
-count_array_t add_counts(count_array_t const & counts,
-			   sample_entry const * s)
-{
-	count_array_t temp(counts);
-	temp += s->counts;
-	return temp;
-}
-
-} // namespace anon
+size_t const sample_container::max_dense_line;
 
 
 sample_container::samples_iterator sample_container::begin() const
@@ -77,23 +65,20 @@ void sample_container::insert(symbol_entry const * symbol,
 }
 
 
-count_array_t
-sample_container::accumulate_samples(debug_name_id filename_id) const
+void sample_container::erase(symbol_entry const * symbol)
 {
-	build_by_loc();
-
-	sample_entry lower, upper;
+	samples_storage::key_type first(symbol, 0);
+	samples_storage::key_type last(symbol, ~bfd_vma(0));
 
-	lower.file_loc.filename = upper.file_loc.filename = filename_id;
-	lower.file_loc.linenr = 0;
-	upper.file_loc.linenr = INT_MAX;
-
-	typedef samples_by_loc_t::const_iterator iterator;
+	samples.erase(samples.lower_bound(first), samples.upper_bound(last));
+}
 
-	iterator it1 = samples_by_loc.lower_bound(&lower);
-	iterator it2 = samples_by_loc.upper_bound(&upper);
 
-	return accumulate(it1, it2, count_array_t(), add_counts);
+count_array_t
+sample_container::accumulate_samples(debug_name_id filename_id) const
+{
+	file_counts const * file = find_file(filename_id);
+	return file ? file->total : count_array_t();
 }
 
 
@@ -113,29 +98,80 @@ count_array_t
 sample_container::accumulate_samples(debug_name_id filename,
                                      size_t linenr) const
 {
-	build_by_loc();
+	file_counts const * file = find_file(filename);
+	if (!file)
+		return count_array_t();
 
-	sample_entry sample;
+	if (linenr < file->lines.size())
+		return file->lines[linenr];
 
-	sample.file_loc.filename = filename;
-	sample.file_loc.linenr = linenr;
+	map<size_t, count_array_t>::const_iterator it =
+		file->far_lines.find(linenr);
+	return it != file->far_lines.end() ? it->second : count_array_t();
+}
 
-	typedef pair<samples_by_loc_t::const_iterator,
-		samples_by_loc_t::const_iterator> it_pair;
 
-	it_pair itp = samples_by_loc.equal_range(&sample);
+vector<count_array_t> const &
+sample_container::accumulate_lines(debug_name_id filename_id) const
+{
+	static vector<count_array_t> const empty;
+
+	file_counts const * file = find_file(filename_id);
+	return file ? file->lines : empty;
+}
+
+
+sample_container::file_counts const *
+sample_container::find_file(debug_name_id filename) const
+{
+	build_line_index();
 
-	return accumulate(itp.first, itp.second, count_array_t(), add_counts);
+	line_index_t::const_iterator it = line_index.find(filename);
+	return it != line_index.end() ? &it->second : 0;
 }
 
 
-void sample_container::build_by_loc() const
+void sample_container::build_line_index() const
 {
-	if (!samples_by_loc.empty())
+	if (line_index_built)
 		return;
+	line_index_built = true;
 
 	samples_iterator cit = samples.begin();
-	samples_iterator end = samples.end();
-	for (; cit != end; ++cit)
-		samples_by_loc.insert(&cit->second);
+	samples_iterator const end = samples.end();
+	for (; cit != end; ++cit) {
+		sample_entry const & sample = cit->second;
+		file_counts & file = line_index[sample.file_loc.filename];
+		size_t const linenr = sample.file_loc.linenr;
+		file.total += sample.counts;
+		if (linenr > max_dense_line) {
+			file.far_lines[linenr] += sample.counts;
+			continue;
+		}
+		if (linenr >= file.lines.size())
+			file.lines.resize(linenr + 1);
+		file.lines[linenr] += sample.counts;
+	}
+
+	if (!(cverb << vdebug))
+		return;
+
+	// a rough estimate, count arrays are maps with one node per class
+	size_t const node_size = sizeof(count_type) + 4 * sizeof(void *);
+	size_t nr_lines = 0;
+	size_t bytes = 0;
+	line_index_t::const_iterator it = line_index.begin();
+	for (; it != line_index.end(); ++it) {
+		bytes += sizeof(*it) + 4 * sizeof(void *);
+		bytes += it->second.total.size() * node_size;
+		bytes += it->second.lines.capacity() * sizeof(count_array_t);
+		for (size_t i = 0; i < it->second.lines.size(); ++i)
+			bytes += it->second.lines[i].size() * node_size;
+		bytes += it->second.far_lines.size() *
+			(sizeof(count_array_t) + 5 * sizeof(void *));
+		nr_lines += it->second.lines.size();
+	}
+
+	cverb << vdebug << "line index: " << line_index.size() << " files, "
+	      << nr_lines << " lines, about " << bytes << " bytes" << endl;
 }
@@ -15,6 +15,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "symbol.h"
 #include "symbol_functors.h"
@@ -27,6 +28,8 @@
 class sample_container {
 	typedef std::pair<symbol_entry const *, bfd_vma> sample_index_t;
 public:
+	sample_container() : line_index_built(false) {}
+
 	typedef std::map<sample_index_t, sample_entry> samples_storage;
 	typedef samples_storage::const_iterator samples_iterator;
 
@@ -44,34 +47,59 @@ public:
 	/// samples into an existing one. Can only be done before any lookups
 	void insert(symbol_entry const * symbol, sample_entry const &);
 
+	/// remove all the samples of this symbol. Same restriction as insert()
+	void erase(symbol_entry const * symbol);
+
 	/// return nr of samples in the given filename
 	count_array_t accumulate_samples(debug_name_id filename_id) const;
 
 	/// return nr of samples at the given line nr in the given file
 	count_array_t accumulate_samples(debug_name_id, size_t linenr) const;
 
+	/**
+	 * return nr of samples of each line of the given file, indexed by
+	 * line nr, up to the last line with samples. Lines above
+	 * max_dense_line, which can only come from bogus debug info, are
+	 * omitted.
+	 */
+	std::vector<count_array_t> const &
+	accumulate_lines(debug_name_id filename_id) const;
+
 	/// return the sample entry for the given image_name and vma if any
 	sample_entry const * find_by_vma(symbol_entry const * symbol,
 					 bfd_vma vma) const;
 
 private:
-	/// build the symbol by file-location cache
-	void build_by_loc() const;
+	/// the samples of a source file
+	struct file_counts {
+		/// sum of all the lines
+		count_array_t total;
+		/// samples by line nr, up to the last line with samples
+		std::vector<count_array_t> lines;
+		/// samples of lines above max_dense_line
+		std::map<size_t, count_array_t> far_lines;
+	};
 
-	/// main sample entry container
-	samples_storage samples;
+	/// highest line nr stored in file_counts::lines
+	static size_t const max_dense_line = 1 << 20;
+
+	typedef std::map<debug_name_id, file_counts> line_index_t;
+
+	/// return the samples of the given file, building the index if needed
+	file_counts const * find_file(debug_name_id filename) const;
 
-	typedef std::multiset<sample_entry const *, less_by_file_loc>
-		samples_by_loc_t;
+	/// build line_index
+	void build_line_index() const;
 
-	// must be declared after the samples_storage to ensure a
-	// correct life-time.
+	/// main sample entry container
+	samples_storage samples;
 
 	/**
-	 * Sample entries by file location. Lazily built when necessary,
+	 * Sample counts by file and line, built once by the first lookup,
 	 * so mutable.
 	 */
-	mutable samples_by_loc_t samples_by_loc;
+	mutable line_index_t line_index;
+	mutable bool line_index_built;
 };
 
 #endif /* SAMPLE_CONTAINER_H */
@@ -0,0 +1,197 @@
+/**
+ * @file session_index.cpp
+ * Read access to the session summary index
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <map>
+#include <iostream>
+
+#include "session_index.h"
+#include "op_session_index.h"
+#include "cverb.h"
+
+using namespace std;
+
+namespace {
+
+/// all session indexes mapped so far, by samples dir
+class index_cache {
+public:
+	~index_cache() {
+		map<string, session_index *>::iterator it = indexes.begin();
+		for (; it != indexes.end(); ++it)
+			delete it->second;
+	}
+
+	session_index const & get(string dir) {
+		if (dir.empty() || dir[dir.length() - 1] != '/')
+			dir += '/';
+		session_index *& index = indexes[dir];
+		if (!index)
+			index = new session_index(dir);
+		return *index;
+	}
+
+private:
+	map<string, session_index *> indexes;
+};
+
+index_cache cache;
+
+
+/// split a sample file name into samples dir and name relative to it
+bool split_filename(string const & filename, string & dir, string & name)
+{
+	string::size_type pos = filename.find("/{root}/");
+	string::size_type kern = filename.find("/{kern}/");
+	if (kern < pos)
+		pos = kern;
+	if (pos == string::npos)
+		return false;
+
+	dir = filename.substr(0, pos + 1);
+	name = filename.substr(pos + 1);
+	return true;
+}
+
+} // anon namespace
+
+
+session_index::session_index(string const & samples_dir)
+	:
+	dir(samples_dir),
+	base(0),
+	length(0),
+	index_mtime(0),
+	nr_entries(0)
+{
+	if (dir.empty() || dir[dir.length() - 1] != '/')
+		dir += '/';
+
+	string const filename = dir + OP_SESSION_INDEX_FILE;
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat st;
+	if (fstat(fd, &st) || size_t(st.st_size) < sizeof(op_session_index_header)) {
+		close(fd);
+		return;
+	}
+
+	length = st.st_size;
+	index_mtime = op_session_index_mtime(&st);
+	void * addr = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return;
+
+	op_session_index_header const * header =
+		static_cast<op_session_index_header const *>(addr);
+	char const * p = static_cast<char const *>(addr) + sizeof(*header);
+	size_t const nr = header->nr_entries;
+	size_t const strings_size = header->strings_size;
+
+	if (memcmp(header->magic, OP_SESSION_INDEX_MAGIC, sizeof(header->magic))
+	    || header->version != OP_SESSION_INDEX_VERSION
+	    || length != sizeof(*header) + nr * (3 * sizeof(u64) + sizeof(u32))
+	                 + strings_size
+	    || (strings_size && p[length - sizeof(*header) - 1] != '\0')) {
+		cverb << vdebug << "ignoring malformed " << filename << endl;
+		munmap(addr, length);
+		return;
+	}
+
+	totals = reinterpret_cast<u64 const *>(p);
+	sizes = totals + nr;
+	mtimes = sizes + nr;
+	names = reinterpret_cast<u32 const *>(mtimes + nr);
+	strings = reinterpret_cast<char const *>(names + nr);
+
+	for (size_t i = 0; i < nr; ++i) {
+		if (names[i] >= strings_size) {
+			cverb << vdebug << "ignoring malformed "
+			      << filename << endl;
+			munmap(addr, length);
+			return;
+		}
+	}
+
+	base = addr;
+	nr_entries = nr;
+	cverb << vdebug << "using " << filename << ", "
+	      << nr_entries << " sample files" << endl;
+}
+
+
+session_index::~session_index()
+{
+	if (base)
+		munmap(base, length);
+}
+
+
+size_t session_index::find(string const & name) const
+{
+	size_t lo = 0;
+	size_t hi = nr_entries;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(strings + names[mid], name.c_str());
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return nr_entries;
+}
+
+
+bool session_index::up_to_date(size_t i) const
+{
+	struct stat st;
+	if (stat((dir + name(i)).c_str(), &st))
+		return false;
+	u64 const mtime = op_session_index_mtime(&st);
+	return u64(st.st_size) == sizes[i] && mtime == mtimes[i]
+		&& mtime < index_mtime;
+}
+
+
+session_index const & session_index::get(string const & samples_dir)
+{
+	return cache.get(samples_dir);
+}
+
+
+bool session_index::sample_count(string const & filename, count_type & count)
+{
+	string dir, name;
+	if (!split_filename(filename, dir, name))
+		return false;
+
+	session_index const & index = get(dir);
+	if (!index.usable())
+		return false;
+
+	size_t i = index.find(name);
+	if (i == index.size() || !index.up_to_date(i))
+		return false;
+
+	count = index.total(i);
+	return true;
+}
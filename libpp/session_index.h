@@ -0,0 +1,95 @@
+/**
+ * @file session_index.h
+ * Read access to the session summary index
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef SESSION_INDEX_H
+#define SESSION_INDEX_H
+
+#include <string>
+
+#include "op_types.h"
+#include "utility.h"
+
+/**
+ * The summary index written by the converter into a samples dir, see
+ * op_session_index.h. The index is mapped read-only and its columns are
+ * used in place. A session without an index, or with an index we can't
+ * understand, gives an unusable object and callers must fall back to
+ * reading the sample files.
+ */
+class session_index : noncopyable {
+public:
+	/// map the index of samples_dir, if any
+	explicit session_index(std::string const & samples_dir);
+
+	~session_index();
+
+	/// true if the index exists and is well formed
+	bool usable() const { return base; }
+
+	/// nr. of sample files in the index
+	size_t size() const { return nr_entries; }
+
+	/// name of the i-th sample file, relative to the samples dir
+	char const * name(size_t i) const { return strings + names[i]; }
+
+	/// sample count of the i-th sample file
+	count_type total(size_t i) const { return totals[i]; }
+
+	/**
+	 * @param name a sample file name relative to the samples dir
+	 *
+	 * Return the position of name in the index, or size() if absent.
+	 */
+	size_t find(std::string const & name) const;
+
+	/**
+	 * true if the i-th sample file is unchanged since the index was
+	 * written: same size and mtime as recorded, and an mtime older than
+	 * the index's own
+	 */
+	bool up_to_date(size_t i) const;
+
+	/**
+	 * @param samples_dir a samples dir
+	 *
+	 * Return the index of samples_dir. The index of each samples dir
+	 * is mapped once and kept until exit.
+	 */
+	static session_index const & get(std::string const & samples_dir);
+
+	/**
+	 * @param filename a sample file name as built by profile_spec
+	 * @param count output the sample count of filename
+	 *
+	 * Return false if the samples dir of filename has no index, or if
+	 * the index doesn't describe the current content of filename.
+	 */
+	static bool sample_count(std::string const & filename,
+	                         count_type & count);
+
+private:
+	/// the samples dir, with a trailing '/'
+	std::string dir;
+
+	/// the mapped index, NULL if unusable
+	void * base;
+	size_t length;
+	/// mtime of the index file, in ns
+	u64 index_mtime;
+
+	size_t nr_entries;
+	u64 const * totals;
+	u64 const * sizes;
+	u64 const * mtimes;
+	u32 const * names;
+	char const * strings;
+};
+
+#endif /* !SESSION_INDEX_H */
@@ -37,6 +37,14 @@ symbol_entry const * symbol_container::insert(symbol_entry const & symb)
 }
 
 
+void symbol_container::erase(symbol_entry const * symbol)
+{
+	symbols_t::iterator it = symbols.find(*symbol);
+	if (it != symbols.end())
+		symbols.erase(it);
+}
+
+
 symbol_collection const
 symbol_container::find(debug_name_id filename, size_t linenr) const
 {
@@ -46,6 +46,12 @@ public:
 	 */
 	symbol_entry const * insert(symbol_entry const &);
 
+	/**
+	 * Remove a symbol returned by insert(). Same restriction as insert()
+	 * about file-location based lookups.
+	 */
+	void erase(symbol_entry const * symbol);
+
 	/// find the symbols at the given filename and line number, if any
 	symbol_collection const find(debug_name_id filename, size_t linenr) const;
 
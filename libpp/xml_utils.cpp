@@ -336,33 +336,6 @@ void xml_utils::build_subclasses(ostream & out)
 }
 
 
-string
-get_counts_string(count_array_t const & counts, size_t begin, size_t end)
-{
-	ostringstream str;
-	bool got_count = false;
-
-	// if no cpu separation then return a simple count, omit zero counts
-	if (nr_cpus == 1) {
-		size_t count = counts[begin];
-		if (count == 0)
-			return "";
-		str << count;
-		return str.str();
-	}
-
-	for (size_t p = begin; p != end; ++p) {
-		size_t count = counts[p];
-		if (p != begin) str << ",";
-		if (count != 0) {
-			got_count = true;
-			str << count;
-		}
-	}
-	return got_count ? str.str() : "";
-}
-
-
 void
 xml_utils::output_symbol_bytes(ostream & out, symbol_entry const * symb,
 			       size_t sym_id, op_bfd const & abfd)
@@ -370,17 +343,17 @@ xml_utils::output_symbol_bytes(ostream & out, symbol_entry const * symb,
 	size_t size = symb->size;
 	scoped_array<unsigned char> contents(new unsigned char[size]);
 	if (abfd.get_symbol_contents(symb->sym_index, contents.get())) {
-		string const name = symbol_names.name(symb->name);
-		out << open_element(BYTES, true) << init_attr(TABLE_ID, sym_id);
-		out << close_element(NONE, true);
+		open_element(out, BYTES, true);
+		init_attr(out, TABLE_ID, sym_id);
+		close_element(out, NONE, true);
 		for (size_t i = 0; i < size; ++i) {
 			char hex_map[] = "0123456789ABCDEF";
 			char hex[2];
 			hex[0] = hex_map[(contents[i] >> 4) & 0xf];
 			hex[1] = hex_map[contents[i] & 0xf];
-			out << hex[0] << hex[1];
+			out.write(hex, 2);
 		}
-		out << close_element(BYTES);
+		close_element(out, BYTES);
 	}
 }
 
@@ -393,13 +366,13 @@ xml_utils::output_summary_data(ostream & out, count_array_t const & summary, siz
 	if (count == 0)
 		return false;
 
-	out << open_element(COUNT, has_subclasses);
+	open_element(out, COUNT, has_subclasses);
 	if (has_subclasses) {
-		out << init_attr(CLASS, classes.v[pclass].name);
-		out << close_element(NONE, true);
+		init_attr(out, CLASS, classes.v[pclass].name);
+		close_element(out, NONE, true);
 	}
 	out << count;
-	out << close_element(COUNT);
+	close_element(out, COUNT);
 	return true;
 }
 
@@ -417,6 +390,8 @@ public:
 	void set_begin(sym_iterator b);
 	void set_end(sym_iterator e);
 	void add_to_summary(count_array_t const & counts);
+	/// true if the summary has a non zero count for our classes
+	bool has_samples() const;
 	void output(ostream & out);
 	bool is_closed(string const & n);
 protected:
@@ -445,6 +420,8 @@ public:
 	void summarize();
 	void set_end(sym_iterator end);
 	string const get_tid() { return thread_id; }
+	/// false if output() would write nothing
+	bool has_output() const;
 	void output(ostream & out);
 	void dump();
 private:
@@ -463,6 +440,8 @@ public:
 		string const & app_name, sym_iterator it);
 	void summarize();
 	void set_end(sym_iterator end);
+	/// false if output() would write nothing
+	bool has_output();
 	void output(ostream & out);
 	void dump();
 private:
@@ -552,6 +531,12 @@ void module_info::set_end(sym_iterator e)
 }
 
 
+bool module_info::has_samples() const
+{
+	return has_sample_counts(summary, lo, hi);
+}
+
+
 bool module_info::is_closed(string const & n)
 {
 	return (name == n) && end != (sym_iterator)0;
@@ -568,11 +553,12 @@ void module_info::dump()
 
 void module_info::output(ostream & out)
 {
-	out << open_element(MODULE, true);
-	out << init_attr(NAME, name) << close_element(NONE, true);
+	open_element(out, MODULE, true);
+	init_attr(out, NAME, name);
+	close_element(out, NONE, true);
 	output_summary(out);
 	output_symbols(out, true);
-	out << close_element(MODULE);
+	close_element(out, MODULE);
 }
 
 
@@ -767,15 +753,16 @@ binary_info::build_binary(string const & n)
 
 void binary_info::output(ostream & out)
 {
-	out << open_element(BINARY, true);
-	out << init_attr(NAME, name) << close_element(NONE, true);
+	open_element(out, BINARY, true);
+	init_attr(out, NAME, name);
+	close_element(out, NONE, true);
 
 	output_summary(out);
 	output_symbols(out, false);
 	for (size_t a = 0; a < nr_modules; ++a)
 		my_modules[a].output(out);
 
-	out << close_element(BINARY);
+	close_element(out, BINARY);
 }
 
 
@@ -869,25 +856,26 @@ void thread_info::add_module_symbol(string const & n, sym_iterator it)
 	m.add_to_summary((*it)->sample.counts);
 }
 
-void thread_info::output(ostream & out)
+bool thread_info::has_output() const
 {
-	ostringstream thread_summary;
-	ostringstream modules_output;
-
-	output_summary(thread_summary);
+	// a module is only added for a symbol with samples
+	return nr_modules != 0 || has_samples();
+}
 
-	for (size_t m = 0; m < nr_modules; ++m)
-		my_modules[m].output(modules_output);
 
+void thread_info::output(ostream & out)
+{
 	// ignore threads with no sample data
-	if (modules_output.str().size() == 0 && thread_summary.str().size() == 0)
+	if (!has_output())
 		return;
 
-	out << open_element(THREAD, true);
-	out << init_attr(THREAD_ID, thread_id) << close_element(NONE, true);
-	out << thread_summary.str();
-	out << modules_output.str();
-	out << close_element(THREAD);
+	open_element(out, THREAD, true);
+	init_attr(out, THREAD_ID, thread_id);
+	close_element(out, NONE, true);
+	output_summary(out);
+	for (size_t m = 0; m < nr_modules; ++m)
+		my_modules[m].output(out);
+	close_element(out, THREAD);
 }
 
 
@@ -931,26 +919,31 @@ void process_info::set_end(sym_iterator end)
 }
 
 
-void process_info::output(ostream & out)
+bool process_info::has_output()
 {
-	ostringstream process_summary;
-	ostringstream thread_output;
-
-	output_summary(process_summary);
-
+	if (has_samples())
+		return true;
 	for (size_t t = 0; t < nr_threads; ++t)
-		my_threads[t].output(thread_output);
+		if (my_threads[t].has_output())
+			return true;
+	return false;
+}
+
 
+void process_info::output(ostream & out)
+{
 	// ignore processes with no sample data
-	if (thread_output.str().size() == 0 && process_summary.str().size() == 0)
+	if (!has_output())
 		return;
 
-	out << open_element(PROCESS, true);
-	out << init_attr(PROC_ID, process_id);
-	out << init_attr(NAME, name) << close_element(NONE, true);
-	out << process_summary.str();
-	out << thread_output.str();
-	out << close_element(PROCESS);
+	open_element(out, PROCESS, true);
+	init_attr(out, PROC_ID, process_id);
+	init_attr(out, NAME, name);
+	close_element(out, NONE, true);
+	output_summary(out);
+	for (size_t t = 0; t < nr_threads; ++t)
+		my_threads[t].output(out);
+	close_element(out, PROCESS);
 }
 
 
@@ -9,12 +9,14 @@
  */
 
 #include <cstdlib>
+#include <algorithm>
 
 #include "config.h"
 
 #include "demangle_symbol.h"
 #include "demangle_java_symbol.h"
 #include "op_regex.h"
+#include "op_parallel.h"
 
 // from libiberty
 /*@{\name demangle option parameter */
@@ -26,6 +28,7 @@
 #endif
 /*@}*/
 extern "C" char * cplus_demangle(char const * mangled, int options);
+extern "C" char * cplus_demangle_v3(char const * mangled, int options);
 
 using namespace std;
 
@@ -33,6 +36,59 @@ namespace options {
 	extern demangle_type demangle;
 }
 
+namespace {
+
+regular_expression_replace const & stl_regex()
+{
+	static bool init = false;
+	static regular_expression_replace regex;
+	if (init == false) {
+		setup_regex(regex, OP_DATADIR "/stl.pat");
+		init = true;
+	}
+	return regex;
+}
+
+
+/// nr. of names demangled by each parallel item
+size_t const chunk_size = 64;
+
+/**
+ * The libiberty demangler of the g++ v3 ABI, cplus_demangle_v3(), keeps no
+ * state between calls, so threads run it concurrently. cplus_demangle()
+ * makes no such promise, and is only used, serialized, for the names which
+ * cplus_demangle_v3() can't demangle and which don't follow that ABI.
+ */
+op_mutex cplus_demangle_mutex;
+
+char * demangle_cplus(string const & name)
+{
+	int const options = DMGL_PARAMS | DMGL_ANSI;
+	char * unmangled = cplus_demangle_v3(name.c_str(), options);
+	if (unmangled || name.compare(0, 2, "_Z") == 0)
+		return unmangled;
+
+	op_lock lock(cplus_demangle_mutex);
+	return cplus_demangle(name.c_str(), options);
+}
+
+struct demangle_task : parallel_task {
+	demangle_task(vector<string> const & n, vector<string> & r)
+		: names(n), result(r) {}
+
+	void run(size_t i) {
+		size_t const end = min(names.size(), (i + 1) * chunk_size);
+		for (size_t j = i * chunk_size; j < end; ++j)
+			result[j] = demangle_symbol(names[j]);
+	}
+
+	vector<string> const & names;
+	vector<string> & result;
+};
+
+} // anon namespace
+
+
 string const demangle_symbol(string const & name)
 {
 	if (options::demangle == dmt_none)
@@ -42,7 +98,7 @@ string const demangle_symbol(string const & name)
 	// C++ demangling failures. However we strip off a leading '.'
         // as generated on PPC64
 	string const & tmp = (name[0] == '.' ? name.substr(1) : name);
-	char * unmangled = cplus_demangle(tmp.c_str(), DMGL_PARAMS | DMGL_ANSI);
+	char * unmangled = demangle_cplus(tmp);
 
 	if (!unmangled) {
 		string result = demangle_java_symbol(name);
@@ -55,16 +111,29 @@ string const demangle_symbol(string const & name)
 	free(unmangled);
 
 	if (options::demangle == dmt_smart) {
-		static bool init = false;
-		static regular_expression_replace regex;
-		if (init == false) {
-			setup_regex(regex, OP_DATADIR "/stl.pat");
-			init = true;
-		}
 		// we don't protect against exception here, pattern must be
 		// right and user can easily work-around by using -d
-		regex.execute(result);
+		stl_regex().execute(result);
 	}
 
 	return result;
 }
+
+
+void demangle_symbols(vector<string> const & names, vector<string> & result)
+{
+	result.resize(names.size());
+
+	if (options::demangle == dmt_none) {
+		result = names;
+		return;
+	}
+
+	// load the patterns before the threads use them
+	if (options::demangle == dmt_smart)
+		stl_regex();
+
+	demangle_task task(names, result);
+	parallel_for((names.size() + chunk_size - 1) / chunk_size, task,
+	             op_nr_cpus());
+}
@@ -12,6 +12,7 @@
 #define DEMANGLE_SYMBOL_H
 
 #include <string>
+#include <vector>
 
 /// demangle type: specify what demangling we use
 enum demangle_type {
@@ -37,4 +38,14 @@ enum demangle_type {
  */
 std::string const demangle_symbol(std::string const & name);
 
+/**
+ * demangle_symbols - demangle a set of symbols
+ * @param names the mangled symbol names
+ * @param result filled with demangle_symbol(names[i]) for each i
+ *
+ * The names are demangled on several threads.
+ */
+void demangle_symbols(std::vector<std::string> const & names,
+                      std::vector<std::string> & result);
+
 #endif // DEMANGLE_SYMBOL_H
@@ -11,6 +11,8 @@
  */
 
 #include <cerrno>
+#include <cctype>
+#include <cstring>
 
 #include <iostream>
 #include <fstream>
@@ -69,9 +71,150 @@ size_t subexpr_index(char ch)
 	return size_t(-1);
 }
 
+
+// return the index of the ']' closing the bracket expression at pos, or
+// string::npos
+size_t skip_bracket(string const & pattern, size_t pos)
+{
+	size_t i = pos + 1;
+	if (i < pattern.length() && pattern[i] == '^')
+		++i;
+	// a leading ']' is part of the list
+	if (i < pattern.length() && pattern[i] == ']')
+		++i;
+
+	for (; i < pattern.length(); ++i) {
+		if (pattern[i] == ']')
+			return i;
+		// [:class:], [.coll.] and [=equiv=]
+		if (pattern[i] == '[' && i + 1 < pattern.length() &&
+		    (pattern[i + 1] == ':' || pattern[i + 1] == '.' ||
+		     pattern[i + 1] == '=')) {
+			char const close[] = { pattern[i + 1], ']', 0 };
+			i = pattern.find(close, i + 2);
+			if (i == string::npos)
+				return i;
+			++i;
+		}
+	}
+
+	return string::npos;
+}
+
+
+// return the index of the ')' closing the group at pos, or string::npos
+size_t skip_group(string const & pattern, size_t pos)
+{
+	size_t depth = 0;
+	for (size_t i = pos; i < pattern.length(); ++i) {
+		switch (pattern[i]) {
+		case '\\':
+			++i;
+			break;
+		case '[':
+			i = skip_bracket(pattern, i);
+			if (i == string::npos)
+				return i;
+			break;
+		case '(':
+			++depth;
+			break;
+		case ')':
+			if (--depth == 0)
+				return i;
+			break;
+		}
+	}
+
+	return string::npos;
+}
+
 }  // anonymous namespace
 
 
+string const required_literal(string const & pattern)
+{
+	string best;
+	string run;
+	// true if the last atom is the last char of run
+	bool last_in_run = false;
+
+	for (size_t i = 0; i < pattern.length(); ++i) {
+		bool end_run = true;
+
+		switch (pattern[i]) {
+		case '\\':
+			if (i + 1 == pattern.length())
+				return string();
+			++i;
+			// back references, word boundaries, GNU classes and
+			// anchors aren't literal
+			if (isalnum(pattern[i]) || strchr("<>`'", pattern[i])) {
+				last_in_run = false;
+				break;
+			}
+			run += pattern[i];
+			last_in_run = true;
+			end_run = false;
+			break;
+		case '[':
+			i = skip_bracket(pattern, i);
+			if (i == string::npos)
+				return string();
+			last_in_run = false;
+			break;
+		case '(':
+			i = skip_group(pattern, i);
+			if (i == string::npos)
+				return string();
+			last_in_run = false;
+			break;
+		case '{':
+			i = pattern.find('}', i);
+			if (i == string::npos)
+				return string();
+			// fall through
+		case '*':
+		case '?':
+			// the previous atom is optional
+			if (last_in_run)
+				run.erase(run.length() - 1);
+			last_in_run = false;
+			break;
+		case '+':
+			last_in_run = false;
+			break;
+		case '|':
+			// outside of a group: nothing is required
+			return string();
+		case '.':
+		case '^':
+		case '$':
+		case ')':
+		case '}':
+			last_in_run = false;
+			break;
+		default:
+			run += pattern[i];
+			last_in_run = true;
+			end_run = false;
+			break;
+		}
+
+		if (end_run) {
+			if (run.length() > best.length())
+				best = run;
+			run.erase();
+		}
+	}
+
+	if (run.length() > best.length())
+		best = run;
+
+	return best;
+}
+
+
 bad_regex::bad_regex(string const & pattern)
 	: op_exception(pattern)
 {
@@ -82,7 +225,8 @@ regular_expression_replace::regular_expression_replace(size_t limit_,
 						       size_t limit_defs)
 	:
 	limit(limit_),
-	limit_defs_expansion(limit_defs)
+	limit_defs_expansion(limit_defs),
+	automaton(1)
 {
 }
 
@@ -108,8 +252,93 @@ void regular_expression_replace::add_pattern(string const & pattern,
 
 	regex_t regexp;
 	op_regcomp(regexp, expanded_pattern);
-	replace_t regex = { regexp, replace };
+	replace_t regex = { regexp, replace,
+	                    required_literal(expanded_pattern) };
 	regex_replace.push_back(regex);
+
+	build_automaton();
+}
+
+
+size_t regular_expression_replace::next_state(size_t state, char ch) const
+{
+	for (;;) {
+		literal_state const & s = automaton[state];
+		for (size_t i = 0; i < s.next.size(); ++i) {
+			if (s.next[i].first == ch)
+				return s.next[i].second;
+		}
+		if (state == 0)
+			return 0;
+		state = s.fail;
+	}
+}
+
+
+void regular_expression_replace::build_automaton()
+{
+	automaton.assign(1, literal_state());
+
+	// the trie of the literals
+	for (size_t i = 0; i < regex_replace.size(); ++i) {
+		string const & literal = regex_replace[i].literal;
+		if (literal.empty())
+			continue;
+
+		size_t state = 0;
+		for (size_t j = 0; j < literal.length(); ++j) {
+			size_t k = 0;
+			vector<pair<char, size_t> > const & next =
+				automaton[state].next;
+			while (k < next.size() && next[k].first != literal[j])
+				++k;
+			if (k == next.size()) {
+				automaton[state].next.push_back(
+					make_pair(literal[j], automaton.size()));
+				automaton.push_back(literal_state());
+			}
+			state = automaton[state].next[k].second;
+		}
+		automaton[state].patterns.push_back(i);
+	}
+
+	// fail links in breadth first order, so the fail link of a
+	// shorter state is always known
+	vector<size_t> queue(1, 0);
+	for (size_t i = 0; i < queue.size(); ++i) {
+		size_t const state = queue[i];
+		for (size_t j = 0; j < automaton[state].next.size(); ++j) {
+			char const ch = automaton[state].next[j].first;
+			size_t const child = automaton[state].next[j].second;
+			size_t const fail = state == 0
+				? 0 : next_state(automaton[state].fail, ch);
+			automaton[child].fail = fail;
+			automaton[child].patterns.insert(
+				automaton[child].patterns.end(),
+				automaton[fail].patterns.begin(),
+				automaton[fail].patterns.end());
+			queue.push_back(child);
+		}
+	}
+}
+
+
+void regular_expression_replace::
+find_candidates(string const & str, vector<bool> & candidates) const
+{
+	candidates.assign(regex_replace.size(), false);
+	for (size_t i = 0; i < regex_replace.size(); ++i) {
+		if (regex_replace[i].literal.empty())
+			candidates[i] = true;
+	}
+
+	size_t state = 0;
+	for (size_t i = 0; i < str.length(); ++i) {
+		state = next_state(state, str[i]);
+		vector<size_t> const & patterns = automaton[state].patterns;
+		for (size_t j = 0; j < patterns.size(); ++j)
+			candidates[patterns[j]] = true;
+	}
 }
 
 
@@ -170,12 +399,19 @@ string regular_expression_replace::substitute_definition(string const & pattern)
 // of output string through a rule "a" = "aa")
 bool regular_expression_replace::execute(string & str) const
 {
+	vector<bool> candidates;
 	bool changed = true;
 	for (size_t nr_iter = 0; changed && nr_iter < limit ; ++nr_iter) {
 		changed = false;
+		find_candidates(str, candidates);
 		for (size_t i = 0 ; i < regex_replace.size() ; ++i) {
-			if (do_execute(str, regex_replace[i]))
+			// regexec() can't match without the literal
+			if (!candidates[i])
+				continue;
+			if (do_execute(str, regex_replace[i])) {
 				changed = true;
+				find_candidates(str, candidates);
+			}
 		}
 	}
 
@@ -72,7 +72,10 @@ public:
 	 * @param str the input/output string where we search pattern and
 	 * replace them.
 	 *
-	 * Execute loop at max limit time on the set of regular expression
+	 * Execute loop at max limit time on the set of regular expression.
+	 * A regular expression is tried only if its literal (see
+	 * required_literal()) is present in str, these are searched all at
+	 * once with an Aho-Corasick automaton.
 	 *
 	 * Return true if too many match occur and replacing has been stopped
 	 * due to reach limit_defs_expansion. You can test if some pattern has
@@ -87,8 +90,29 @@ private:
 		regex_t regexp;
 		// replace the matched part with this string
 		std::string replace;
+		// a string present in all the matches, may be empty
+		std::string literal;
 	};
 
+	// a state of the automaton matching the literal of all patterns
+	struct literal_state {
+		literal_state() : fail(0) {}
+		// goto function
+		std::vector<std::pair<char, size_t> > next;
+		// longest proper suffix of this state which is a state
+		size_t fail;
+		// patterns whose literal is a suffix of this state
+		std::vector<size_t> patterns;
+	};
+
+	// return the state reached from state with ch, fail links included
+	size_t next_state(size_t state, char ch) const;
+	// rebuild the automaton from the literal of all patterns
+	void build_automaton();
+	// set candidates[i] to false if pattern i can't match str
+	void find_candidates(std::string const & str,
+	                     std::vector<bool> & candidates) const;
+
 	// helper to execute
 	bool do_execute(std::string & str, replace_t const & regexp) const;
 	void do_replace(std::string & str, std::string const & replace,
@@ -113,11 +137,22 @@ private:
 	size_t limit;
 	size_t limit_defs_expansion;
 	std::vector<replace_t> regex_replace;
+
+	// state 0 is the initial state
+	std::vector<literal_state> automaton;
 	/// dictionary of regular definition
 	typedef std::map<std::string, std::string> defs_dict;
 	defs_dict defs;
 };
 
+/**
+ * @param pattern a POSIX extended regular expression
+ *
+ * Return the longest string which is a part of any string matching the
+ * pattern, this is a conservative approximation which can be empty.
+ */
+std::string const required_literal(std::string const & pattern);
+
 /**
  * @param regex the regular_expression_replace to fill
  * @param filename the filename from where the deifnition and pattern are read
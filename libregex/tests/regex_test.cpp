@@ -8,6 +8,9 @@
  * when no argument is provided "mangled-name" is used,
  * see it for the input file format
  *
+ * $ regex_test --bench [filename]
+ * measures the throughput of the rewrite over the input file names
+ *
  * @remark Copyright 2003 OProfile authors
  * @remark Read the file COPYING
  *
@@ -20,8 +23,10 @@
 
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 #include <cstdlib>
+#include <ctime>
 
 using namespace std;
 
@@ -62,10 +67,49 @@ static void do_test(istream& fin)
 		cerr << "input file ill formed\n";
 }
 
+static void do_bench(istream & fin)
+{
+	regular_expression_replace rep;
+
+	setup_regex(rep, "../stl.pat");
+
+	// both the test and the expected names are used as input
+	vector<string> names;
+	string line;
+	while (getline(fin, line)) {
+		line = trim(line);
+		if (line.length() && line[0] != '#')
+			names.push_back(line);
+	}
+
+	size_t const nr_loops = 100;
+	clock_t const start = clock();
+	for (size_t i = 0; i < nr_loops; ++i) {
+		for (size_t j = 0; j < names.size(); ++j) {
+			string str(names[j]);
+			rep.execute(str);
+		}
+	}
+	double const secs = double(clock() - start) / CLOCKS_PER_SEC;
+
+	cout << nr_loops * names.size() << " names in " << secs << " s";
+	if (secs > 0)
+		cout << ", " << size_t(nr_loops * names.size() / secs)
+		     << " names/s";
+	cout << endl;
+}
+
 int main(int argc, char * argv[])
 {
 	try {
-		if (argc > 1) {
+		if (argc > 1 && string(argv[1]) == "--bench") {
+			ifstream fin(argc > 2 ? argv[2] : "mangled-name");
+			if (!fin) {
+				cerr << "Unable to open input file\n";
+				exit(EXIT_FAILURE);
+			}
+			do_bench(fin);
+		} else if (argc > 1) {
 			for (int i = 1; i < argc; ++i) {
 				ifstream fin(argv[i]);
 				do_test(fin);
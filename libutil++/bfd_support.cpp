@@ -560,6 +560,18 @@ void bfd_info::close()
 		bfd_close(abfd);
 }
 
+
+debug_line_index const * bfd_info::line_index() const
+{
+	if (!valid() || is_pseudo_bfd())
+		return 0;
+
+	if (!line_idx.get())
+		line_idx.reset(new debug_line_index(abfd));
+
+	return line_idx.get();
+}
+
 #if SYNTHESIZE_SYMBOLS
 /**
  * This function is intended solely for processing ppc64 debuginfo files.
@@ -776,6 +788,7 @@ find_nearest_line(bfd_info const & b, op_bfd_symbol const & sym,
 	asymbol * empty_syms[1];
 	bfd_vma pc;
 	bool ret;
+	debug_line_index const * index;
 
 	if (!b.valid())
 		goto fail;
@@ -826,6 +839,20 @@ find_nearest_line(bfd_info const & b, op_bfd_symbol const & sym,
 	if (pc >= bfd_section_size(abfd, section))
 		goto fail;
 
+	// fast path: the line table index answers nearly all lookups. Addresses
+	// it doesn't cover, and rows without a line number, which need the
+	// function name checks below, go through bfd_find_nearest_line()
+	index = b.line_index();
+	if (index && index->usable()) {
+		bfd_vma vma = bfd_get_section_vma(abfd, section) + pc;
+		if (index->find(vma, info.filename, linenr) && linenr) {
+			info.found = true;
+			info.line = linenr;
+			return info;
+		}
+		linenr = 0;
+	}
+
 	ret = bfd_find_nearest_line(abfd, section, syms, pc, &cfilename,
 	                                 &function, &linenr);
 
@@ -15,6 +15,7 @@
 #include "utility.h"
 #include "op_types.h"
 #include "locate_images.h"
+#include "debug_line_index.h"
 
 #include <bfd.h>
 #include <stdint.h>
@@ -49,6 +50,12 @@ struct bfd_info {
 	/// pick out the symbols from the bfd, if we can
 	void get_symbols();
 
+	/**
+	 * Return the line table index of this BFD, decoding it on first
+	 * use. Return NULL if the BFD is not valid.
+	 */
+	debug_line_index const * line_index() const;
+
 	/// the actual BFD
 	bfd * abfd;
 	/// normal symbols (includes synthesized symbols)
@@ -82,6 +89,9 @@ private:
 	 */ 
 	bfd_info * image_bfd_info;
 
+	/// lazily built by line_index()
+	mutable scoped_ptr<debug_line_index> line_idx;
+
 #if SYNTHESIZE_SYMBOLS
 	/**
 	 * This function is used only for ppc64 binaries. It uses the runtime
@@ -0,0 +1,775 @@
+/**
+ * @file debug_line_index.cpp
+ * Address to source line index built from .debug_line
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include "debug_line_index.h"
+
+#include "cverb.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+using namespace std;
+
+extern verbose vbfd;
+
+namespace {
+
+/// DWARF constants we need, the system dwarf.h is not always available
+enum {
+	DW_LNS_copy = 1,
+	DW_LNS_advance_pc,
+	DW_LNS_advance_line,
+	DW_LNS_set_file,
+	DW_LNS_set_column,
+	DW_LNS_negate_stmt,
+	DW_LNS_set_basic_block,
+	DW_LNS_const_add_pc,
+	DW_LNS_fixed_advance_pc
+};
+
+enum {
+	DW_LNE_end_sequence = 1,
+	DW_LNE_set_address,
+	DW_LNE_define_file
+};
+
+enum {
+	DW_LNCT_path = 1,
+	DW_LNCT_directory_index
+};
+
+enum {
+	DW_AT_stmt_list = 0x10,
+	DW_AT_comp_dir = 0x1b
+};
+
+enum {
+	DW_FORM_addr = 0x01,
+	DW_FORM_block2 = 0x03,
+	DW_FORM_block4 = 0x04,
+	DW_FORM_data2 = 0x05,
+	DW_FORM_data4 = 0x06,
+	DW_FORM_data8 = 0x07,
+	DW_FORM_string = 0x08,
+	DW_FORM_block = 0x09,
+	DW_FORM_block1 = 0x0a,
+	DW_FORM_data1 = 0x0b,
+	DW_FORM_flag = 0x0c,
+	DW_FORM_sdata = 0x0d,
+	DW_FORM_strp = 0x0e,
+	DW_FORM_udata = 0x0f,
+	DW_FORM_ref_addr = 0x10,
+	DW_FORM_ref1 = 0x11,
+	DW_FORM_ref2 = 0x12,
+	DW_FORM_ref4 = 0x13,
+	DW_FORM_ref8 = 0x14,
+	DW_FORM_ref_udata = 0x15,
+	DW_FORM_sec_offset = 0x17,
+	DW_FORM_exprloc = 0x18,
+	DW_FORM_flag_present = 0x19,
+	DW_FORM_data16 = 0x1e,
+	DW_FORM_line_strp = 0x1f,
+	DW_FORM_ref_sig8 = 0x20,
+	DW_FORM_GNU_ref_alt = 0x1f20,
+	DW_FORM_GNU_strp_alt = 0x1f21
+};
+
+
+/**
+ * Bounds checked reader over a chunk of DWARF data. Once a read goes
+ * past the end all further reads return 0 and ok() is false.
+ */
+class dwarf_reader {
+public:
+	dwarf_reader(bfd * abfd_, unsigned char const * p_,
+	             unsigned char const * end_)
+		: abfd(abfd_), p(p_), end(end_), failed(false) {}
+
+	bool ok() const { return !failed; }
+	unsigned char const * pos() const { return p; }
+
+	void seek(unsigned char const * to) {
+		if (to > end)
+			failed = true;
+		else
+			p = to;
+	}
+
+	bool has(size_t n) {
+		if (failed || size_t(end - p) < n)
+			failed = true;
+		return !failed;
+	}
+
+	unsigned int u8() {
+		if (!has(1))
+			return 0;
+		return *p++;
+	}
+
+	unsigned int u16() {
+		if (!has(2))
+			return 0;
+		unsigned int val = bfd_get_16(abfd, p);
+		p += 2;
+		return val;
+	}
+
+	bfd_vma u32() {
+		if (!has(4))
+			return 0;
+		bfd_vma val = bfd_get_32(abfd, p);
+		p += 4;
+		return val;
+	}
+
+	bfd_vma u64() {
+		if (!has(8))
+			return 0;
+		bfd_vma val = bfd_get_64(abfd, p);
+		p += 8;
+		return val;
+	}
+
+	/// an address or offset of the given size
+	bfd_vma sized(size_t size) {
+		switch (size) {
+		case 1: return u8();
+		case 2: return u16();
+		case 4: return u32();
+		case 8: return u64();
+		}
+		failed = true;
+		return 0;
+	}
+
+	bfd_vma uleb() {
+		bfd_vma val = 0;
+		unsigned int shift = 0;
+		unsigned int byte;
+		do {
+			byte = u8();
+			if (shift < sizeof(bfd_vma) * 8)
+				val |= bfd_vma(byte & 0x7f) << shift;
+			shift += 7;
+		} while ((byte & 0x80) && ok());
+		return val;
+	}
+
+	long sleb() {
+		bfd_vma val = 0;
+		unsigned int shift = 0;
+		unsigned int byte;
+		do {
+			byte = u8();
+			if (shift < sizeof(bfd_vma) * 8)
+				val |= bfd_vma(byte & 0x7f) << shift;
+			shift += 7;
+		} while ((byte & 0x80) && ok());
+		if (shift < sizeof(bfd_vma) * 8 && (byte & 0x40))
+			val |= ~bfd_vma(0) << shift;
+		return long(val);
+	}
+
+	string cstring() {
+		unsigned char const * start = p;
+		while (p < end && *p)
+			++p;
+		if (p == end) {
+			failed = true;
+			return string();
+		}
+		string str(start, p);
+		++p;
+		return str;
+	}
+
+private:
+	bfd * abfd;
+	unsigned char const * p;
+	unsigned char const * end;
+	bool failed;
+};
+
+
+bool read_section(bfd * abfd, char const * name,
+                  vector<unsigned char> & contents)
+{
+	asection * sect = bfd_get_section_by_name(abfd, name);
+	if (!sect)
+		return false;
+
+	bfd_size_type size = bfd_section_size(abfd, sect);
+	contents.resize(size);
+	if (!size)
+		return true;
+
+	return bfd_get_section_contents(abfd, sect, &contents[0], 0, size);
+}
+
+
+string const c_string_at(vector<unsigned char> const & section,
+                         bfd_vma offset)
+{
+	if (offset >= section.size())
+		return string();
+	vector<unsigned char>::const_iterator it = section.begin() + offset;
+	return string(it, find(it, section.end(), 0));
+}
+
+
+string const join_path(string const & dir, string const & name)
+{
+	if (dir.empty() || name.empty() || name[0] == '/')
+		return name;
+	if (dir[dir.size() - 1] == '/')
+		return dir + name;
+	return dir + '/' + name;
+}
+
+
+/**
+ * Read a DWARF 5 directory or file name entry described by formats,
+ * a vector of (content type, form) pairs.
+ */
+bool read_entry(dwarf_reader & r, vector<pair<bfd_vma, bfd_vma> > const & formats,
+                bool dwarf64, vector<unsigned char> const & line_str,
+                string & path, bfd_vma & dir)
+{
+	for (size_t i = 0; i < formats.size(); ++i) {
+		string str;
+		bfd_vma val = 0;
+
+		switch (formats[i].second) {
+		case DW_FORM_string:
+			str = r.cstring();
+			break;
+		case DW_FORM_line_strp: {
+			bfd_vma offset = r.sized(dwarf64 ? 8 : 4);
+			if (offset >= line_str.size())
+				return false;
+			str = c_string_at(line_str, offset);
+			break;
+		}
+		case DW_FORM_udata:
+			val = r.uleb();
+			break;
+		case DW_FORM_data1:
+			val = r.u8();
+			break;
+		case DW_FORM_data2:
+			val = r.u16();
+			break;
+		case DW_FORM_data4:
+			val = r.u32();
+			break;
+		case DW_FORM_data8:
+			val = r.u64();
+			break;
+		case DW_FORM_data16:
+			r.seek(r.pos() + 16);
+			break;
+		case DW_FORM_block:
+			val = r.uleb();
+			r.seek(r.pos() + val);
+			break;
+		default:
+			// strx, strp & co. need more than .debug_line
+			return false;
+		}
+
+		if (formats[i].first == DW_LNCT_path)
+			path = str;
+		else if (formats[i].first == DW_LNCT_directory_index)
+			dir = val;
+	}
+
+	return r.ok();
+}
+
+
+bool read_formats(dwarf_reader & r,
+                  vector<pair<bfd_vma, bfd_vma> > & formats)
+{
+	unsigned int count = r.u8();
+	for (unsigned int i = 0; i < count && r.ok(); ++i) {
+		bfd_vma type = r.uleb();
+		bfd_vma form = r.uleb();
+		formats.push_back(make_pair(type, form));
+	}
+	return r.ok();
+}
+
+
+/**
+ * Read the DW_AT_comp_dir of the DWARF 2 to 4 compilation unit at r, if
+ * any, and record it against its DW_AT_stmt_list. Before DWARF 5 the line
+ * table itself doesn't hold the compilation directory, which relative
+ * file names are based on.
+ */
+bool read_comp_dir(bfd * abfd, dwarf_reader & r,
+                   vector<unsigned char> const & abbrev,
+                   vector<unsigned char> const & str,
+                   map<bfd_vma, string> & comp_dirs)
+{
+	bool dwarf64 = false;
+	bfd_vma length = r.u32();
+	if (length == 0xffffffff) {
+		dwarf64 = true;
+		length = r.u64();
+	}
+	unsigned char const * next = r.pos() + length;
+	if (!r.ok() || !length)
+		return false;
+
+	unsigned int version = r.u16();
+	if (version < 2 || version > 4) {
+		r.seek(next);
+		return r.ok();
+	}
+
+	size_t offset_size = dwarf64 ? 8 : 4;
+	bfd_vma abbrev_offset = r.sized(offset_size);
+	size_t addr_size = r.u8();
+	bfd_vma code = r.uleb();
+	if (!r.ok() || abbrev_offset >= abbrev.size())
+		return false;
+
+	// find the abbreviation describing the unit DIE
+	unsigned char const * abbrev_end = &abbrev[0] + abbrev.size();
+	dwarf_reader a(abfd, &abbrev[0] + abbrev_offset, abbrev_end);
+	while (a.ok() && a.uleb() != code) {
+		// tag, children, attribute list
+		a.uleb();
+		a.u8();
+		while (a.ok() && (a.uleb() | a.uleb()))
+			;
+	}
+	a.uleb();
+	a.u8();
+
+	bool has_stmt_list = false;
+	bfd_vma stmt_list = 0;
+	string comp_dir;
+	for (;;) {
+		bfd_vma attr = a.uleb();
+		bfd_vma form = a.uleb();
+		if (!a.ok())
+			return false;
+		if (!attr && !form)
+			break;
+
+		bfd_vma val = 0;
+		string strval;
+		switch (form) {
+		case DW_FORM_addr:
+			val = r.sized(addr_size);
+			break;
+		case DW_FORM_ref_addr:
+			val = r.sized(version == 2 ? addr_size : offset_size);
+			break;
+		case DW_FORM_data1:
+		case DW_FORM_ref1:
+		case DW_FORM_flag:
+			val = r.u8();
+			break;
+		case DW_FORM_data2:
+		case DW_FORM_ref2:
+			val = r.u16();
+			break;
+		case DW_FORM_data4:
+		case DW_FORM_ref4:
+			val = r.u32();
+			break;
+		case DW_FORM_data8:
+		case DW_FORM_ref8:
+		case DW_FORM_ref_sig8:
+			val = r.u64();
+			break;
+		case DW_FORM_sdata:
+			val = r.sleb();
+			break;
+		case DW_FORM_udata:
+		case DW_FORM_ref_udata:
+			val = r.uleb();
+			break;
+		case DW_FORM_strp:
+			strval = c_string_at(str, r.sized(offset_size));
+			break;
+		case DW_FORM_sec_offset:
+		case DW_FORM_GNU_ref_alt:
+		case DW_FORM_GNU_strp_alt:
+			val = r.sized(offset_size);
+			break;
+		case DW_FORM_string:
+			strval = r.cstring();
+			break;
+		case DW_FORM_flag_present:
+			break;
+		case DW_FORM_block1:
+			r.seek(r.pos() + r.u8());
+			break;
+		case DW_FORM_block2:
+			r.seek(r.pos() + r.u16());
+			break;
+		case DW_FORM_block4:
+			r.seek(r.pos() + r.u32());
+			break;
+		case DW_FORM_block:
+		case DW_FORM_exprloc:
+			r.seek(r.pos() + r.uleb());
+			break;
+		default:
+			// we can't go further but the other units are fine
+			attr = 0;
+			break;
+		}
+
+		if (attr == DW_AT_stmt_list) {
+			has_stmt_list = true;
+			stmt_list = val;
+		} else if (attr == DW_AT_comp_dir) {
+			comp_dir = strval;
+		} else if (!attr) {
+			break;
+		}
+	}
+
+	if (has_stmt_list && !comp_dir.empty())
+		comp_dirs[stmt_list] = comp_dir;
+
+	r.seek(next);
+	return r.ok();
+}
+
+
+/// map .debug_line offsets to compilation directories
+void read_comp_dirs(bfd * abfd, map<bfd_vma, string> & comp_dirs)
+{
+	vector<unsigned char> info;
+	vector<unsigned char> abbrev;
+	vector<unsigned char> str;
+
+	if (!read_section(abfd, ".debug_info", info) || info.empty() ||
+	    !read_section(abfd, ".debug_abbrev", abbrev) || abbrev.empty())
+		return;
+	read_section(abfd, ".debug_str", str);
+
+	dwarf_reader r(abfd, &info[0], &info[0] + info.size());
+	while (r.ok() && r.pos() < &info[0] + info.size()) {
+		if (!read_comp_dir(abfd, r, abbrev, str, comp_dirs))
+			break;
+	}
+}
+
+} // anon namespace
+
+
+debug_line_index::debug_line_index(bfd * abfd)
+{
+	// addresses in relocatable objects are not final, let BFD handle it
+	if (bfd_get_file_flags(abfd) & HAS_RELOC)
+		return;
+
+	vector<unsigned char> line;
+	if (!read_section(abfd, ".debug_line", line) || line.empty())
+		return;
+
+	vector<unsigned char> line_str;
+	read_section(abfd, ".debug_line_str", line_str);
+
+	map<bfd_vma, string> comp_dirs;
+	read_comp_dirs(abfd, comp_dirs);
+
+	map<string, unsigned int> file_ids;
+	unsigned char const * p = &line[0];
+	unsigned char const * end = p + line.size();
+	while (p < end) {
+		string const & comp_dir = comp_dirs[p - &line[0]];
+		if (!decode_unit(abfd, p, end, comp_dir, line_str, file_ids)) {
+			cverb << vbfd << "debug_line_index: unable to decode "
+			      << ".debug_line of " << bfd_get_filename(abfd)
+			      << endl;
+			rows.clear();
+			filenames.clear();
+			return;
+		}
+	}
+
+	stable_sort(rows.begin(), rows.end(), less_row);
+
+	cverb << vbfd << "debug_line_index: " << rows.size() << " rows, "
+	      << filenames.size() << " files for "
+	      << bfd_get_filename(abfd) << endl;
+}
+
+
+bool debug_line_index::less_row(row const & lhs, row const & rhs)
+{
+	if (lhs.vma != rhs.vma)
+		return lhs.vma < rhs.vma;
+	return lhs.file == end_sequence && rhs.file != end_sequence;
+}
+
+
+bool debug_line_index::in_code_section(bfd * abfd, bfd_vma vma) const
+{
+	for (asection * sect = abfd->sections; sect; sect = sect->next) {
+		if (!(bfd_get_section_flags(abfd, sect) & SEC_CODE))
+			continue;
+		bfd_vma start = bfd_get_section_vma(abfd, sect);
+		if (vma >= start && vma < start + bfd_section_size(abfd, sect))
+			return true;
+	}
+	return false;
+}
+
+
+bool debug_line_index::decode_unit(bfd * abfd, unsigned char const * & p,
+                                   unsigned char const * end,
+                                   string const & comp_dir,
+                                   vector<unsigned char> const & line_str,
+                                   map<string, unsigned int> & file_ids)
+{
+	dwarf_reader r(abfd, p, end);
+
+	bool dwarf64 = false;
+	bfd_vma length = r.u32();
+	if (length == 0xffffffff) {
+		dwarf64 = true;
+		length = r.u64();
+	}
+	if (!r.ok() || length > bfd_vma(end - r.pos()))
+		return false;
+
+	unsigned char const * unit_end = r.pos() + length;
+	r = dwarf_reader(abfd, r.pos(), unit_end);
+	p = unit_end;
+
+	unsigned int version = r.u16();
+	if (version < 2 || version > 5)
+		return false;
+
+	if (version >= 5) {
+		// address and segment selector size
+		r.u8();
+		r.u8();
+	}
+
+	bfd_vma header_length = r.sized(dwarf64 ? 8 : 4);
+	if (!r.ok() || header_length > bfd_vma(unit_end - r.pos()))
+		return false;
+	unsigned char const * program = r.pos() + header_length;
+
+	unsigned int min_inst_length = r.u8();
+	if (version >= 4) {
+		// maximum operations per instruction, VLIW only
+		r.u8();
+	}
+	// default_is_stmt
+	r.u8();
+	int line_base = static_cast<signed char>(r.u8());
+	unsigned int line_range = r.u8();
+	unsigned int opcode_base = r.u8();
+	if (!r.ok() || !line_range || !opcode_base)
+		return false;
+
+	vector<unsigned int> opcode_lengths(opcode_base);
+	for (unsigned int i = 1; i < opcode_base; ++i)
+		opcode_lengths[i] = r.u8();
+
+	vector<string> dirs;
+	vector<string> names;
+	vector<bfd_vma> name_dirs;
+
+	if (version < 5) {
+		// directory 0 is the compilation directory, file 0 is unused
+		dirs.push_back(comp_dir);
+		names.push_back(string());
+		name_dirs.push_back(0);
+		for (string dir = r.cstring(); !dir.empty() && r.ok();
+		     dir = r.cstring())
+			dirs.push_back(join_path(comp_dir, dir));
+		for (string name = r.cstring(); !name.empty() && r.ok();
+		     name = r.cstring()) {
+			names.push_back(name);
+			name_dirs.push_back(r.uleb());
+			// mtime and length
+			r.uleb();
+			r.uleb();
+		}
+	} else {
+		vector<pair<bfd_vma, bfd_vma> > formats;
+		if (!read_formats(r, formats))
+			return false;
+		bfd_vma count = r.uleb();
+		for (bfd_vma i = 0; i < count && r.ok(); ++i) {
+			string path;
+			bfd_vma dir = 0;
+			if (!read_entry(r, formats, dwarf64, line_str, path, dir))
+				return false;
+			// directory 0 is the compilation directory, the
+			// others can be relative to it
+			if (i)
+				path = join_path(dirs[0], path);
+			dirs.push_back(path);
+		}
+
+		formats.clear();
+		if (!read_formats(r, formats))
+			return false;
+		count = r.uleb();
+		for (bfd_vma i = 0; i < count && r.ok(); ++i) {
+			string path;
+			bfd_vma dir = 0;
+			if (!read_entry(r, formats, dwarf64, line_str, path, dir))
+				return false;
+			names.push_back(path);
+			name_dirs.push_back(dir);
+		}
+	}
+
+	if (!r.ok())
+		return false;
+
+	// file ids in the unit numbering
+	vector<unsigned int> files;
+	for (size_t i = 0; i < names.size(); ++i) {
+		if (names[i].empty()) {
+			files.push_back(end_sequence);
+			continue;
+		}
+
+		string name = names[i];
+		if (name_dirs[i] < dirs.size())
+			name = join_path(dirs[name_dirs[i]], name);
+
+		map<string, unsigned int>::const_iterator it =
+			file_ids.find(name);
+		if (it == file_ids.end()) {
+			it = file_ids.insert(make_pair(name,
+			                               filenames.size())).first;
+			filenames.push_back(name);
+		}
+		files.push_back(it->second);
+	}
+
+	r.seek(program);
+
+	vector<row> sequence;
+	bfd_vma address = 0;
+	unsigned int file = 1;
+	unsigned int linenr = 1;
+
+	while (r.ok() && r.pos() < unit_end) {
+		unsigned int opcode = r.u8();
+		bool emit = false;
+
+		if (opcode >= opcode_base) {
+			unsigned int adjusted = opcode - opcode_base;
+			address += (adjusted / line_range) * min_inst_length;
+			linenr += line_base + int(adjusted % line_range);
+			emit = true;
+		} else if (opcode == 0) {
+			bfd_vma len = r.uleb();
+			if (!r.ok() || len > bfd_vma(unit_end - r.pos()) || !len)
+				return false;
+			unsigned char const * next = r.pos() + len;
+			switch (r.u8()) {
+			case DW_LNE_end_sequence: {
+				if (!sequence.empty() &&
+				    in_code_section(abfd, sequence[0].vma)) {
+					row const end_row =
+						{ address, end_sequence, 0 };
+					rows.insert(rows.end(), sequence.begin(),
+					            sequence.end());
+					rows.push_back(end_row);
+				}
+				sequence.clear();
+				address = 0;
+				file = 1;
+				linenr = 1;
+				break;
+			}
+			case DW_LNE_set_address:
+				address = r.sized(len - 1);
+				break;
+			case DW_LNE_define_file:
+				// deprecated and unused by any known producer
+				return false;
+			}
+			r.seek(next);
+		} else {
+			switch (opcode) {
+			case DW_LNS_copy:
+				emit = true;
+				break;
+			case DW_LNS_advance_pc:
+				address += r.uleb() * min_inst_length;
+				break;
+			case DW_LNS_advance_line:
+				linenr += r.sleb();
+				break;
+			case DW_LNS_set_file:
+				file = r.uleb();
+				break;
+			case DW_LNS_const_add_pc:
+				address += ((255 - opcode_base) / line_range)
+					* min_inst_length;
+				break;
+			case DW_LNS_fixed_advance_pc:
+				address += r.u16();
+				break;
+			default:
+				for (unsigned int i = 0;
+				     i < opcode_lengths[opcode]; ++i)
+					r.uleb();
+				break;
+			}
+		}
+
+		if (emit) {
+			if (file >= files.size() || files[file] == end_sequence)
+				return false;
+			row const new_row = { address, files[file], linenr };
+			sequence.push_back(new_row);
+		}
+	}
+
+	return r.ok();
+}
+
+
+size_t debug_line_index::covering_row(bfd_vma vma) const
+{
+	row const key = { vma, 0, 0 };
+	vector<row>::const_iterator it =
+		upper_bound(rows.begin(), rows.end(), key, less_row);
+	if (it == rows.begin())
+		return rows.size();
+	--it;
+	if (it->file == end_sequence)
+		return rows.size();
+	return it - rows.begin();
+}
+
+
+bool debug_line_index::find(bfd_vma vma, string & filename,
+                            unsigned int & linenr) const
+{
+	size_t i = covering_row(vma);
+	if (i == rows.size())
+		return false;
+
+	filename = filenames[rows[i].file];
+	linenr = rows[i].line;
+	return true;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file debug_line_index.h
+ * Address to source line index built from .debug_line
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef DEBUG_LINE_INDEX_H
+#define DEBUG_LINE_INDEX_H
+
+#include <bfd.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "utility.h"
+
+/**
+ * The DWARF line tables of an image decoded once into a vector of rows
+ * sorted by vma, so each lookup is a binary search rather than a call to
+ * bfd_find_nearest_line(). The index is only built for linked images
+ * (executables, shared libraries and their separate debuginfo files);
+ * for relocatable objects, or if anything in .debug_line is not
+ * understood, the index is left empty and callers must fall back to
+ * bfd_find_nearest_line().
+ */
+class debug_line_index : noncopyable {
+public:
+	/// decode the line tables of abfd, abfd must remain open
+	debug_line_index(bfd * abfd);
+
+	/// true if lookups can be answered from this index
+	bool usable() const { return !rows.empty(); }
+
+	/**
+	 * @param vma the address to lookup
+	 * @param filename output parameter to store filename
+	 * @param linenr output parameter to store linenr
+	 *
+	 * Return false if no line table row covers vma. linenr can be zero
+	 * if the covering row has no line attribution.
+	 */
+	bool find(bfd_vma vma, std::string & filename,
+	          unsigned int & linenr) const;
+
+	/// nr. of rows in the index
+	size_t size() const { return rows.size(); }
+
+private:
+	/// a line table row, a row with file == end_sequence ends a sequence
+	struct row {
+		bfd_vma vma;
+		unsigned int file;
+		unsigned int line;
+	};
+
+	enum { end_sequence = ~0U };
+
+	/// order rows by vma, an end of sequence before a row at the same vma
+	static bool less_row(row const & lhs, row const & rhs);
+
+	/// return the index of the row covering vma, or rows.size()
+	size_t covering_row(bfd_vma vma) const;
+
+	/// decode one line program unit, return false on malformed input
+	bool decode_unit(bfd * abfd, unsigned char const * & p,
+	                 unsigned char const * end,
+	                 std::string const & comp_dir,
+	                 std::vector<unsigned char> const & line_str,
+	                 std::map<std::string, unsigned int> & file_ids);
+
+	/// true if vma lies inside a code section of abfd
+	bool in_code_section(bfd * abfd, bfd_vma vma) const;
+
+	/// all rows sorted by vma
+	std::vector<row> rows;
+	/// file names referenced by row::file
+	std::vector<std::string> filenames;
+};
+
+#endif /* !DEBUG_LINE_INDEX_H */
@@ -97,7 +97,8 @@ bool is_files_identical(string const & file1, string const & file2)
 
 string const op_realpath(string const & name)
 {
-	static char tmp[PATH_MAX];
+	// not static, opannotate calls this from several threads
+	char tmp[PATH_MAX];
 	if (!realpath(name.c_str(), tmp))
 		return name;
 	return string(tmp);
@@ -45,7 +45,8 @@ bool is_files_identical(std::string const & file1, std::string const & file2);
  * file must exist !
  *
  * Resolve a symbolic link as far as possible.
- * Returns the original string on failure.
+ * Returns the original string on failure. Safe to call from several
+ * threads at once.
  */
 std::string const op_realpath(std::string const & name);
 
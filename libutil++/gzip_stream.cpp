@@ -0,0 +1,142 @@
+/**
+ * @file gzip_stream.cpp
+ * Writing a gzip compressed stream
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include "config.h"
+
+#include <unistd.h>
+
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "gzip_stream.h"
+
+using namespace std;
+
+#if HAVE_LIBZ
+
+gzip_streambuf::gzip_streambuf(string const & filename)
+	: file(0), failed(false)
+{
+	if (filename.empty()) {
+		// gzclose() closes the fd, keep stdout usable
+		int fd = dup(STDOUT_FILENO);
+		if (fd >= 0) {
+			file = gzdopen(fd, "wb");
+			if (!file)
+				::close(fd);
+		}
+	} else {
+		file = gzopen(filename.c_str(), "wb");
+	}
+
+	setp(buffer, buffer + sizeof(buffer));
+}
+
+
+gzip_streambuf::~gzip_streambuf()
+{
+	close();
+}
+
+
+bool gzip_streambuf::flush_buffer()
+{
+	int const len = pptr() - pbase();
+	if (len && !failed && gzwrite(static_cast<gzFile>(file), pbase(), len) != len)
+		failed = true;
+	setp(buffer, buffer + sizeof(buffer));
+	return !failed;
+}
+
+
+gzip_streambuf::int_type gzip_streambuf::overflow(int_type c)
+{
+	if (!file || !flush_buffer())
+		return traits_type::eof();
+
+	if (!traits_type::eq_int_type(c, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+
+int gzip_streambuf::sync()
+{
+	// no gzflush(), a full flush would degrade the compression
+	if (!file || !flush_buffer())
+		return -1;
+	return 0;
+}
+
+
+bool gzip_streambuf::close()
+{
+	if (!file)
+		return false;
+
+	flush_buffer();
+	if (gzclose(static_cast<gzFile>(file)) != Z_OK)
+		failed = true;
+	file = 0;
+	return !failed;
+}
+
+
+bool gzip_streambuf::supported()
+{
+	return true;
+}
+
+#else
+
+gzip_streambuf::gzip_streambuf(string const &)
+	: file(0), failed(true)
+{
+}
+
+
+gzip_streambuf::~gzip_streambuf()
+{
+}
+
+
+bool gzip_streambuf::flush_buffer()
+{
+	return false;
+}
+
+
+gzip_streambuf::int_type gzip_streambuf::overflow(int_type)
+{
+	return traits_type::eof();
+}
+
+
+int gzip_streambuf::sync()
+{
+	return -1;
+}
+
+
+bool gzip_streambuf::close()
+{
+	return false;
+}
+
+
+bool gzip_streambuf::supported()
+{
+	return false;
+}
+
+#endif /* HAVE_LIBZ */
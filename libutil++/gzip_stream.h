@@ -0,0 +1,59 @@
+/**
+ * @file gzip_stream.h
+ * Writing a gzip compressed stream
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+#include <streambuf>
+#include <string>
+
+#include "utility.h"
+
+/**
+ * A streambuf compressing to a gzip file as data are written, so large
+ * reports never exist uncompressed in memory or on disk. Attach it to an
+ * ostream, or replace the rdbuf() of an existing one.
+ */
+class gzip_streambuf : public std::streambuf, noncopyable {
+public:
+	/**
+	 * @param filename  the file to write, stdout if empty
+	 *
+	 * Check is_open() before using the stream.
+	 */
+	explicit gzip_streambuf(std::string const & filename);
+
+	/// close() if it was not done yet
+	~gzip_streambuf();
+
+	/// false if the output couldn't be opened
+	bool is_open() const { return file != 0; }
+
+	/// flush and terminate the gzip stream, false on any write error
+	bool close();
+
+	/// false if oprofile is built without zlib
+	static bool supported();
+
+protected:
+	int_type overflow(int_type c);
+	int sync();
+
+private:
+	/// compress the buffered data
+	bool flush_buffer();
+
+	/// the gzFile, kept opaque so zlib.h isn't needed by our users
+	void * file;
+	bool failed;
+	char buffer[65536];
+};
+
+#endif /* !GZIP_STREAM_H */
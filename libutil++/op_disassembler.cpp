@@ -0,0 +1,290 @@
+/**
+ * @file op_disassembler.cpp
+ * In-process disassembly through libopcodes
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include "op_disassembler.h"
+
+#include "config.h"
+#include "cverb.h"
+
+#if HAVE_LIBOPCODES
+#include <dis-asm.h>
+#endif
+
+#include <cstdarg>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+extern verbose vbfd;
+
+namespace {
+
+struct less_sym_vma {
+	bool operator()(bfd_vma vma, pair<bfd_vma, string> const & sym) const {
+		return vma < sym.first;
+	}
+};
+
+} // anon namespace
+
+#if HAVE_LIBOPCODES
+
+/// libopcodes state for one image
+struct op_disassembler::disasm_state {
+	disassemble_info info;
+	disassembler_ftype print_insn;
+	/// text of the instruction being disassembled
+	string text;
+	/// used to print symbolic addresses
+	op_disassembler const * owner;
+	/// contents of the range being disassembled
+	vector<bfd_byte> buffer;
+};
+
+namespace {
+
+void append_text(void * stream, char const * fmt, va_list ap)
+{
+	op_disassembler::disasm_state * state =
+		static_cast<op_disassembler::disasm_state *>(stream);
+
+	char buf[256];
+	va_list aq;
+	va_copy(aq, ap);
+	int len = vsnprintf(buf, sizeof(buf), fmt, aq);
+	va_end(aq);
+
+	if (len < 0)
+		return;
+
+	if (size_t(len) < sizeof(buf)) {
+		state->text.append(buf, len);
+	} else {
+		vector<char> big(len + 1);
+		vsnprintf(&big[0], big.size(), fmt, ap);
+		state->text.append(&big[0], len);
+	}
+}
+
+
+int print_text(void * stream, char const * fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	append_text(stream, fmt, ap);
+	va_end(ap);
+	return 0;
+}
+
+
+#if INIT_DISASSEMBLE_INFO_STYLED
+int print_styled_text(void * stream, enum disassembler_style,
+                      char const * fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	append_text(stream, fmt, ap);
+	va_end(ap);
+	return 0;
+}
+#endif
+
+
+/// print an address operand the way objdump does: "401126 <foo+0x6>"
+void print_address(bfd_vma vma, disassemble_info * info)
+{
+	op_disassembler::disasm_state * state =
+		static_cast<op_disassembler::disasm_state *>(info->stream);
+
+	print_text(state, "%llx", (unsigned long long)vma);
+
+	string name;
+	bfd_vma offset;
+	if (!state->owner->find_symbol(vma, name, offset))
+		return;
+
+	if (offset)
+		print_text(state, " <%s+0x%llx>", name.c_str(),
+		           (unsigned long long)offset);
+	else
+		print_text(state, " <%s>", name.c_str());
+}
+
+
+disassembler_ftype get_disassembler(bfd * abfd)
+{
+#if DISASSEMBLER_TAKES_ARCH
+	return disassembler(bfd_get_arch(abfd), bfd_big_endian(abfd),
+	                    bfd_get_mach(abfd), abfd);
+#else
+	return disassembler(abfd);
+#endif
+}
+
+} // anon namespace
+
+#else
+
+struct op_disassembler::disasm_state {
+};
+
+#endif /* HAVE_LIBOPCODES */
+
+
+op_disassembler::op_disassembler(string const & image)
+	: disasm(0)
+{
+#if HAVE_LIBOPCODES
+	ibfd.abfd = open_bfd(image);
+	if (!ibfd.valid())
+		return;
+
+	ibfd.get_symbols();
+	for (size_t i = 0; i < ibfd.nr_syms; ++i) {
+		asymbol const * sym = ibfd.syms[i];
+		if (!sym->section || !(sym->section->flags & SEC_CODE))
+			continue;
+		if (sym->flags & BSF_SECTION_SYM || !*sym->name)
+			continue;
+		code_syms.push_back(make_pair(bfd_asymbol_value(sym),
+		                              string(sym->name)));
+	}
+	sort(code_syms.begin(), code_syms.end());
+
+	disasm = new disasm_state;
+	disasm->owner = this;
+
+#if INIT_DISASSEMBLE_INFO_STYLED
+	init_disassemble_info(&disasm->info, disasm, print_text,
+	                      print_styled_text);
+#else
+	init_disassemble_info(&disasm->info, disasm, print_text);
+#endif
+	disasm->info.arch = bfd_get_arch(ibfd.abfd);
+	disasm->info.mach = bfd_get_mach(ibfd.abfd);
+	disasm->info.endian = bfd_big_endian(ibfd.abfd)
+		? BFD_ENDIAN_BIG : BFD_ENDIAN_LITTLE;
+	disasm->info.print_address_func = print_address;
+	disassemble_init_for_target(&disasm->info);
+
+	disasm->print_insn = get_disassembler(ibfd.abfd);
+	if (!disasm->print_insn) {
+		cverb << vbfd << "no libopcodes disassembler for "
+		      << image << endl;
+		delete disasm;
+		disasm = 0;
+	}
+#else
+	cverb << vbfd << "built without libopcodes, can't disassemble "
+	      << image << endl;
+#endif
+}
+
+
+op_disassembler::~op_disassembler()
+{
+	delete disasm;
+}
+
+
+unsigned int op_disassembler::address_digits() const
+{
+	return bfd_arch_bits_per_address(ibfd.abfd) / 4;
+}
+
+
+asection * op_disassembler::find_section(bfd_vma vma) const
+{
+	for (asection * sect = ibfd.abfd->sections; sect; sect = sect->next) {
+		if (!(bfd_get_section_flags(ibfd.abfd, sect) & SEC_CODE))
+			continue;
+		bfd_vma start = bfd_get_section_vma(ibfd.abfd, sect);
+		if (vma >= start &&
+		    vma < start + bfd_section_size(ibfd.abfd, sect))
+			return sect;
+	}
+	return 0;
+}
+
+
+bool op_disassembler::find_symbol(bfd_vma vma, string & name,
+                                  bfd_vma & offset) const
+{
+	vector<pair<bfd_vma, string> >::const_iterator it =
+		upper_bound(code_syms.begin(), code_syms.end(), vma,
+		            less_sym_vma());
+	if (it == code_syms.begin())
+		return false;
+	--it;
+
+	name = it->second;
+	offset = vma - it->first;
+	return true;
+}
+
+
+#if HAVE_LIBOPCODES
+
+bool op_disassembler::disassemble(bfd_vma start, bfd_vma end,
+                                  vector<insn> & insns)
+{
+	if (!disasm)
+		return false;
+
+	asection * sect = find_section(start);
+	if (!sect)
+		return false;
+
+	bfd_vma sect_vma = bfd_get_section_vma(ibfd.abfd, sect);
+	bfd_vma sect_end = sect_vma + bfd_section_size(ibfd.abfd, sect);
+	if (end > sect_end)
+		end = sect_end;
+	if (start >= end)
+		return true;
+
+	vector<bfd_byte> & buffer = disasm->buffer;
+	buffer.resize(end - start);
+	if (!bfd_get_section_contents(ibfd.abfd, sect, &buffer[0],
+	                              start - sect_vma, buffer.size())) {
+		cverb << vbfd << "op_disassembler: unable to read section "
+		      << sect->name << endl;
+		return false;
+	}
+
+	disassemble_info & info = disasm->info;
+	info.buffer = &buffer[0];
+	info.buffer_vma = start;
+	info.buffer_length = buffer.size();
+	info.section = sect;
+
+	for (bfd_vma pc = start; pc < end; ) {
+		disasm->text.erase();
+		int size = disasm->print_insn(pc, &info);
+		if (size <= 0)
+			return false;
+
+		insn const cur = { pc, size_t(size), disasm->text };
+		insns.push_back(cur);
+		pc += size;
+	}
+
+	return true;
+}
+
+#else
+
+bool op_disassembler::disassemble(bfd_vma, bfd_vma, vector<insn> &)
+{
+	return false;
+}
+
+#endif /* HAVE_LIBOPCODES */
@@ -0,0 +1,81 @@
+/**
+ * @file op_disassembler.h
+ * In-process disassembly through libopcodes
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef OP_DISASSEMBLER_H
+#define OP_DISASSEMBLER_H
+
+#include "bfd_support.h"
+#include "utility.h"
+
+#include <bfd.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Disassemble address ranges of an image without spawning objdump.
+ * Only the requested ranges are read from the image. The output of an
+ * instruction is formatted like objdump --no-show-raw-insn.
+ *
+ * If oprofile was built without libopcodes, or the image architecture is
+ * not supported by it, valid() returns false and the caller must fall
+ * back to objdump.
+ */
+class op_disassembler : noncopyable {
+public:
+	/// a single disassembled instruction
+	struct insn {
+		bfd_vma vma;
+		size_t size;
+		std::string text;
+	};
+
+	/// @param image the file to disassemble
+	explicit op_disassembler(std::string const & image);
+
+	~op_disassembler();
+
+	/// true if ranges of this image can be disassembled in-process
+	bool valid() const { return disasm; }
+
+	/**
+	 * @param start vma of the first instruction
+	 * @param end vma where disassembly stops
+	 * @param insns output instructions are appended here
+	 *
+	 * Return false if the range does not lie in a code section or
+	 * libopcodes reports an error.
+	 */
+	bool disassemble(bfd_vma start, bfd_vma end, std::vector<insn> & insns);
+
+	/// number of hex digits objdump uses to print a symbol address
+	unsigned int address_digits() const;
+
+	/// return the name of the symbol containing vma, and its offset
+	bool find_symbol(bfd_vma vma, std::string & name, bfd_vma & offset) const;
+
+	/// libopcodes state, opaque to avoid including dis-asm.h here
+	struct disasm_state;
+
+private:
+	/// return the code section containing vma, or NULL
+	asection * find_section(bfd_vma vma) const;
+
+	/// the image BFD and its symbols
+	bfd_info ibfd;
+
+	/// (vma, name) of code symbols sorted by vma
+	std::vector<std::pair<bfd_vma, std::string> > code_syms;
+
+	/// NULL if we can't disassemble this image
+	disasm_state * disasm;
+};
+
+#endif /* !OP_DISASSEMBLER_H */
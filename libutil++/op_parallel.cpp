@@ -0,0 +1,194 @@
+/**
+ * @file op_parallel.cpp
+ * Running independent tasks on several threads
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include "config.h"
+
+#include <unistd.h>
+
+#if HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <exception>
+
+#include "op_parallel.h"
+#include "op_exception.h"
+
+using namespace std;
+
+#if HAVE_LIBPTHREAD
+
+struct op_mutex::impl {
+	pthread_mutex_t mutex;
+};
+
+
+op_mutex::op_mutex()
+	: data(new impl)
+{
+	pthread_mutex_init(&data->mutex, 0);
+}
+
+
+op_mutex::~op_mutex()
+{
+	pthread_mutex_destroy(&data->mutex);
+	delete data;
+}
+
+
+void op_mutex::lock()
+{
+	pthread_mutex_lock(&data->mutex);
+}
+
+
+void op_mutex::unlock()
+{
+	pthread_mutex_unlock(&data->mutex);
+}
+
+#else
+
+struct op_mutex::impl {
+};
+
+
+op_mutex::op_mutex()
+	: data(0)
+{
+}
+
+
+op_mutex::~op_mutex()
+{
+}
+
+
+void op_mutex::lock()
+{
+}
+
+
+void op_mutex::unlock()
+{
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
+
+namespace {
+
+/// state shared by the threads of one parallel_for()
+struct work_queue {
+	work_queue(size_t n, parallel_task & t)
+		: nr(n), next(0), task(t), failed(false), fatal(false) {}
+
+	/// return false if there is nothing left to do
+	bool get(size_t & i) {
+		op_lock lock(mutex);
+		if (failed || next == nr)
+			return false;
+		i = next++;
+		return true;
+	}
+
+	/// record the first failure and stop handing out items
+	void fail(string const & msg, bool is_fatal) {
+		op_lock lock(mutex);
+		if (failed)
+			return;
+		failed = true;
+		fatal = is_fatal;
+		error = msg;
+	}
+
+	void run() {
+		size_t i;
+		while (get(i)) {
+			try {
+				task.run(i);
+			} catch (op_fatal_error const & e) {
+				fail(e.what(), true);
+			} catch (exception const & e) {
+				fail(e.what(), false);
+			} catch (...) {
+				fail("unknown exception", false);
+			}
+		}
+	}
+
+	size_t const nr;
+	size_t next;
+	parallel_task & task;
+	op_mutex mutex;
+	bool failed;
+	bool fatal;
+	string error;
+};
+
+
+#if HAVE_LIBPTHREAD
+extern "C" void * run_worker(void * queue)
+{
+	static_cast<work_queue *>(queue)->run();
+	return 0;
+}
+#endif
+
+} // anon namespace
+
+
+void parallel_for(size_t nr, parallel_task & task, size_t nr_threads)
+{
+	if (nr_threads > nr)
+		nr_threads = nr;
+
+	if (nr_threads <= 1) {
+		for (size_t i = 0; i < nr; ++i)
+			task.run(i);
+		return;
+	}
+
+	work_queue queue(nr, task);
+
+#if HAVE_LIBPTHREAD
+	// the caller's thread is one of the workers
+	vector<pthread_t> threads;
+	for (size_t i = 1; i < nr_threads; ++i) {
+		pthread_t thread;
+		if (pthread_create(&thread, 0, run_worker, &queue))
+			break;
+		threads.push_back(thread);
+	}
+#endif
+
+	queue.run();
+
+#if HAVE_LIBPTHREAD
+	for (size_t i = 0; i < threads.size(); ++i)
+		pthread_join(threads[i], 0);
+#endif
+
+	if (!queue.failed)
+		return;
+	if (queue.fatal)
+		throw op_fatal_error(queue.error);
+	throw op_runtime_error(queue.error);
+}
+
+
+size_t op_nr_cpus()
+{
+	long nr = sysconf(_SC_NPROCESSORS_ONLN);
+	return nr > 0 ? nr : 1;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file op_parallel.h
+ * Running independent tasks on several threads
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef OP_PARALLEL_H
+#define OP_PARALLEL_H
+
+#include <cstddef>
+
+#include "utility.h"
+
+/**
+ * A mutual exclusion lock. If oprofile is built without thread support
+ * locking is a no-op since parallel_for() then runs all tasks in the
+ * caller's thread.
+ */
+class op_mutex : noncopyable {
+public:
+	op_mutex();
+	~op_mutex();
+
+	void lock();
+	void unlock();
+
+private:
+	struct impl;
+	impl * data;
+};
+
+
+/// hold an op_mutex for the lifetime of this object
+class op_lock : noncopyable {
+public:
+	explicit op_lock(op_mutex & m) : mutex(m) { mutex.lock(); }
+	~op_lock() { mutex.unlock(); }
+
+private:
+	op_mutex & mutex;
+};
+
+
+/// the work done by parallel_for() for each item
+class parallel_task {
+public:
+	virtual ~parallel_task() {}
+
+	/// process the i-th item, may be called concurrently for other items
+	virtual void run(size_t i) = 0;
+};
+
+
+/**
+ * @param nr  the nr. of items
+ * @param task  called once for each item in [0, nr)
+ * @param nr_threads  maximum nr. of threads to use
+ *
+ * Items are handed out to the threads in increasing order. If run()
+ * throws, the remaining items are skipped and the first exception is
+ * rethrown in the caller as op_fatal_error or op_runtime_error. With
+ * nr_threads <= 1, or without thread support, all items are run in order
+ * in the caller's thread.
+ */
+void parallel_for(size_t nr, parallel_task & task, size_t nr_threads);
+
+/// the nr. of online processors, at least 1
+size_t op_nr_cpus();
+
+#endif /* !OP_PARALLEL_H */
@@ -10,6 +10,7 @@
  */
 
 #include <algorithm>
+#include <typeinfo>
 
 #include "string_filter.h"
 #include "string_manip.h"
@@ -47,3 +48,18 @@ bool string_filter::match(string const & str) const
 
 	return false;
 }
+
+
+string string_filter::signature() const
+{
+	string result = typeid(*this).name();
+
+	vector<string>::const_iterator cit;
+	for (cit = include.begin(); cit != include.end(); ++cit)
+		result += '\0' + *cit;
+	result += '\1';
+	for (cit = exclude.begin(); cit != exclude.end(); ++cit)
+		result += '\0' + *cit;
+
+	return result;
+}
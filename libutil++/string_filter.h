@@ -45,6 +45,12 @@ public:
 	/// Returns true if the given string matches
 	virtual bool match(std::string const & str) const;
 
+	/**
+	 * Return a string identifying the filter type and patterns, two
+	 * filters with the same signature match the same strings.
+	 */
+	std::string signature() const;
+
 protected:
 	/// include patterns
 	std::vector<std::string> include;
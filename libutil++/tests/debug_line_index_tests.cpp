@@ -0,0 +1,126 @@
+/**
+ * @file debug_line_index_tests.cpp
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "debug_line_index.h"
+#include "cverb.h"
+
+using namespace std;
+
+verbose vbfd("bfd");
+
+/// max. nr. of mismatches printed
+static size_t const max_errors = 10;
+
+/// the image tested, this test itself unless given on the command line
+static char const * image = "/proc/self/exe";
+
+
+static vector<asymbol *> read_symbols(bfd * abfd)
+{
+	vector<asymbol *> syms;
+	long const size = bfd_get_symtab_upper_bound(abfd);
+	if (size <= 0)
+		return syms;
+
+	syms.resize(size / sizeof(asymbol *) + 1);
+	long const nr = bfd_canonicalize_symtab(abfd, &syms[0]);
+	syms.resize(nr > 0 ? nr + 1 : 1);
+	syms[syms.size() - 1] = 0;
+	return syms;
+}
+
+
+/*
+ * Every address answered by the index with a line number must get the
+ * same file and line from bfd_find_nearest_line(), the index is only a
+ * faster way to get them.
+ */
+static void check_against_bfd(bfd * abfd, debug_line_index const & index)
+{
+	vector<asymbol *> syms = read_symbols(abfd);
+	size_t nr_checked = 0;
+	size_t nr_errors = 0;
+
+	for (asection * sect = abfd->sections; sect; sect = sect->next) {
+		if (!(bfd_get_section_flags(abfd, sect) & SEC_CODE))
+			continue;
+
+		bfd_vma const start = bfd_get_section_vma(abfd, sect);
+		bfd_size_type const size = bfd_section_size(abfd, sect);
+		for (bfd_vma pc = 0; pc < size; ++pc) {
+			string filename;
+			unsigned int linenr;
+			if (!index.find(start + pc, filename, linenr) || !linenr)
+				continue;
+
+			char const * bfd_filename = 0;
+			char const * function = 0;
+			unsigned int bfd_linenr = 0;
+			bool const found = bfd_find_nearest_line(abfd, sect,
+				syms.empty() ? 0 : &syms[0], pc,
+				&bfd_filename, &function, &bfd_linenr);
+
+			++nr_checked;
+			if (found && bfd_filename && filename == bfd_filename &&
+			    linenr == bfd_linenr)
+				continue;
+
+			if (++nr_errors <= max_errors) {
+				cerr << hex << "debug_line_index: at 0x"
+				     << start + pc << dec << " expect:\n\""
+				     << (bfd_filename ? bfd_filename : "")
+				     << ":" << bfd_linenr << "\"\nfound:\n\""
+				     << filename << ":" << linenr << "\"\n";
+			}
+		}
+	}
+
+	if (nr_errors) {
+		cerr << nr_errors << " of " << nr_checked
+		     << " lookups differ from bfd_find_nearest_line()" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nr_checked) {
+		cerr << "debug_line_index: no line found in " << image << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+int main(int argc, char * argv[])
+{
+	if (argc > 1)
+		image = argv[1];
+
+	bfd_init();
+	bfd * abfd = bfd_openr(image, 0);
+	if (!abfd || !bfd_check_format(abfd, bfd_object)) {
+		cerr << "debug_line_index: unable to open " << image << endl;
+		return EXIT_FAILURE;
+	}
+
+	debug_line_index const index(abfd);
+	if (!index.usable()) {
+		// built without debug information, nothing to compare
+		cerr << "debug_line_index: no line table in " << image
+		     << ", test skipped" << endl;
+	} else {
+		check_against_bfd(abfd, index);
+	}
+
+	bfd_close(abfd);
+	return EXIT_SUCCESS;
+}
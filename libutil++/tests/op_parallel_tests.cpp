@@ -0,0 +1,104 @@
+/**
+ * @file op_parallel_tests.cpp
+ * tests op_parallel.h
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "op_parallel.h"
+#include "op_exception.h"
+
+using namespace std;
+
+namespace {
+
+struct square_task : parallel_task {
+	square_task(size_t nr) : results(nr), sum(0) {}
+
+	void run(size_t i) {
+		results[i] = i * i;
+		op_lock lock(mutex);
+		sum += i;
+	}
+
+	vector<size_t> results;
+	size_t sum;
+	op_mutex mutex;
+};
+
+
+struct throwing_task : parallel_task {
+	void run(size_t i) {
+		if (i == 7)
+			throw op_fatal_error("item 7");
+	}
+};
+
+
+bool check_squares(size_t nr, size_t nr_threads)
+{
+	square_task task(nr);
+	parallel_for(nr, task, nr_threads);
+
+	for (size_t i = 0; i < nr; ++i) {
+		if (task.results[i] != i * i) {
+			cerr << "wrong result for item " << i << " with "
+			     << nr_threads << " threads\n";
+			return false;
+		}
+	}
+
+	if (task.sum != nr * (nr - 1) / 2) {
+		cerr << "wrong sum " << task.sum << " with "
+		     << nr_threads << " threads\n";
+		return false;
+	}
+
+	return true;
+}
+
+
+bool check_throw(size_t nr_threads)
+{
+	throwing_task task;
+	try {
+		parallel_for(100, task, nr_threads);
+	} catch (op_fatal_error const & e) {
+		return string(e.what()) == "item 7";
+	}
+	return false;
+}
+
+} // anon namespace
+
+
+int main()
+{
+	size_t const threads[] = { 0, 1, 2, 8, 200 };
+
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+		if (!check_squares(1000, threads[i]) ||
+		    !check_squares(1, threads[i]) ||
+		    !check_squares(0, threads[i]))
+			return EXIT_FAILURE;
+		if (!check_throw(threads[i])) {
+			cerr << "exception not forwarded with " << threads[i]
+			     << " threads\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (op_nr_cpus() < 1) {
+		cerr << "op_nr_cpus() returned 0\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
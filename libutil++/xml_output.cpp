@@ -80,3 +80,69 @@ string init_attr(tag_t attr, string const & str)
 	out << buf;
 	return out.str();
 }
+
+
+void open_element(ostream & out, tag_t tag, bool with_attrs)
+{
+	out << '<' << xml_tag_name(tag);
+	if (with_attrs)
+		out << ' ';
+	else
+		out << ">\n";
+}
+
+
+void close_element(ostream & out, tag_t tag, bool has_nested)
+{
+	if (tag == NONE)
+		out << (has_nested ? ">\n" : "/>\n");
+	else
+		out << "</" << xml_tag_name(tag) << ">\n";
+}
+
+
+void init_attr(ostream & out, tag_t attr, size_t value)
+{
+	// init_xml_int_attr() prints an int
+	out << ' ' << xml_tag_name(attr) << "=\"" << int(value) << '"';
+}
+
+
+void init_attr(ostream & out, tag_t attr, double value)
+{
+	char dbl[64];
+
+	dbl[0] = '\0';
+	init_xml_dbl_attr(attr, value, dbl, sizeof(dbl));
+	out << dbl;
+}
+
+
+void init_attr(ostream & out, tag_t attr, string const & str)
+{
+	out << ' ' << xml_tag_name(attr) << "=\"";
+
+	string::const_iterator it = str.begin();
+	string::const_iterator const end = str.end();
+	for (; it != end; ++it) {
+		switch (*it) {
+		case '&':
+			out << "&amp;";
+			break;
+		case '<':
+			out << "&lt;";
+			break;
+		case '>':
+			out << "&gt;";
+			break;
+		case '"':
+			out << "&quot;";
+			break;
+		default:
+			out << *it;
+			break;
+		}
+	}
+
+	out << '"';
+}
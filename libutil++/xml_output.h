@@ -10,6 +10,10 @@
 
 #ifndef XML_OUTPUT_H
 #define XML_OUTPUT_H
+
+#include <iosfwd>
+#include <string>
+
 #include "op_xml_out.h"
 
 std::string tag_name(tag_t tag);
@@ -19,4 +23,15 @@ std::string init_attr(tag_t attr, size_t value);
 std::string init_attr(tag_t attr, double value);
 std::string init_attr(tag_t attr, std::string const & str);
 
+/**
+ * The same as above but written straight to out, these don't allocate
+ * and are the ones to use for anything output once per symbol or sample.
+ */
+void open_element(std::ostream & out, tag_t tag, bool with_attrs = false);
+void close_element(std::ostream & out, tag_t tag = NONE,
+                   bool has_nested = false);
+void init_attr(std::ostream & out, tag_t attr, size_t value);
+void init_attr(std::ostream & out, tag_t attr, double value);
+void init_attr(std::ostream & out, tag_t attr, std::string const & str);
+
 #endif /* XML_OUTPUT_H */
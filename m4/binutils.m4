@@ -50,6 +50,35 @@ AC_LINK_IFELSE([AC_LANG_PROGRAM([[#include <bfd.h>]
 	])
 AC_DEFINE_UNQUOTED(SYNTHESIZE_SYMBOLS, $SYNTHESIZE_SYMBOLS, [Synthesize special symbols when needed])
 
+# libopcodes is optional, without it opannotate --assembly runs objdump
+HAVE_LIBOPCODES=0
+DISASSEMBLER_TAKES_ARCH=0
+INIT_DISASSEMBLE_INFO_STYLED=0
+OPCODES_LIB=""
+AC_CHECK_HEADERS(dis-asm.h)
+if test "$ac_cv_header_dis_asm_h" = "yes"; then
+	AC_CHECK_LIB(opcodes, disassemble_init_for_target,
+		HAVE_LIBOPCODES=1; OPCODES_LIB="-lopcodes",, [-lbfd $Z_LIB])
+fi
+if test "$HAVE_LIBOPCODES" = "1"; then
+	AC_MSG_CHECKING([whether disassembler() takes the architecture])
+	AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[#include <dis-asm.h>]],
+		[[disassembler_ftype f = disassembler(bfd_arch_unknown, 0, 0, 0);]])],
+		[AC_MSG_RESULT([yes])
+		DISASSEMBLER_TAKES_ARCH=1],
+		[AC_MSG_RESULT([no])])
+	AC_MSG_CHECKING([whether init_disassemble_info() takes a styled printer])
+	AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[#include <dis-asm.h>]],
+		[[struct disassemble_info info;
+		init_disassemble_info(&info, 0, 0, 0);]])],
+		[AC_MSG_RESULT([yes])
+		INIT_DISASSEMBLE_INFO_STYLED=1],
+		[AC_MSG_RESULT([no])])
+fi
+AC_DEFINE_UNQUOTED(HAVE_LIBOPCODES, $HAVE_LIBOPCODES, [Define to 1 if libopcodes can be used for disassembly])
+AC_DEFINE_UNQUOTED(DISASSEMBLER_TAKES_ARCH, $DISASSEMBLER_TAKES_ARCH, [Define to 1 if disassembler() takes arch, big endian, mach and bfd arguments])
+AC_DEFINE_UNQUOTED(INIT_DISASSEMBLE_INFO_STYLED, $INIT_DISASSEMBLE_INFO_STYLED, [Define to 1 if init_disassemble_info() takes a styled fprintf function])
+
 AC_LANG_POP(C)
 ]
 )
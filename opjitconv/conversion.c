@@ -15,19 +15,6 @@
 
 #include "opjitconv.h"
 
-static void free_jit_records(void)
-{
-	struct jitentry * entry, * next;
-
-	for (entry = jitentry_list; entry; entry = next) {
-		if (entry->sym_name_malloced)
-			free(entry->symbol_name);
-		next = entry->next;
-		free(entry);
-	}
-	jitentry_list = NULL;
-}
-
 static void free_jit_debug_line(void)
 {
 	struct jitentry_debug_line * entry, * next;
@@ -49,9 +36,8 @@ int op_jit_convert(struct op_jitdump_info * file_info, char const * elffile,
 	max_entry_count = 0;
 	syms = NULL;
 	cur_bfd = NULL;
-	jitentry_list = NULL;
 	jitentry_debug_line_list = NULL;
-	entries_symbols_ascending = entries_address_ascending = NULL;
+	entries_address_ascending = NULL;
 
 	if ((rc = parse_all(jitdump, jitdump + file_info->dmp_file_stat.st_size,
 	                    end_time)) == OP_JIT_CONV_FAIL)
@@ -62,8 +48,10 @@ int op_jit_convert(struct op_jitdump_info * file_info, char const * elffile,
 		goto out;
 
 	disambiguate_symbol_names();
-	if (!entry_count)
-		return OP_JIT_CONV_NO_JIT_RECS_IN_DUMPFILE;
+	if (!entry_count) {
+		rc = OP_JIT_CONV_NO_JIT_RECS_IN_DUMPFILE;
+		goto out;
+	}
 
 	if ((cur_bfd = open_elf(elffile)) == NULL) {
 		rc = OP_JIT_CONV_FAIL;
@@ -83,10 +71,8 @@ int op_jit_convert(struct op_jitdump_info * file_info, char const * elffile,
 	if (cur_bfd)
 		bfd_close(cur_bfd);
 	free(syms);
-	out: free_jit_records();
+	out: free_jitentries();
 	free_jit_debug_line();
-	free(entries_symbols_ascending);
-	free(entries_address_ascending);
 	return rc;
 }
 
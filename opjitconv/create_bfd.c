@@ -43,11 +43,11 @@ static int fill_symtab(void)
 	
 	syms = xmalloc(sizeof(asymbol *) * (entry_count+1));
 	syms[entry_count] = NULL;
-	assert(entries_address_ascending[0]->section);
+	assert(entries_address_ascending[0].section);
 	// Do this to silence Coverity
-	section = entries_address_ascending[0]->section;
+	section = entries_address_ascending[0].section;
 	for (i = 0; i < entry_count; i++) {
-		e = entries_address_ascending[i];
+		e = &entries_address_ascending[i];
 		if (e->section)
 			section = e->section;
 		s = bfd_make_empty_symbol(cur_bfd);
@@ -111,8 +111,8 @@ static int create_text_section(int start_idx, int end_idx)
 	char const * section_name;
 	int idx = start_idx;
 	unsigned long long vma_start =
-		entries_address_ascending[start_idx]->vma;
-	struct jitentry * ee = entries_address_ascending[end_idx];
+		entries_address_ascending[start_idx].vma;
+	struct jitentry * ee = &entries_address_ascending[end_idx];
 	unsigned long long vma_end = ee->vma + ee->code_size;
 	int size = vma_end - vma_start;
 
@@ -123,7 +123,7 @@ static int create_text_section(int start_idx, int end_idx)
 	section = create_section(cur_bfd, section_name, size, vma_start,
                SEC_ALLOC|SEC_LOAD|SEC_READONLY|SEC_CODE|SEC_HAS_CONTENTS);
 	if (section)
-		entries_address_ascending[start_idx]->section = section;
+		entries_address_ascending[start_idx].section = section;
 	else
 		rc = OP_JIT_CONV_FAIL;
 
@@ -150,12 +150,12 @@ static int fill_text_section_content(asection * section, int start_idx,
 {
 	int rc = OP_JIT_CONV_OK;
 	unsigned long long vma_start =
-		entries_address_ascending[start_idx]->vma;
+		entries_address_ascending[start_idx].vma;
 	struct jitentry const * e;
 	int i;
 
 	for (i = start_idx; i <= end_idx; i++) {
-		e = entries_address_ascending[i];
+		e = &entries_address_ascending[i];
 		verbprintf(debug, "section = %s, i = %i, code = %llx,"
 			   " vma = %llx, offset = %llx,"
 			   "size = %i, name = %s\n",
@@ -193,8 +193,8 @@ int partition_sections(void)
 	// i: start index of the section
 	i = 0;
 	for (j = 1; j < entry_count; j++) {
-		entry = entries_address_ascending[j];
-		pred = entries_address_ascending[j - 1];
+		entry = &entries_address_ascending[j];
+		pred = &entries_address_ascending[j - 1];
 		end_addr = pred->vma + pred->code_size;
 		// calculate gap between code, if it is more than one page
 		// create an additional section
@@ -227,8 +227,8 @@ int fill_sections(void)
 	verbprintf(debug, "opjitconv: fill_sections\n");
 	i = 0;
 	for (j = 1; j < entry_count; j++) {
-		if (entries_address_ascending[j]->section) {
-			section = entries_address_ascending[i]->section;
+		if (entries_address_ascending[j].section) {
+			section = entries_address_ascending[i].section;
 			rc = fill_text_section_content(section, i,
 						       j - 1);
 			if (rc == OP_JIT_CONV_FAIL)
@@ -238,7 +238,7 @@ int fill_sections(void)
 	}
 	// this holds always if we have at least one jitentry
 	if (i < entry_count) {
-		section = entries_address_ascending[i]->section;
+		section = entries_address_ascending[i].section;
 		rc = fill_text_section_content(section,
 					       i, entry_count - 1);
 	}
@@ -27,43 +27,68 @@
 #include <unistd.h>
 #include <limits.h>
 
-typedef int (*compare_symbol)(void const *, void const *);
+/* make room for at least nr entries in the entry array. The array grows
+ * geometrically so that adding n entries costs O(n) copies in total. */
+static void reserve_entries(u32 nr)
+{
+	u32 new_max = max_entry_count;
 
+	if (nr <= max_entry_count)
+		return;
 
-/* count the entries in the jitentry_list */
-static u32 count_entries(void)
-{
-	struct jitentry const * entry;
-	u32 cnt = 0;
-	for (entry = jitentry_list; entry; entry = entry->next)
-		cnt++;
-	return cnt;
+	while (new_max < nr) {
+		if (new_max < 64)
+			new_max = 64;
+		else if (new_max <= UINT32_MAX / 2)
+			new_max *= 2;
+		else
+			new_max = UINT32_MAX;
+	}
+	if ((unsigned long long)new_max * sizeof(struct jitentry) > SIZE_MAX) {
+		fprintf(stderr, "Amount of JIT dump file entries is too large.\n");
+		exit(EXIT_FAILURE);
+	}
+	entries_address_ascending =
+		xrealloc(entries_address_ascending,
+			 sizeof(struct jitentry) * new_max);
+	max_entry_count = new_max;
 }
 
 
-static void fill_entry_array(struct jitentry * entries[])
+/* return a new, zeroed entry at the end of the entry array. Any pointer
+ * into the array is invalidated. */
+struct jitentry * new_jitentry(void)
 {
-	int i = 0;
 	struct jitentry * entry;
-	for (entry = jitentry_list; entry; entry = entry->next)
-		entries[i++] = entry;
+
+	if (entry_count == UINT32_MAX) {
+		fprintf(stderr, "Amount of JIT dump file entries is too large.\n");
+		exit(EXIT_FAILURE);
+	}
+	reserve_entries(entry_count + 1);
+	entry = &entries_address_ascending[entry_count++];
+	memset(entry, 0, sizeof(struct jitentry));
+	return entry;
 }
 
 
-/* create an array pointing to the jitentry structures which is sorted
- * according to the comparator rule given by parameter compar
- */
-static struct jitentry ** create_sorted_array(compare_symbol compare)
+/* free the entry array and the symbol names allocated for it */
+void free_jitentries(void)
 {
-	struct jitentry ** array =
-		xmalloc(sizeof(struct jitentry *) * entry_count);
-	fill_entry_array(array);
-	qsort(array, entry_count, sizeof(struct jitentry *), compare);
-	return array;
+	u32 i;
+
+	for (i = 0; i < entry_count; i++) {
+		if (entries_address_ascending[i].sym_name_malloced)
+			free(entries_address_ascending[i].symbol_name);
+	}
+	free(entries_address_ascending);
+	entries_address_ascending = NULL;
+	entry_count = max_entry_count = 0;
 }
 
 
-/* comparator method for qsort which sorts jitentries by symbol_name */
+/* comparator method for qsort which sorts pointers to jitentries by
+ * symbol_name */
 static int cmp_symbolname(void const * a, void const * b)
 {
 	struct jitentry * a0 = *(struct jitentry **) a;
@@ -75,8 +100,8 @@ static int cmp_symbolname(void const * a, void const * b)
 /* comparator method for qsort which sorts jitentries by address */
 static int cmp_address(void const * a, void const * b)
 {
-	struct jitentry * a0 = *(struct jitentry **) a;
-	struct jitentry * b0 = *(struct jitentry **) b;
+	struct jitentry const * a0 = a;
+	struct jitentry const * b0 = b;
 	if (a0->vma < b0->vma)
 		return -1;
 	if (a0->vma == b0->vma)
@@ -85,68 +110,44 @@ static int cmp_address(void const * a, void const * b)
 }
 
 
-/* resort address_ascending array */
+/* resort the entry array, dropping the invalidated entries */
 static void resort_address(void)
 {
 	u32 i;
 
 	qsort(entries_address_ascending, entry_count,
-	      sizeof(struct jitentry *), cmp_address);
+	      sizeof(struct jitentry), cmp_address);
 
 	// lower entry_count if entries are invalidated
 	for (i = 0; i < entry_count; ++i) {
-		if (entries_address_ascending[i]->vma)
+		if (entries_address_ascending[i].vma)
 			break;
+		if (entries_address_ascending[i].sym_name_malloced)
+			free(entries_address_ascending[i].symbol_name);
 	}
 
 	if (i) {
 		entry_count -= i;
 		memmove(&entries_address_ascending[0],
 			&entries_address_ascending[i],
-			sizeof(struct jitentry *) * entry_count);
+			sizeof(struct jitentry) * entry_count);
 	}
 }
 
 
-/* Copy address_ascending array to entries_symbols_ascending and resort it.  */
-static void resort_symbol(void)
-{
-	memcpy(entries_symbols_ascending, entries_address_ascending,
-	       sizeof(struct jitentry *) * entry_count);
-	qsort(entries_symbols_ascending, entry_count,
-	      sizeof(struct jitentry *), cmp_symbolname);
-}
-
-/* allocate, populate and sort the jitentry arrays */
+/* sort the jitentry array by address */
 void create_arrays(void)
 {
-	max_entry_count = entry_count = count_entries();
-	entries_symbols_ascending = create_sorted_array(cmp_symbolname);
-	entries_address_ascending = create_sorted_array(cmp_address);
+	qsort(entries_address_ascending, entry_count,
+	      sizeof(struct jitentry), cmp_address);
 }
 
 
-/* add a new create jitentry to the array. mallocs new arrays if space is
- * needed */
-static void insert_entry(struct jitentry * entry)
+/* add a copy of a new created jitentry to the array. Any pointer into the
+ * array is invalidated. */
+static void insert_entry(struct jitentry const * entry)
 {
-	if (entry_count == max_entry_count) {
-		if (max_entry_count < UINT32_MAX - 18)
-			max_entry_count += 18;
-		else if (max_entry_count < UINT32_MAX)
-			max_entry_count += 1;
-		else {
-			fprintf(stderr, "Amount of JIT dump file entries is too large.\n");
-			exit(EXIT_FAILURE);
-		}
-		entries_symbols_ascending = (struct jitentry **)
-			xrealloc(entries_symbols_ascending,
-				 sizeof(struct jitentry *) * max_entry_count);
-		entries_address_ascending = (struct jitentry **)
-			xrealloc(entries_address_ascending,
-				 sizeof(struct jitentry *) * max_entry_count);
-	}
-	entries_address_ascending[entry_count++] = entry;
+	*new_jitentry() = *entry;
 }
 
 
@@ -190,16 +191,14 @@ static void invalidate_earlybirds(unsigned long long start_time)
 
 	flag = 0;
 	for (i = 0; i < entry_count; i++) {
-		a = entries_address_ascending[i];
+		a = &entries_address_ascending[i];
 		if (a->life_end < start_time) {
 			invalidate_entry(a);
 			flag = 1;
 		}
 	}
-	if (flag) {
+	if (flag)
 		resort_address();
-		resort_symbol();
-	}
 }
 
 
@@ -213,7 +212,7 @@ static int select_one(int start_idx, int end_idx)
 	struct jitentry const * e;
 
 	for (i = start_idx; i <= end_idx; i++) {
-		e = entries_address_ascending[i];
+		e = &entries_address_ascending[i];
 		x = e->life_end - e->life_start;
 		if (candidate == -1 || x > lifetime) {
 			candidate = i;
@@ -240,8 +239,10 @@ static int select_one(int start_idx, int end_idx)
  *
  * However, both parts may or may not exist.
  */
-static void split_entry(struct jitentry * split, struct jitentry const * keep)
+static void split_entry(int split_idx, int keep_idx)
 {
+	struct jitentry * split = &entries_address_ascending[split_idx];
+	struct jitentry const * keep = &entries_address_ascending[keep_idx];
 	unsigned long long start_addr_keep = keep->vma;
 	unsigned long long end_addr_keep = keep->vma + keep->code_size;
 	unsigned long long end_addr_split = split->vma + split->code_size;
@@ -249,9 +250,11 @@ static void split_entry(struct jitentry * split, struct jitentry const * keep)
 
 	// do we need a right part?
 	if (end_addr_split > end_addr_keep) {
-		struct jitentry * new_entry =
-			xcalloc(1, sizeof(struct jitentry));
+		struct jitentry right;
+		struct jitentry * new_entry = &right;
 		char * s = NULL;
+
+		memset(new_entry, 0, sizeof(right));
 		
 		/* Check for max. length to avoid possible integer overflow. */
 		if (strlen(split->symbol_name) > SIZE_MAX - 3) {
@@ -277,6 +280,8 @@ static void split_entry(struct jitentry * split, struct jitentry const * keep)
 			   new_entry->vma,
 			   new_entry->vma + new_entry->code_size);
 		insert_entry(new_entry);
+		// the array may have moved
+		split = &entries_address_ascending[split_idx];
 	}
 	// do we need a left part?
 	if (start_addr_split < start_addr_keep) {
@@ -316,7 +321,7 @@ static unsigned long long eliminate_overlaps(int start_idx, int end_idx,
 					 int keep_idx)
 {
 	unsigned long long retval;
-	struct jitentry const * keep = entries_address_ascending[keep_idx];
+	struct jitentry const * keep = &entries_address_ascending[keep_idx];
 	struct jitentry * e;
 	unsigned long long start_addr_keep = keep->vma;
 	unsigned long long end_addr_keep = keep->vma + keep->code_size;
@@ -328,7 +333,7 @@ static unsigned long long eliminate_overlaps(int start_idx, int end_idx,
 	for (i = start_idx; i <= end_idx; i++) {
 		if (i == keep_idx)
 			continue;
-		e = entries_address_ascending[i];
+		e = &entries_address_ascending[i];
 		start_addr_entry = e->vma;
 		end_addr_entry = e->vma + e->code_size;
 		if (debug) {
@@ -353,7 +358,7 @@ static unsigned long long eliminate_overlaps(int start_idx, int end_idx,
 				min_start = e->life_start;
 			if (e->life_end > max_end)
 				max_end = e->life_end;
-			split_entry(e, keep);
+			split_entry(i, keep_idx);
 		}
 	}
 	retval = max_end - min_start;
@@ -379,7 +384,7 @@ static int handle_overlap_region(int start_idx, int end_idx)
 
 	if (debug) {
 		for (i = start_idx; i <= end_idx; i++) {
-			e = entries_address_ascending[i];
+			e = &entries_address_ascending[i];
 			verbprintf(debug, "overlap idx=%i, name=%s, "
 				   "start=%llx, end=%llx, life_start=%lli, "
 				   "life_end=%lli, lifetime=%lli\n",
@@ -399,7 +404,7 @@ static int handle_overlap_region(int start_idx, int end_idx)
 		rc = OP_JIT_CONV_FAIL;
 		goto out;
 	}
-	e = entries_address_ascending[idx];
+	e = &entries_address_ascending[idx];
 	pct = (totaltime == 0) ? 100 : (e->life_end - e->life_start) * 100 / totaltime;
 
 	cnt = 1;
@@ -470,11 +475,11 @@ static int scan_overlaps(void)
 		 * sym3 would not overlap with sym1. Therefore handle_overlap_regio() would
 		 * only be called for sym1 up to sym2.
 		 */
-		a = entries_address_ascending[j - 1];
+		a = &entries_address_ascending[j - 1];
 		end_addr2 = a->vma + a->code_size;
 		if (end_addr2 > end_addr)
 			end_addr = end_addr2;
-		a = entries_address_ascending[j];
+		a = &entries_address_ascending[j];
 		if (end_addr <= a->vma) {
 			if (i != j - 1) {
 				if (handle_overlap_region(i, j - 1) ==
@@ -514,17 +519,14 @@ int resolve_overlaps(unsigned long long start_time)
 		}
 		cnt++;
 	}
-	if (cnt > 0 && rc != OP_JIT_CONV_FAIL)
-		resort_symbol();
 	return rc;
 }
 
 
-/*
- * scan through the sorted array and replace identical symbol names by unique
- * ones by adding a counter value.
- */
-void disambiguate_symbol_names(void)
+/* replace identical symbol names in the array of pointers to entries,
+ * sorted by name, by unique ones by adding a counter value. Return the
+ * nr. of names replaced. */
+static int disambiguate_sorted_names(struct jitentry * entries[])
 {
 	u32 j;
 	int cnt, rep_cnt;
@@ -533,10 +535,10 @@ void disambiguate_symbol_names(void)
 
 	rep_cnt = 0;
 	for (j = 1; j < entry_count; j++) {
-		a = entries_symbols_ascending[j - 1];
+		a = entries[j - 1];
 		cnt = 1;
 		do {
-			b = entries_symbols_ascending[j];
+			b = entries[j];
 			if (strcmp(a->symbol_name, b->symbol_name) == 0) {
 				if (b->sym_name_malloced)
 					free(b->symbol_name);
@@ -551,10 +553,32 @@ void disambiguate_symbol_names(void)
 			}
 		} while (j < entry_count);
 	}
-	/* recurse to avoid that the added suffix also creates a collision */
-	if (rep_cnt) {
-		qsort(entries_symbols_ascending, entry_count,
-		      sizeof(struct jitentry *), cmp_symbolname);
-		disambiguate_symbol_names();
-	}
+	return rep_cnt;
+}
+
+
+/*
+ * sort the entries by symbol name and replace identical symbol names by
+ * unique ones by adding a counter value. The pointers into the entry array
+ * are sorted rather than the entries, which stay sorted by address.
+ */
+void disambiguate_symbol_names(void)
+{
+	struct jitentry ** entries;
+	u32 i;
+
+	if (!entry_count)
+		return;
+
+	entries = xmalloc(sizeof(struct jitentry *) * entry_count);
+	for (i = 0; i < entry_count; i++)
+		entries[i] = &entries_address_ascending[i];
+
+	/* repeat to avoid that the added suffix also creates a collision */
+	do {
+		qsort(entries, entry_count, sizeof(struct jitentry *),
+		      cmp_symbolname);
+	} while (disambiguate_sorted_names(entries));
+
+	free(entries);
 }
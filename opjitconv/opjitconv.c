@@ -14,6 +14,9 @@
  *
  */
 
+/* need this for nftw() in <ftw.h> */
+#define _GNU_SOURCE
+
 #include "opjitconv.h"
 #include "opd_printf.h"
 #include "op_file.h"
@@ -22,6 +25,7 @@
 #include <getopt.h>
 #include <dirent.h>
 #include <fnmatch.h>
+#include <ftw.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -32,18 +36,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/types.h>
+#include <signal.h>
 #include <unistd.h>
 #include <wait.h>
 #include <sys/file.h>
 
-/*
- * list head.  The linked list is used during parsing (parse_all) to
- * hold all jitentry elements. After parsing, the program works on the
- * array structures (entries_symbols_ascending, entries_address_ascending)
- * and the linked list is not used any more.
- */
-struct jitentry * jitentry_list = NULL;
+/* exit status of a conversion worker process for OP_JIT_CONV_FAIL */
+#define OP_JITCONV_WORKER_FAILED 255
+
 struct jitentry_debug_line * jitentry_debug_line_list = NULL;
 
 /* Global variable for asymbols so we can free the storage later. */
@@ -62,14 +64,12 @@ char sys_cmd_buffer[PATH_MAX + 1];
 /* the bfd handle of the ELF file we write */
 bfd * cur_bfd;
 
-/* count of jitentries in the list */
+/* count of jitentries in the array */
 u32 entry_count;
-/* maximul space in the entry arrays, needed to add entries */
+/* allocated size of the entry array */
 u32 max_entry_count;
-/* array pointing to all jit entries, sorted by symbol names */
-struct jitentry ** entries_symbols_ascending;
-/* array pointing to all jit entries sorted by address */
-struct jitentry ** entries_address_ascending;
+/* all jit entries, sorted by address after create_arrays() */
+struct jitentry * entries_address_ascending;
 
 /* debug flag, print some information */
 int debug;
@@ -79,6 +79,8 @@ int non_root;
 int delete_jitdumps;
 /* Session directory where sample data is stored */
 char * session_dir;
+/* in a conversion worker, the opjitconv process it must not outlive */
+static pid_t worker_parent;
 
 static struct option long_options [] = {
                                         { "session-dir", required_argument, NULL, 's'},
@@ -132,6 +134,31 @@ static void delete_path_names_list(struct list_head * list)
 	}
 }
 
+static int remove_tree_entry(char const * fpath,
+                             struct stat const * sb __attribute__((unused)),
+                             int tflag __attribute__((unused)),
+                             struct FTW * ftwbuf __attribute__((unused)))
+{
+	if (remove(fpath)) {
+		verbprintf(debug, "opjitconv: cannot remove %s: %s\n", fpath,
+			   strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Remove a directory with all its content, without following symbolic
+ * links. A directory that does not exist is not an error.
+ */
+static int remove_dir_tree(char const * path)
+{
+	errno = 0;
+	if (nftw(path, remove_tree_entry, 16, FTW_DEPTH | FTW_PHYS) &&
+	    errno != ENOENT)
+		return -1;
+	return 0;
+}
+
 static int mmap_jitdump(char const * dumpfile,
 	struct op_jitdump_info * file_info)
 {
@@ -164,6 +191,65 @@ out:
 	return rc;
 }
 
+/* Map the original dump file for conversion in place. The file is mapped
+ * under a shared lock, so the agent cannot be in the middle of writing a
+ * record meanwhile. If the agent has not closed the file yet, it may still
+ * append to it, so the mapping is dropped and OP_JIT_CONV_DUMPFILE_IN_USE
+ * is returned; the caller then converts a copy (see copy_dumpfile()).
+ */
+static int mmap_closed_jitdump(char const * dumpfile,
+			       struct op_jitdump_info * file_info)
+{
+#define OP_JITCONV_USECS_TO_WAIT 1000
+	unsigned int usecs_waited = 0;
+	int rc = OP_JIT_CONV_OK;
+	int dumpfd;
+
+	dumpfd = open(dumpfile, O_RDONLY);
+	if (dumpfd < 0) {
+		if (errno == ENOENT)
+			return OP_JIT_CONV_NO_DUMPFILE;
+		return OP_JIT_CONV_FAIL;
+	}
+again:
+	if (flock(dumpfd, LOCK_SH | LOCK_NB)) {
+		if (usecs_waited < OP_JITCONV_USECS_TO_WAIT) {
+			usleep(100);
+			usecs_waited += 100;
+			goto again;
+		}
+		rc = OP_JIT_CONV_DUMPFILE_IN_USE;
+		goto out;
+	}
+	if (fstat(dumpfd, &file_info->dmp_file_stat) < 0) {
+		perror("opjitconv:fstat on dumpfile");
+		rc = OP_JIT_CONV_FAIL;
+		goto unlock;
+	}
+	if (file_info->dmp_file_stat.st_size == 0) {
+		rc = OP_JIT_CONV_DUMPFILE_IN_USE;
+		goto unlock;
+	}
+	file_info->dmp_file = mmap(0, file_info->dmp_file_stat.st_size,
+				   PROT_READ, MAP_PRIVATE, dumpfd, 0);
+	if (file_info->dmp_file == MAP_FAILED) {
+		perror("opjitconv:mmap\n");
+		rc = OP_JIT_CONV_FAIL;
+		goto unlock;
+	}
+	if (!jitdump_is_closed(file_info->dmp_file, file_info->dmp_file +
+			       file_info->dmp_file_stat.st_size)) {
+		munmap(file_info->dmp_file, file_info->dmp_file_stat.st_size);
+		rc = OP_JIT_CONV_DUMPFILE_IN_USE;
+	}
+unlock:
+	flock(dumpfd, LOCK_UN);
+out:
+#undef OP_JITCONV_USECS_TO_WAIT
+	close(dumpfd);
+	return rc;
+}
+
 static char const * find_anon_dir_match(struct list_head * anon_dirs,
 					char const * proc_id)
 {
@@ -209,7 +295,8 @@ out:
 }
 
 /* Copies the given file to the temporary working directory and sets ownership
- * to 'oprofile:oprofile'.
+ * to 'oprofile:oprofile'. Only needed for dump files the agent may still
+ * write to, see mmap_closed_jitdump().
  */
 int copy_dumpfile(char const * dumpfile, char * tmp_dumpfile)
 {
@@ -293,6 +380,33 @@ out:
 	return rc;
 }
 
+/* Have a conversion worker killed when opjitconv ends, and end it now if
+ * opjitconv already has. The kernel forgets the death signal each time the
+ * effective user or group changes, so this is done again after each change.
+ */
+static void watch_worker_parent(void)
+{
+	if (!worker_parent)
+		return;
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	if (getppid() != worker_parent)
+		_exit(OP_JITCONV_WORKER_FAILED);
+}
+
+static int jitconv_setegid(gid_t gid)
+{
+	int rc = setegid(gid);
+	watch_worker_parent();
+	return rc;
+}
+
+static int jitconv_seteuid(uid_t uid)
+{
+	int rc = seteuid(uid);
+	watch_worker_parent();
+	return rc;
+}
+
 /* Look for an anonymous samples directory that matches the process ID
  * given by the passed JIT dmp_pathname.  If none is found, it's an error
  * since by agreement, all JIT dump files should be removed every time
@@ -315,7 +429,7 @@ static int process_jit_dumpfile(char const * dmp_pathname,
 	char * proc_id = NULL;
 	char const * anon_dir;
 	char const * dumpfilename = rindex(dmp_pathname, '/');
-	/* temporary copy of dump file created for conversion step */
+	/* temporary copy of dump file, if the agent is still writing it */
 	char * tmp_dumpfile;
 	/* temporary ELF file created during conversion step */
 	char * tmp_elffile;
@@ -377,10 +491,18 @@ chk_proc_id:
 		goto free_res1;
 	}
 	
-	if (copy_dumpfile(dmp_pathname, tmp_dumpfile) != OP_JIT_CONV_OK)
-		goto free_res1;
-	
-	if ((rc = mmap_jitdump(tmp_dumpfile, &dmp_info)) == OP_JIT_CONV_OK) {
+	rc = mmap_closed_jitdump(dmp_pathname, &dmp_info);
+	if (rc == OP_JIT_CONV_DUMPFILE_IN_USE) {
+		verbprintf(debug, "%s is still in use, converting a copy\n",
+			   dmp_pathname);
+		if (copy_dumpfile(dmp_pathname, tmp_dumpfile) != OP_JIT_CONV_OK) {
+			// skip this dump file, but go on with the others
+			rc = OP_JIT_CONV_OK;
+			goto free_res1;
+		}
+		rc = mmap_jitdump(tmp_dumpfile, &dmp_info);
+	}
+	if (rc == OP_JIT_CONV_OK) {
 		char * anon_path_seg = rindex(anon_dir, '/');
 		if (!anon_path_seg) {
 			printf("opjitconv: Bad path for anon sample: %s\n",
@@ -436,13 +558,13 @@ chk_proc_id:
 		verbprintf(debug, "Converting %s to %s\n", dmp_pathname,
 			   elf_file);
 		/* Set eGID of the special user 'oprofile'. */
-		if (!non_root && setegid(pw_oprofile->pw_gid) != 0) {
+		if (!non_root && jitconv_setegid(pw_oprofile->pw_gid) != 0) {
 			perror("opjitconv: setegid to special user failed");
 			rc = OP_JIT_CONV_FAIL;
 			goto free_res3;
 		}
 		/* Set eUID of the special user 'oprofile'. */
-		if (!non_root && seteuid(pw_oprofile->pw_uid) != 0) {
+		if (!non_root && jitconv_seteuid(pw_oprofile->pw_uid) != 0) {
 			perror("opjitconv: seteuid to special user failed");
 			rc = OP_JIT_CONV_FAIL;
 			goto free_res3;
@@ -453,13 +575,13 @@ chk_proc_id:
 			goto free_res3;
 
 		/* Set eUID back to the original user. */
-		if (!non_root && seteuid(getuid()) != 0) {
+		if (!non_root && jitconv_seteuid(getuid()) != 0) {
 			perror("opjitconv: seteuid to original user failed");
 			rc = OP_JIT_CONV_FAIL;
 			goto free_res3;
 		}
 		/* Set eGID back to the original user. */
-		if (!non_root && setegid(getgid()) != 0) {
+		if (!non_root && jitconv_setegid(getgid()) != 0) {
 			perror("opjitconv: setegid to original user failed");
 			rc = OP_JIT_CONV_FAIL;
 			goto free_res3;
@@ -583,12 +705,140 @@ static void _add_jitdumps_to_deletion_list(void * all_jitdumps, char const * jit
 	}
 }
 
+/* Convert one dump file in a temporary directory of its own, so that the
+ * conversions running in parallel never share files.
+ */
+static int convert_in_own_dir(char const * dmp_pathname, char const * dmp_name,
+			      struct list_head * anon_sample_dirs,
+			      unsigned long long start_time,
+			      unsigned long long end_time,
+			      char const * tmp_conv_dir)
+{
+	char dump_tmp_dir[PATH_MAX + 1];
+	int rc;
+
+	snprintf(dump_tmp_dir, sizeof(dump_tmp_dir), "%s/%s.d", tmp_conv_dir,
+		 dmp_name);
+	if (mkdir(dump_tmp_dir, S_IRWXU | S_IRWXG) ||
+	    change_owner(dump_tmp_dir) != 0) {
+		printf("opjitconv: Temporary working directory %s cannot be created.\n",
+		       dump_tmp_dir);
+		return OP_JIT_CONV_FAIL;
+	}
+	rc = process_jit_dumpfile(dmp_pathname, anon_sample_dirs, start_time,
+				  end_time, dump_tmp_dir);
+	// the whole tmp_conv_dir is removed at the end anyway
+	if (remove_dir_tree(dump_tmp_dir))
+		verbprintf(debug, "opjitconv: cannot remove %s\n", dump_tmp_dir);
+	return rc;
+}
+
+
+/* Wait for one conversion worker process to end and return its result. */
+static int wait_jitconv_worker(void)
+{
+	int status;
+	pid_t pid;
+
+	while ((pid = wait(&status)) < 0 && errno == EINTR)
+		;
+	if (pid < 0) {
+		perror("opjitconv: wait for conversion process failed");
+		return OP_JIT_CONV_FAIL;
+	}
+	if (!WIFEXITED(status) ||
+	    WEXITSTATUS(status) == OP_JITCONV_WORKER_FAILED)
+		return OP_JIT_CONV_FAIL;
+	return WEXITSTATUS(status);
+}
+
+
+/* Convert all dump files in jd_fnames. The conversion code keeps its state
+ * in global variables and changes the effective user ID, so each dump file
+ * is converted in a worker process of its own, with at most one worker per
+ * online processor. After a failed conversion no more workers are started.
+ * Returns OP_JIT_CONV_FAIL if any conversion failed, and the result of the
+ * last one to end otherwise.
+ */
+static int convert_jit_dumpfiles(struct list_head * jd_fnames,
+				 char const * jitdump_dir,
+				 struct list_head * anon_dnames,
+				 unsigned long long start_time,
+				 unsigned long long end_time,
+				 char const * tmp_conv_dir)
+{
+	struct list_head * pos1, * pos2;
+	char jitdumpfile[PATH_MAX + 1];
+	long max_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	long nr_workers = 0;
+	int failed = 0;
+	int rc = OP_JIT_CONV_OK;
+
+	if (max_workers < 1)
+		max_workers = 1;
+
+	/* get_matching_pathnames returns only filename segment when
+	 * NO_RECURSION is passed, so below, we add back the JIT
+	 * dump directory path to the name.
+	 */
+	list_for_each_safe(pos1, pos2, jd_fnames) {
+		struct pathname * dmpfile =
+			list_entry(pos1, struct pathname, neighbor);
+		pid_t pid, parent;
+
+		for (; nr_workers >= max_workers; nr_workers--) {
+			if ((rc = wait_jitconv_worker()) == OP_JIT_CONV_FAIL)
+				failed = 1;
+		}
+		if (failed)
+			break;
+
+		strncpy(jitdumpfile, jitdump_dir, PATH_MAX);
+		strncat(jitdumpfile, dmpfile->name, PATH_MAX);
+		// don't let the workers inherit pending output
+		fflush(stdout);
+		parent = getpid();
+		pid = fork();
+		if (pid == 0) {
+			// a worker is of no use once opjitconv is killed
+			worker_parent = parent;
+			watch_worker_parent();
+			rc = convert_in_own_dir(jitdumpfile, dmpfile->name,
+						anon_dnames, start_time,
+						end_time, tmp_conv_dir);
+			fflush(stdout);
+			_exit(rc == OP_JIT_CONV_FAIL ?
+			      OP_JITCONV_WORKER_FAILED : rc);
+		} else if (pid < 0) {
+			verbprintf(debug, "opjitconv: fork failed, converting %s "
+				   "in the main process\n", jitdumpfile);
+			rc = convert_in_own_dir(jitdumpfile, dmpfile->name,
+						anon_dnames, start_time,
+						end_time, tmp_conv_dir);
+			if (rc == OP_JIT_CONV_FAIL)
+				failed = 1;
+		} else {
+			nr_workers++;
+		}
+		delete_pathname(dmpfile);
+	}
+
+	for (; nr_workers > 0; nr_workers--) {
+		if ((rc = wait_jitconv_worker()) == OP_JIT_CONV_FAIL)
+			failed = 1;
+	}
+
+	if (failed) {
+		verbprintf(debug, "JIT convert error %d\n", OP_JIT_CONV_FAIL);
+		rc = OP_JIT_CONV_FAIL;
+	}
+	return rc;
+}
+
 static int op_process_jit_dumpfiles(char const * session_dir,
 	unsigned long long start_time, unsigned long long end_time)
 {
-	struct list_head * pos1, * pos2;
 	int rc = OP_JIT_CONV_OK;
-	char jitdumpfile[PATH_MAX + 1];
 	char oprofile_tmp_template[PATH_MAX + 1];
 	char const * jitdump_dir = "/tmp/.oprofile/jitdump/";
 
@@ -609,8 +859,7 @@ static int op_process_jit_dumpfiles(char const * session_dir,
 	/* Create a temporary working directory used for the conversion step.
 	 */
 	if (non_root) {
-		sprintf(sys_cmd_buffer, "/bin/rm -rf %s", oprofile_tmp_template);
-		if (system(sys_cmd_buffer) != 0) {
+		if (remove_dir_tree(oprofile_tmp_template)) {
 			printf("opjitconv: Removing temporary working directory %s failed.\n",
 			       oprofile_tmp_template);
 			rc = OP_JIT_CONV_TMPDIR_NOT_REMOVED;
@@ -698,31 +947,17 @@ static int op_process_jit_dumpfiles(char const * session_dir,
 	 */
 	filter_anon_samples_list(&anon_dnames);
 
-	/* get_matching_pathnames returns only filename segment when
-	 * NO_RECURSION is passed, so below, we add back the JIT
-	 * dump directory path to the name.
-	 */
-	list_for_each_safe(pos1, pos2, &jd_fnames) {
-		struct pathname * dmpfile =
-			list_entry(pos1, struct pathname, neighbor);
-		strncpy(jitdumpfile, jitdump_dir, PATH_MAX);
-		strncat(jitdumpfile, dmpfile->name, PATH_MAX);
-		rc = process_jit_dumpfile(jitdumpfile, &anon_dnames,
-					  start_time, end_time, tmp_conv_dir);
-		if (rc == OP_JIT_CONV_FAIL) {
-			verbprintf(debug, "JIT convert error %d\n", rc);
-			goto rm_tmp;
-		}
-		delete_pathname(dmpfile);
-	}
+	rc = convert_jit_dumpfiles(&jd_fnames, jitdump_dir, &anon_dnames,
+				   start_time, end_time, tmp_conv_dir);
+	if (rc == OP_JIT_CONV_FAIL)
+		goto rm_tmp;
 	delete_path_names_list(&anon_dnames);
 	
 rm_tmp:
 	/* Delete temporary working directory with all its files
 	 * (i.e. dump and ELF file).
 	 */
-	sprintf(sys_cmd_buffer, "/bin/rm -rf '%s'", tmp_conv_dir);
-	if (system(sys_cmd_buffer) != 0) {
+	if (remove_dir_tree(tmp_conv_dir)) {
 		printf("opjitconv: Removing temporary working directory failed.\n");
 		rc = OP_JIT_CONV_TMPDIR_NOT_REMOVED;
 	}
@@ -25,6 +25,7 @@
 #define OP_JIT_CONV_NO_JIT_RECS_IN_DUMPFILE 4
 #define OP_JIT_CONV_ALREADY_DONE 5
 #define OP_JIT_CONV_TMPDIR_NOT_REMOVED 6
+#define OP_JIT_CONV_DUMPFILE_IN_USE 7
 
 #include "config.h"
 #include <stddef.h>
@@ -39,8 +40,6 @@
  * the jit dump file gets mmapped and code and
  * symbol_name point directly into the file */
 struct jitentry {
-	/* linked list. see jitentry_list */
-	struct jitentry * next;
 	/* vma */
 	unsigned long long vma;
 	/* point to code in the memory mapped file */
@@ -90,6 +89,8 @@ struct jitdump_deletion_candidate
 };
 
 /* jitsymbol.c */
+struct jitentry * new_jitentry(void);
+void free_jitentries(void);
 void create_arrays(void);
 int resolve_overlaps(unsigned long long start_time);
 void disambiguate_symbol_names(void);
@@ -97,6 +98,7 @@ void disambiguate_symbol_names(void);
 /* parse_dump.c */
 int parse_all(void const * start, void const * end,
 	      unsigned long long end_time);
+int jitdump_is_closed(void const * start, void const * end);
 
 /* conversion.c */
 int op_jit_convert(struct op_jitdump_info *file_info, char const * elffile,
@@ -120,22 +122,17 @@ extern enum bfd_architecture dump_bfd_arch;
 extern int dump_bfd_mach;
 extern char const * dump_bfd_target_name;
 /*
- * list head.  The linked list is used during parsing (parse_all) to
- * hold all jitentry elements. After parsing, the program works on the
- * array structures (entries_symbols_ascending, entries_address_ascending)
- * and the linked list is not used any more.
+ * All jitentry elements, in one array allocated by new_jitentry(). They
+ * are in file order after parsing (parse_all), and sorted by address once
+ * create_arrays() has been called. Adding an entry may move the array.
  */
-extern struct jitentry * jitentry_list;
-/* count of jitentries in the list */
+extern struct jitentry * entries_address_ascending;
+/* count of jitentries in the array */
 extern u32 entry_count;
 /* list head for debug line information */
 extern struct jitentry_debug_line * jitentry_debug_line_list;
-/* maximum space in the entry arrays, needed to add entries */
+/* allocated size of the entry array */
 extern u32 max_entry_count;
-/* array pointing to all jit entries, sorted by symbol names */
-extern struct jitentry ** entries_symbols_ascending;
-/* array pointing to all jit entries sorted by address */
-extern struct jitentry ** entries_address_ascending;
 /* Global variable for asymbols so we can free the storage later. */
 extern asymbol ** syms;
 /* the bfd handle of the ELF file we write */
@@ -22,7 +22,7 @@
 #include <string.h>
 #include <stdio.h>
 
-/* parse a code load record and add the entry to the jitentry list */
+/* parse a code load record and add the entry to the jitentry array */
 static int parse_code_load(void const * ptr_arg, int size,
 			   unsigned long long end_time)
 {
@@ -34,10 +34,9 @@ static int parse_code_load(void const * ptr_arg, int size,
 	size_t padding_count, rec_totalsize;
 	end = rec->code_addr ? ptr + size : NULL;
 
-	entry = xcalloc(1, sizeof(struct jitentry));
+	entry = new_jitentry();
 
 	// jitentry constructor
-	entry->next = NULL;
 	ptr += sizeof(*rec);
 	/* symbol_name can be malloced so we cast away the constness. */
 	entry->symbol_name = (char *)ptr;
@@ -53,10 +52,6 @@ static int parse_code_load(void const * ptr_arg, int size,
 	// later
 	entry->life_end = end_time;
 
-	// build list
-	entry->next = jitentry_list;
-	jitentry_list = entry;
-
 	/* padding bytes are calculated over the complete record
 	 * (i.e. header + symbol name + code)
 	 */
@@ -87,6 +82,7 @@ static void parse_code_unload(void const * ptr, unsigned long long end_time)
 {
 	struct jr_code_unload const * rec = ptr;
 	struct jitentry * entry;
+	u32 i;
 
 	verbprintf(debug,"record1: vma=%llx, life_end=%lli\n",
 		   rec->vma, rec->timestamp);
@@ -97,7 +93,9 @@ static void parse_code_unload(void const * ptr, unsigned long long end_time)
 	 * it could be zero or not. Therefore it is only a sanity check at the moment.
 	 */
 	if (rec->timestamp > 0 && rec->vma != 0) {
-		for (entry = jitentry_list; entry; entry = entry->next) {
+		// the most recently loaded code first
+		for (i = entry_count; i-- > 0; ) {
+			entry = &entries_address_ascending[i];
 			if (entry->vma == rec->vma &&
 			    entry->life_end == end_time) {
 				entry->life_end = rec->timestamp;
@@ -130,7 +128,7 @@ static void parse_code_debug_info(void const * ptr, void const * end,
 }
 
 
-/* parse all entries in the jit dump file and build jitentry_list.
+/* parse all entries in the jit dump file and fill the jitentry array.
  * the code needs to check always whether there is enough
  * to read remaining. this is because the file may be written to
  * concurrently. */
@@ -245,3 +243,32 @@ int parse_all(void const * start, void const * end,
 	else
 		return OP_JIT_CONV_FAIL;
 }
+
+
+/* Check the record sequence of the memory mapped jitdump file without
+ * parsing the records. Returns 1 if the records fill the file exactly and
+ * the last one is the JIT_CODE_CLOSE record written by op_close_agent(),
+ * i.e. the agent will not write to the file anymore, and 0 otherwise.
+ */
+int jitdump_is_closed(void const * start, void const * end)
+{
+	struct jitheader const * header = start;
+	struct jr_prefix const * rec;
+	u32 last_id = JIT_CODE_LOAD;
+
+	if (start + sizeof(struct jitheader) >= end ||
+	    header->magic != JITHEADER_MAGIC ||
+	    start + header->totalsize > end)
+		return 0;
+
+	rec = start + header->totalsize;
+	while ((void *)rec + sizeof(struct jr_prefix) <= end) {
+		if (rec->total_size < sizeof(struct jr_prefix) ||
+		    (void *)rec + rec->total_size > end)
+			return 0;
+		last_id = rec->id;
+		rec = (void *)rec + rec->total_size;
+	}
+
+	return (void *)rec == end && last_id == JIT_CODE_CLOSE;
+}
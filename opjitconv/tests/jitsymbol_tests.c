@@ -0,0 +1,293 @@
+/**
+ * @file jitsymbol_tests.c
+ * Tests for the jitdump parsing and symbol handling of opjitconv
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "opjitconv.h"
+#include "jitdump.h"
+#include "op_libiberty.h"
+
+/* the globals normally defined in opjitconv.c */
+struct jitentry * entries_address_ascending;
+u32 entry_count;
+u32 max_entry_count;
+struct jitentry_debug_line * jitentry_debug_line_list;
+enum bfd_architecture dump_bfd_arch;
+int dump_bfd_mach;
+char const * dump_bfd_target_name;
+int debug;
+
+#define END_TIME 100
+#define CODE_SIZE 16
+
+static int nr_error;
+
+static int verbose = 0;
+
+#define test_verbprintf(args...) \
+	do { \
+		if (verbose) \
+			printf(args); \
+	} while (0)
+
+/* a jitdump file being built in memory */
+struct dump {
+	char * buf;
+	size_t size;
+	size_t max_size;
+};
+
+static double used_time(void)
+{
+	struct rusage  usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1E9 + 
+		((usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)) * 1000;
+}
+
+
+static void * append(struct dump * dump, size_t size)
+{
+	void * ptr;
+
+	if (dump->size + size > dump->max_size) {
+		dump->max_size = (dump->size + size) * 2;
+		dump->buf = xrealloc(dump->buf, dump->max_size);
+	}
+	ptr = dump->buf + dump->size;
+	memset(ptr, 0, size);
+	dump->size += size;
+	return ptr;
+}
+
+
+static void add_header(struct dump * dump)
+{
+	struct jitheader * header = append(dump, sizeof(*header) + 8);
+
+	header->magic = JITHEADER_MAGIC;
+	header->version = JITHEADER_VERSION;
+	header->totalsize = sizeof(*header) + 8;
+	strcpy(header->bfd_target, "elf64");
+}
+
+
+static void add_load(struct dump * dump, char const * name,
+		     unsigned long long vma, u32 code_size,
+		     unsigned long long timestamp)
+{
+	size_t size = sizeof(struct jr_code_load) + strlen(name) + 1 + code_size;
+	struct jr_code_load * rec;
+
+	size += PADDING_8ALIGNED(size);
+	rec = append(dump, size);
+	rec->id = JIT_CODE_LOAD;
+	rec->total_size = size;
+	rec->timestamp = timestamp;
+	rec->vma = vma;
+	rec->code_addr = vma;
+	rec->code_size = code_size;
+	strcpy((char *)(rec + 1), name);
+}
+
+
+static void add_unload(struct dump * dump, unsigned long long vma,
+		       unsigned long long timestamp)
+{
+	struct jr_code_unload * rec = append(dump, sizeof(*rec));
+
+	rec->id = JIT_CODE_UNLOAD;
+	rec->total_size = sizeof(*rec);
+	rec->timestamp = timestamp;
+	rec->vma = vma;
+}
+
+
+/* what op_jit_convert() does before creating the ELF file */
+static int convert(struct dump * dump, unsigned long long start_time)
+{
+	int rc;
+
+	entries_address_ascending = NULL;
+	entry_count = max_entry_count = 0;
+
+	rc = parse_all(dump->buf, dump->buf + dump->size, END_TIME);
+	if (rc == OP_JIT_CONV_FAIL)
+		return rc;
+	create_arrays();
+	rc = resolve_overlaps(start_time);
+	if (rc == OP_JIT_CONV_FAIL)
+		return rc;
+	disambiguate_symbol_names();
+	return OP_JIT_CONV_OK;
+}
+
+
+static void check_entry(u32 i, unsigned long long vma, int code_size,
+			char const * name)
+{
+	struct jitentry const * e;
+
+	if (i >= entry_count) {
+		fprintf(stderr, "missing entry %u (%s)\n", i, name);
+		++nr_error;
+		return;
+	}
+	e = &entries_address_ascending[i];
+	if (e->vma != vma || e->code_size != code_size ||
+	    (name && strcmp(e->symbol_name, name))) {
+		fprintf(stderr, "entry %u: got %llx %d %s, expected %llx %d %s\n",
+			i, e->vma, e->code_size, e->symbol_name,
+			vma, code_size, name ? name : "*");
+		++nr_error;
+	}
+}
+
+
+static void do_test(void)
+{
+	struct dump dump = { NULL, 0, 0 };
+
+	add_header(&dump);
+	add_load(&dump, "foo", 0x3000, 0x100, 3);
+	add_load(&dump, "bar", 0x2000, 0x100, 2);
+	// unloaded before the profiling started
+	add_load(&dump, "old", 0x4000, 0x10, 1);
+	add_unload(&dump, 0x4000, 2);
+	// overlaps with "small", which lives longer
+	add_load(&dump, "big", 0x5000, 0x300, 90);
+	add_load(&dump, "small", 0x5100, 0x10, 4);
+	add_load(&dump, "foo", 0x1000, 0x100, 6);
+
+	if (convert(&dump, 5) != OP_JIT_CONV_OK) {
+		fprintf(stderr, "conversion failed\n");
+		++nr_error;
+	} else {
+		if (entry_count != 6) {
+			fprintf(stderr, "%u entries, expected 6\n", entry_count);
+			++nr_error;
+		}
+		// which one of the two foo gets renamed is unspecified
+		check_entry(0, 0x1000, 0x100, NULL);
+		check_entry(1, 0x2000, 0x100, "bar");
+		check_entry(2, 0x3000, 0x100, NULL);
+		check_entry(3, 0x5000, 0x100, "big#0");
+		check_entry(4, 0x5100, 0x10, "small%100");
+		check_entry(5, 0x5110, 0x1f0, "big#1");
+		if (entry_count == 6 &&
+		    strcmp(entries_address_ascending[0].symbol_name, "foo~1") &&
+		    strcmp(entries_address_ascending[2].symbol_name, "foo~1")) {
+			fprintf(stderr, "duplicate symbol names not renamed\n");
+			++nr_error;
+		}
+	}
+
+	free_jitentries();
+	free(dump.buf);
+}
+
+
+/* an overlap split when the entry array is full, so adding the split part
+ * moves the array */
+static void do_grow_test(void)
+{
+	struct dump dump = { NULL, 0, 0 };
+	char name[64];
+	u32 i;
+
+	add_header(&dump);
+	add_load(&dump, "big", 0x5000, 0x300, 90);
+	add_load(&dump, "small", 0x5100, 0x10, 4);
+	for (i = 0; i < 62; ++i) {
+		snprintf(name, sizeof(name), "method_%u", i);
+		add_load(&dump, name, 0x10000 + i * 0x100, 0x10, 10);
+	}
+
+	if (convert(&dump, 5) != OP_JIT_CONV_OK) {
+		fprintf(stderr, "conversion failed\n");
+		++nr_error;
+	} else {
+		if (entry_count != 65) {
+			fprintf(stderr, "%u entries, expected 65\n", entry_count);
+			++nr_error;
+		}
+		check_entry(0, 0x5000, 0x100, "big#0");
+		check_entry(1, 0x5100, 0x10, "small%100");
+		check_entry(2, 0x5110, 0x1f0, "big#1");
+		check_entry(3, 0x10000, 0x10, "method_0");
+	}
+
+	free_jitentries();
+	free(dump.buf);
+}
+
+
+/* nr_item code load records, some of them overlapping or with the same name */
+static void speed_test(int nr_item)
+{
+	struct dump dump = { NULL, 0, 0 };
+	double begin, end;
+	char name[64];
+	int i;
+
+	add_header(&dump);
+	for (i = 0; i < nr_item; ++i) {
+		// visit the addresses out of order
+		unsigned long long vma = 0x10000000ULL +
+			(i * 7919ULL) % nr_item * 64;
+		snprintf(name, sizeof(name), "java.lang.Method_%d", i % (nr_item - nr_item / 100));
+		add_load(&dump, name, vma, i % 1000 ? CODE_SIZE : 96, i % END_TIME);
+	}
+
+	begin = used_time();
+	if (convert(&dump, 0) != OP_JIT_CONV_OK) {
+		fprintf(stderr, "conversion of %d entries failed\n", nr_item);
+		++nr_error;
+	}
+	end = used_time();
+
+	test_verbprintf("nr item: %d, elapsed: %f ns per item, %u entries\n",
+			nr_item, (end - begin) / nr_item, entry_count);
+
+	free_jitentries();
+	free(dump.buf);
+}
+
+
+static void do_speed_test(void)
+{
+	int i;
+
+	for (i = 10000; i <= 1000000; i *= 10)
+		speed_test(i);
+}
+
+
+int main(int argc, char * argv[])
+{
+	do_test();
+	do_grow_test();
+
+	if (argc > 1 && !strcmp(argv[1], "--speed")) {
+		verbose = 1;
+		do_speed_test();
+	}
+
+	if (nr_error)
+		printf("%d error occured\n", nr_error);
+
+	return nr_error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -22,15 +22,18 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
-#include <sys/time.h>
-#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/timerfd.h>
 
 #include "op_pe_utils.h"
 #include "ocount_counter.h"
+#include "ocount_output.h"
 #include "op_cpu_type.h"
 #include "op_cpufreq.h"
 #include "operf_event.h"
@@ -44,11 +47,8 @@ std::vector<operf_event_t> events;
 op_cpu cpu_type;
 
 #define OCOUNT_MSECS_PER_SEC 1000
-// Current implementation supports a display interval of 100 ms
-#define OCOUNT_DSP_INTVL_MSECS 100
-#define OCOUNT_DSP_INTVLS_PER_SEC (OCOUNT_MSECS_PER_SEC/OCOUNT_DSP_INTVL_MSECS)
-#define OCOUNT_NSECS_PER_MSEC 1000000
-#define OCOUNT_NSECS_PER_DSP_INTVL (OCOUNT_NSECS_PER_MSEC * OCOUNT_DSP_INTVL_MSECS)
+#define OCOUNT_NSECS_PER_MSEC 1000000ULL
+#define OCOUNT_NSECS_PER_SEC 1000000000ULL
 
 static char * app_name_SAVE = NULL;
 static char ** app_args = NULL;
@@ -56,6 +56,7 @@ static bool app_started;
 static bool startApp;
 static bool stop = false;
 static std::ofstream outfile;
+static int binary_fd = -1;
 static pid_t my_uid;
 static double cpu_speed;
 static ocount_record * orecord;
@@ -84,6 +85,7 @@ bool separate_cpu;
 bool separate_thread;
 set<string> evts;
 bool csv_output;
+bool binary_output;
 long display_interval;
 long num_intervals;
 }
@@ -107,6 +109,7 @@ struct option long_options [] =
  {"separate-cpu", no_argument, NULL, 'c'},
  {"separate-thread", no_argument, NULL, 't'},
  {"brief-format", no_argument, NULL, 'b'},
+ {"binary-format", no_argument, NULL, 'B'},
  {"time-interval", required_argument, NULL, 'i'},
  {"help", no_argument, NULL, 'h'},
  {"usage", no_argument, NULL, 'u'},
@@ -114,7 +117,7 @@ struct option long_options [] =
  {NULL, 9, NULL, 0}
 };
 
-const char * short_options = "VsC:p:r:e:f:ctbi:huv";
+const char * short_options = "VsC:p:r:e:f:ctbBi:huv";
 
 static void cleanup(void)
 {
@@ -123,6 +126,10 @@ static void cleanup(void)
 	events.clear();
 	if (!ocount_options::outfile.empty())
 		outfile.close();
+	if (binary_fd >= 0) {
+		close(binary_fd);
+		binary_fd = -1;
+	}
 }
 
 
@@ -302,11 +309,18 @@ bool start_counting(void)
 	return ret;
 }
 
-static void do_results(ostream & out)
+/* The timestamp is only used by --binary-format, the text formats print theirs
+ * before calling us.
+ */
+static void do_results(ostream & out, struct timespec const & timestamp)
 {
 	try {
-		orecord->output_results(out, ocount_options::separate_cpu | ocount_options::separate_thread,
-		                        ocount_options::csv_output);
+		if (ocount_options::binary_output)
+			orecord->output_binary_results(binary_fd, timestamp);
+		else
+			orecord->output_results(out, ocount_options::separate_cpu |
+			                        ocount_options::separate_thread,
+			                        ocount_options::csv_output);
 	} catch (const runtime_error & e) {
 		cerr << "Caught runtime error from ocount_record::output_results" << endl;
 		cerr << e.what() << endl;
@@ -315,6 +329,108 @@ static void do_results(ostream & out)
 	}
 }
 
+static u64 _timespec_to_ns(struct timespec const & ts)
+{
+	return ts.tv_sec * OCOUNT_NSECS_PER_SEC + ts.tv_nsec;
+}
+
+static struct timespec _ns_to_timespec(u64 ns)
+{
+	struct timespec ts;
+	ts.tv_sec = ns / OCOUNT_NSECS_PER_SEC;
+	ts.tv_nsec = ns % OCOUNT_NSECS_PER_SEC;
+	return ts;
+}
+
+/* Wakes ocount up for each display interval. The deadlines are absolute
+ * CLOCK_MONOTONIC times, one interval apart from when counting started, so
+ * the time spent reading and printing the counts doesn't make the intervals
+ * drift.
+ */
+class interval_timer {
+public:
+	interval_timer(long interval_msecs);
+	~interval_timer();
+	/* Wait for the end of the current interval, at most max_wait_msecs (-1 to
+	 * wait as long as needed). Returns false on timeout or when interrupted
+	 * by a signal.
+	 */
+	bool wait(int max_wait_msecs);
+	/* The wall clock time of the end of the last interval waited for. This
+	 * is derived from the monotonic deadline so it advances by exactly one
+	 * interval each time.
+	 */
+	struct timespec deadline(void) const;
+
+private:
+	int fd;
+	u64 interval_ns;
+	u64 start_realtime_ns;
+	u64 nr_intervals;
+};
+
+interval_timer::interval_timer(long interval_msecs)
+{
+	struct timespec start, start_realtime;
+	struct itimerspec its;
+
+	interval_ns = interval_msecs * OCOUNT_NSECS_PER_MSEC;
+	nr_intervals = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	clock_gettime(CLOCK_REALTIME, &start_realtime);
+	start_realtime_ns = _timespec_to_ns(start_realtime);
+
+	its.it_interval = _ns_to_timespec(interval_ns);
+	its.it_value = _ns_to_timespec(_timespec_to_ns(start) + interval_ns);
+	fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (fd < 0 || timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		perror("Internal error: ocount could not set up the interval timer");
+		cleanup();
+		exit(EXIT_FAILURE);
+	}
+	cverb << vdebug << "Display interval used: " << interval_msecs << "ms" << endl;
+}
+
+interval_timer::~interval_timer()
+{
+	close(fd);
+}
+
+bool interval_timer::wait(int max_wait_msecs)
+{
+	struct pollfd pfd;
+	u64 expirations;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, max_wait_msecs) <= 0)
+		return false;
+	if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return false;
+	/* If we were late, the counts printed for this interval cover the ones
+	 * we missed, but the following deadlines stay on schedule.
+	 */
+	if (expirations > 1)
+		cverb << vdebug << "Missed " << expirations - 1 << " display interval(s)" << endl;
+	nr_intervals += expirations;
+	return true;
+}
+
+struct timespec interval_timer::deadline(void) const
+{
+	return _ns_to_timespec(start_realtime_ns + nr_intervals * interval_ns);
+}
+
+static void _output_interval_results(ostream & out, struct timespec const & ts)
+{
+	if (!ocount_options::binary_output)
+		ocount_output_interval_start(out, runmode, ocount_options::csv_output,
+		                             _timespec_to_ns(ts),
+		                             ocount_options::display_interval);
+	do_results(out, ts);
+}
+
 end_code_t _get_waitpid_status(int waitpid_status, int wait_rc)
 {
 	end_code_t rc = ALL_OK;
@@ -354,85 +470,19 @@ end_code_t _wait_for_app(ostream & out)
 	cverb << vdebug << "going into waitpid on monitored app " << app_PID << endl;
 	if (ocount_options::display_interval) {
 		long number_intervals = ocount_options::num_intervals;
+		interval_timer timer(ocount_options::display_interval);
 		do {
-			struct timeval mytime;
-			unsigned int countdown, dsp_intvl_in_100ms_units = 0;
-			struct timespec ts_req;
-
-			/* The display_interval is in milliseconds; but at this time, we only allow
-			 * 100ms granularity. */
-			dsp_intvl_in_100ms_units = (int)round(((double)ocount_options::display_interval/
-					OCOUNT_DSP_INTVL_MSECS));
-			if (dsp_intvl_in_100ms_units == 0)
-				dsp_intvl_in_100ms_units = 1; // special case of rounding up; prevent 0 time interval
-			countdown = dsp_intvl_in_100ms_units;
-			cverb << vdebug << "Actual display interval used: " << dsp_intvl_in_100ms_units
-					<< "x100ms" << endl;
-			ts_req.tv_nsec = countdown * OCOUNT_NSECS_PER_DSP_INTVL;
-			ts_req.tv_sec = 0;
-			while (countdown) {
-				/* We want to avoid the scenario where, say, the user requests a
-				 * 10 second time interval and the app being counted ends
-				 * immediately after we call sleep().  If we called sleep() with
-				 * the full time interval, we'd be sleeping unnecessarily for
-				 * 10 seconds.  So, for any time interval of one second or longer,
-				 * we do a one second sleep(), wake up and check if the app is
-				 * still alive.
-				 */
-				if (countdown >= OCOUNT_DSP_INTVLS_PER_SEC) {
-					countdown -= OCOUNT_DSP_INTVLS_PER_SEC;
-					sleep(1);
-					if (countdown && (countdown < OCOUNT_DSP_INTVLS_PER_SEC)) {
-						/* The next time through the loop, we'll be taking the
-						 * 'else' leg of this if-statement -- i.e., we will have
-						 * finished the specified time interval, modulo
-						 * OCOUNT_DSP_INTVLS_PER_SEC. So we set sleep time
-						 * accordingly and force dsp_intvl_in_100ms_units to be
-						 * equal to the current countdown value so the "-=" op
-						 * below makes the countdown finally zero.
-						 */
-						ts_req.tv_nsec = countdown * OCOUNT_NSECS_PER_DSP_INTVL;
-						dsp_intvl_in_100ms_units  = countdown;
-					}
-
-				} else {
-					/* We don't bother keeping track of remaining time, since signals delivered
-					 * to this process will be rare (see nanosleep man page). The real time (in
-					 * the supported granularity of 100 ms) is printed out for each time interval,
-					 * so we leave it to the user to note any time gaps.
-					 */
-					(void)nanosleep(&ts_req, NULL);
-					countdown -= dsp_intvl_in_100ms_units;
-				}
-				if (countdown == 0) {
-					if (gettimeofday(&mytime, NULL) < 0) {
-						cleanup();
-						perror("gettimeofday");
-						exit(EXIT_FAILURE);
-					}
-					if (!ocount_options::csv_output)
-						out << endl << "Current time (seconds since epoch): ";
-					else
-						out << endl << "timestamp,";
-					if (dsp_intvl_in_100ms_units % OCOUNT_DSP_INTVLS_PER_SEC) {
-						int tenths_secs = (int)round(((double)mytime.tv_usec/100000));
-						if (tenths_secs == 10)
-							out << dec << mytime.tv_sec + 1 << "." << "0";
-						else
-							out << dec << mytime.tv_sec << "." << tenths_secs;
-					} else {
-						out << dec << mytime.tv_sec;
-					}
-					do_results(out);
-				}
-				wait_rc = waitpid(app_PID, &waitpid_status, WNOHANG);
-				if (wait_rc) {
-					rc = _get_waitpid_status(waitpid_status, wait_rc);
-					done = true;
-					countdown = 0;
-				}
-			}
-			if (--number_intervals == 0) {
+			/* Don't wait for the end of a long interval to notice the app has
+			 * ended; wake up at least once a second to check it.
+			 */
+			bool interval_done = timer.wait(OCOUNT_MSECS_PER_SEC);
+			if (interval_done)
+				_output_interval_results(out, timer.deadline());
+			wait_rc = waitpid(app_PID, &waitpid_status, WNOHANG);
+			if (wait_rc) {
+				rc = _get_waitpid_status(waitpid_status, wait_rc);
+				done = true;
+			} else if (interval_done && --number_intervals == 0) {
 				done = true;
 				kill(app_PID, SIGKILL);
 			}
@@ -466,6 +516,16 @@ static end_code_t _run(ostream & out)
 	if (startApp)
 		cverb << vdebug << "app " << app_PID << " is running" << endl;
 
+	if (ocount_options::binary_output) {
+		try {
+			orecord->output_binary_header(binary_fd, ocount_options::display_interval *
+			                              OCOUNT_NSECS_PER_MSEC);
+		} catch (const runtime_error & e) {
+			cerr << e.what() << endl;
+			return PERF_RECORD_ERROR;
+		}
+	}
+
 	set_signals_for_parent();
 	if (startApp) {
 		rc = _wait_for_app(out);
@@ -473,40 +533,18 @@ static end_code_t _run(ostream & out)
 		cout << "ocount: Press Ctl-c or 'kill -SIGINT " << getpid() << "' to stop counting" << endl;
 		if (ocount_options::display_interval) {
 			long number_intervals = ocount_options::num_intervals;
-			struct timeval mytime;
-			/* The display_interval is in milliseconds; but at this time, we only allow
-			 * 100ms granularity. */
-			struct timespec ts_req;
-			unsigned int dsp_intvl_in_100ms_units = (int)round(((double)ocount_options::display_interval/
-					OCOUNT_DSP_INTVL_MSECS));
-			if (dsp_intvl_in_100ms_units == 0)
-				dsp_intvl_in_100ms_units = 1; // special case of rounding up; prevent 0 time interval
-			cverb << vdebug << "Actual display interval used: " << dsp_intvl_in_100ms_units
-					<< "x100ms" << endl;
-			// 10 dsp_intvl_in_100ms_units is one second, so we set ts_req accordingly
-			ts_req.tv_sec = dsp_intvl_in_100ms_units/10;
-			ts_req.tv_nsec = (dsp_intvl_in_100ms_units % 10) * OCOUNT_NSECS_PER_DSP_INTVL;
+			interval_timer timer(ocount_options::display_interval);
 			while (!stop) {
-				(void)nanosleep(&ts_req, NULL);
-				if (gettimeofday(&mytime, NULL) < 0) {
-					cleanup();
-					perror("gettimeofday");
-					exit(EXIT_FAILURE);
-				}
-				if (!ocount_options::csv_output)
-					out << endl << "Current time (seconds since epoch): ";
-				else
-					out << endl << "t:";
-				if (dsp_intvl_in_100ms_units % OCOUNT_DSP_INTVLS_PER_SEC) {
-					int tenths_secs = (int)round(((double)mytime.tv_usec/100000));
-					if (tenths_secs == 10)
-						out << dec << mytime.tv_sec + 1 << "." << "0";
-					else
-						out << dec << mytime.tv_sec << "." << tenths_secs;
+				if (timer.wait(-1)) {
+					_output_interval_results(out, timer.deadline());
+				} else if (stop) {
+					// Ctrl-C: print the partial interval we were in
+					struct timespec now;
+					clock_gettime(CLOCK_REALTIME, &now);
+					_output_interval_results(out, now);
 				} else {
-					out << dec << mytime.tv_sec;
+					continue;
 				}
-				do_results(out);
 				if (--number_intervals == 0)
 					stop = true;
 			}
@@ -645,6 +683,9 @@ static int _process_ocount_and_app_args(int argc, char * const argv[])
 		case 'b':
 			ocount_options::csv_output = true;
 			break;
+		case 'B':
+			ocount_options::binary_output = true;
+			break;
 		case 'i':
 			_parse_time_interval();
 			break;
@@ -746,6 +787,17 @@ static void _validate_args(void)
 		__print_usage_and_exit(NULL);
 	}
 
+	if (ocount_options::binary_output) {
+		if (ocount_options::outfile.empty()) {
+			cerr << "The --binary-format option requires --output-file." << endl;
+			__print_usage_and_exit(NULL);
+		}
+		if (ocount_options::csv_output) {
+			cerr << "The --binary-format and --brief-format options are incompatible." << endl;
+			__print_usage_and_exit(NULL);
+		}
+	}
+
 	if (runmode == OP_CPULIST) {
 		int num_cpus = use_cpu_minus_one ? 1 : sysconf(_SC_NPROCESSORS_ONLN);
 		if (num_cpus < 1) {
@@ -886,7 +938,16 @@ int main(int argc, char * const argv[])
 		exit(1);
 	}
 
-	if (!ocount_options::outfile.empty()) {
+	if (ocount_options::binary_output) {
+		binary_fd = open(ocount_options::outfile.c_str(),
+		                 O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (binary_fd < 0) {
+			cerr << "Unable to open " << ocount_options::outfile << ": "
+			     << strerror(errno) << endl;
+			cleanup();
+			exit(EXIT_FAILURE);
+		}
+	} else if (!ocount_options::outfile.empty()) {
 		outfile.open(ocount_options::outfile.c_str());
 	}
 	ostream & out = !ocount_options::outfile.empty() ? outfile : cout;
@@ -916,8 +977,11 @@ int main(int argc, char * const argv[])
 	}
 	if (get_results)
 		// We don't do a final display of results if we've been doing it on an interval already.
-		if (!ocount_options::display_interval)
-			do_results(out);
+		if (!ocount_options::display_interval) {
+			struct timespec now;
+			clock_gettime(CLOCK_REALTIME, &now);
+			do_results(out, now);
+		}
 
 	cleanup();
 	return 0;
@@ -0,0 +1,208 @@
+/**
+ * @file ocount_binary.cpp
+ * Write and decode the ocount --binary-format output
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <sstream>
+#include <stdexcept>
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "ocount_binary.h"
+#include "ocount_output.h"
+
+using namespace std;
+
+#define NSECS_PER_MSEC 1000000ULL
+
+/* The counts are written straight from the ocount_accum_t array they are
+ * read into, so it must have the layout of an ocount_binary_count array. Each
+ * typedef below is an array of negative size, which does not compile, if not.
+ */
+#define OCOUNT_SAME_LAYOUT(a, b) ((a) == (b) ? 1 : -1)
+typedef char ocount_binary_size_check[
+	OCOUNT_SAME_LAYOUT(sizeof(ocount_accum_t), sizeof(struct ocount_binary_count))];
+typedef char ocount_binary_count_check[
+	OCOUNT_SAME_LAYOUT(offsetof(ocount_accum_t, count),
+	                   offsetof(struct ocount_binary_count, count))];
+typedef char ocount_binary_enabled_check[
+	OCOUNT_SAME_LAYOUT(offsetof(ocount_accum_t, enabled_time),
+	                   offsetof(struct ocount_binary_count, enabled_time))];
+typedef char ocount_binary_running_check[
+	OCOUNT_SAME_LAYOUT(offsetof(ocount_accum_t, running_time),
+	                   offsetof(struct ocount_binary_count, running_time))];
+
+namespace {
+
+void write_binary(int fd, struct iovec * iov, int nr_iov)
+{
+	ssize_t len = 0;
+	for (int i = 0; i < nr_iov; i++)
+		len += iov[i].iov_len;
+
+	errno = 0;
+	if (writev(fd, iov, nr_iov) != len) {
+		string err_msg = "Error writing the binary output: ";
+		err_msg += errno ? strerror(errno) : "short write";
+		throw runtime_error(err_msg);
+	}
+}
+
+void append_binary_string(string & buf, string const & str)
+{
+	u32 len = str.size();
+	buf.append((char const *)&len, sizeof(len));
+	buf += str;
+}
+
+bool read_binary(istream & in, void * buf, size_t len)
+{
+	in.read((char *)buf, len);
+	return (size_t)in.gcount() == len;
+}
+
+/* The nr. of bytes left to read in, no limit if in can't seek */
+u64 remaining_size(istream & in)
+{
+	streampos const pos = in.tellg();
+	if (pos < 0)
+		return ~0ULL;
+	in.seekg(0, ios::end);
+	streampos const end = in.tellg();
+	in.seekg(pos);
+	return end > pos ? (u64)(end - pos) : 0;
+}
+
+string read_binary_string(istream & in)
+{
+	u32 len;
+	if (!read_binary(in, &len, sizeof(len)))
+		throw runtime_error("truncated header");
+	// don't trust a corrupted length with an allocation
+	if (len > remaining_size(in))
+		throw runtime_error("truncated header");
+	string str(len, '\0');
+	if (len && !read_binary(in, &str[0], len))
+		throw runtime_error("truncated header");
+	return str;
+}
+
+/* Read the header and the schema into header and info */
+void read_binary_header(istream & in, struct ocount_binary_header & header,
+                        ocount_output_info & info)
+{
+	if (!read_binary(in, &header, sizeof(header)) ||
+	    memcmp(header.magic, OCOUNT_BINARY_MAGIC, sizeof(header.magic)))
+		throw runtime_error("not an ocount --binary-format file");
+	if (header.version != OCOUNT_BINARY_VERSION) {
+		ostringstream err;
+		err << "unsupported file version " << header.version;
+		throw runtime_error(err.str());
+	}
+
+	// each event name takes at least its length, and the app name follows
+	if ((u64)header.nr_events * sizeof(u32) + sizeof(u32) > remaining_size(in))
+		throw runtime_error("truncated header");
+	for (u32 i = 0; i < header.nr_events; i++)
+		info.event_labels.push_back(read_binary_string(in));
+	info.app_name = read_binary_string(in);
+	if ((u64)header.nr_elements * sizeof(int) > remaining_size(in))
+		throw runtime_error("truncated header");
+	info.elements.resize(header.nr_elements);
+	if (header.nr_elements &&
+	    !read_binary(in, &info.elements[0], header.nr_elements * sizeof(int)))
+		throw runtime_error("truncated header");
+
+	info.runmode = (enum op_runmode)header.runmode;
+	info.count_per_cpu = header.separation == OCOUNT_BINARY_CPU;
+	info.evt_name_col_size = header.name_col_size;
+	info.with_time_interval = header.interval_ns != 0;
+}
+
+} // anonymous namespace
+
+void ocount_write_binary_header(int fd, struct ocount_binary_header header,
+                                vector<string> const & event_labels,
+                                string const & app_name,
+                                vector<int> const & elements)
+{
+	memcpy(header.magic, OCOUNT_BINARY_MAGIC, sizeof(header.magic));
+	header.version = OCOUNT_BINARY_VERSION;
+	header.nr_events = event_labels.size();
+	header.nr_elements = elements.size();
+
+	string schema;
+	for (size_t event = 0; event < event_labels.size(); event++)
+		append_binary_string(schema, event_labels[event]);
+	append_binary_string(schema, app_name);
+	if (!elements.empty())
+		schema.append((char const *)&elements[0], elements.size() * sizeof(int));
+
+	struct iovec iov[2];
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = (void *)schema.data();
+	iov[1].iov_len = schema.size();
+	write_binary(fd, iov, 2);
+}
+
+void ocount_write_binary_record(int fd, u64 time_ns,
+                                vector<ocount_accum_t> const & counts)
+{
+	struct iovec iov[2];
+	iov[0].iov_base = &time_ns;
+	iov[0].iov_len = sizeof(time_ns);
+	iov[1].iov_base = counts.empty() ? NULL : (void *)&counts[0];
+	iov[1].iov_len = counts.size() * sizeof(ocount_accum_t);
+	write_binary(fd, iov, 2);
+}
+
+void ocount_decode_binary(istream & in, ostream & out, bool use_separation,
+                          bool short_format)
+{
+	struct ocount_binary_header header;
+	ocount_output_info info;
+	read_binary_header(in, header, info);
+
+	u64 const nr_counts = (u64)info.event_labels.size() * info.elements.size();
+	u64 const rest = remaining_size(in);
+	// a file without records is fine, else the first one must be there
+	if (rest >= sizeof(u64) &&
+	    nr_counts > (rest - sizeof(u64)) / sizeof(ocount_binary_count))
+		throw runtime_error("truncated record");
+	if (rest < sizeof(u64))
+		return;
+
+	vector<ocount_binary_count> record(nr_counts);
+	vector<u64> prev_counts(nr_counts);
+	vector<ocount_accum_t> counts(nr_counts);
+	u64 time_ns;
+
+	while (read_binary(in, &time_ns, sizeof(time_ns))) {
+		if (nr_counts && !read_binary(in, &record[0], nr_counts * sizeof(record[0])))
+			throw runtime_error("truncated record");
+
+		// With time intervals ocount prints the counts since the previous one
+		for (size_t i = 0; i < nr_counts; i++) {
+			counts[i].count = record[i].count - prev_counts[i];
+			counts[i].enabled_time = record[i].enabled_time;
+			counts[i].running_time = record[i].running_time;
+			if (info.with_time_interval)
+				prev_counts[i] = record[i].count;
+		}
+
+		if (info.with_time_interval)
+			ocount_output_interval_start(out, info.runmode, short_format, time_ns,
+			                             header.interval_ns / NSECS_PER_MSEC);
+		ocount_output_results(out, info, counts, use_separation, short_format,
+		                      time_ns - header.start_time);
+	}
+}
@@ -0,0 +1,86 @@
+/**
+ * @file ocount_binary.h
+ * Layout of the ocount --binary-format output
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef OCOUNT_BINARY_H_
+#define OCOUNT_BINARY_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "op_types.h"
+#include "ocount_counter.h"
+
+/*
+ * The file starts with a struct ocount_binary_header, followed by:
+ *   - nr_events event names, including their unit mask and mode qualifiers;
+ *   - the name of the counted app (empty unless runmode is OP_START_APP);
+ *   - nr_elements ints: the cpu numbers or task IDs counted.
+ * Each string is stored as a u32 length followed by its characters, without
+ * a terminating NUL.
+ *
+ * Then comes one record per interval (or a single record at the end of the
+ * run without --time-interval): a u64 time stamp, in nanoseconds since the
+ * epoch, followed by one struct ocount_binary_count per element per event,
+ * element major. The counts are the raw values read from the kernel, not the
+ * difference with the previous interval and not scaled.
+ *
+ * Everything is in the byte order of the machine that ran ocount.
+ */
+
+#define OCOUNT_BINARY_MAGIC "OCOUNTB"
+#define OCOUNT_BINARY_VERSION 1
+
+enum ocount_binary_separation {
+	OCOUNT_BINARY_CPU,
+	OCOUNT_BINARY_TASK
+};
+
+struct ocount_binary_header {
+	char magic[8];
+	u32 version;
+	u32 runmode;           /* an enum op_runmode */
+	u32 nr_events;
+	u32 nr_elements;       /* nr. of cpus or tasks counted */
+	u32 separation;        /* an enum ocount_binary_separation */
+	u32 name_col_size;     /* width of the event names in the text formats */
+	u64 interval_ns;       /* 0 without --time-interval */
+	u64 start_time;        /* nanoseconds since the epoch */
+};
+
+struct ocount_binary_count {
+	u64 count;
+	u64 enabled_time;
+	u64 running_time;
+};
+
+/* Write the header and the schema. The magic, version, nr_events and
+ * nr_elements fields of header are filled from the other arguments.
+ * Throws a runtime_error if the write fails.
+ */
+void ocount_write_binary_header(int fd, struct ocount_binary_header header,
+                                std::vector<std::string> const & event_labels,
+                                std::string const & app_name,
+                                std::vector<int> const & elements);
+
+/* Write the record of an interval ending at time_ns, with a single writev().
+ * Throws a runtime_error if the write fails.
+ */
+void ocount_write_binary_record(int fd, u64 time_ns,
+                                std::vector<ocount_accum_t> const & counts);
+
+/* Print the records of an ocount --binary-format file in ocount's text
+ * formats, see ocount_output_results(). Throws a runtime_error if the file is
+ * not a valid one.
+ */
+void ocount_decode_binary(std::istream & in, std::ostream & out,
+                          bool use_separation, bool short_format);
+
+#endif /* OCOUNT_BINARY_H_ */
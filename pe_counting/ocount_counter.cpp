@@ -17,23 +17,36 @@
 #include <dirent.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <signal.h>
 
+#include <algorithm>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 
 #include "ocount_counter.h"
+#include "ocount_binary.h"
+#include "ocount_output.h"
 #include "op_pe_utils.h"
 #include "operf_event.h"
+#include "op_cpu_type.h"
 #include "cverb.h"
 
 extern verbose vdebug;
 extern bool use_cpu_minus_one;
 extern char * app_name;
+extern op_cpu cpu_type;
 
 using namespace std;
 
+// File descriptors left free for ocount itself when counting more tasks
+#define OCOUNT_RESERVED_FDS 32
+// How long a new perf event group gets to be scheduled at least once
+#define OCOUNT_GROUP_PROBE_NS 20000000
+
 static string print_mask_modes(bool mode_specified,bool um_specified,
 			       int no_kernel, int no_user,
 			       string um_numeric_as_str, string umask_value)
@@ -64,38 +77,48 @@ static string print_mask_modes(bool mode_specified,bool um_specified,
 }
 
 ocount_counter::ocount_counter(operf_event_t & evt,  bool enable_on_exec,
-                               bool inherit)
+                               bool inherit, bool group_leader, bool grouped)
 {
 	memset(&attr, 0, sizeof(attr));
 	attr.size = sizeof(attr);
 	attr.type = PERF_TYPE_RAW;
 	attr.config = evt.evt_code;
 	attr.inherit = inherit ? 1 : 0;
-	attr.enable_on_exec = enable_on_exec ? 1 : 0;
+	// Group members are enabled and disabled along with their leader.
+	attr.enable_on_exec = (enable_on_exec && group_leader) ? 1 : 0;
 	attr.disabled  = attr.enable_on_exec;
 	attr.exclude_idle = 0;
 	attr.exclude_kernel = evt.no_kernel;
 	attr.exclude_user = evt.no_user;
 	attr.exclude_hv = evt.no_hv;
 	// This format allows us to tell user percent of time an event was scheduled
-	// when multiplexing has been done by the kernel.
+	// when multiplexing has been done by the kernel.  With PERF_FORMAT_GROUP,
+	// reading the group leader returns the counts of the whole group; older
+	// kernels leave the counts of inherited counters out of group reads.
 	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
-			    PERF_FORMAT_TOTAL_TIME_RUNNING;
+			    PERF_FORMAT_TOTAL_TIME_RUNNING | PERF_FORMAT_ID;
+	if (grouped)
+		attr.read_format |= PERF_FORMAT_GROUP;
 	event = evt;
 	fd = cpu = pid = -1;
+	id = 0ULL;
 }
 
 ocount_counter::~ocount_counter() {
 }
 
 #include <stdio.h>
-int ocount_counter::perf_event_open(pid_t _pid, int _cpu)
+int ocount_counter::perf_event_open(pid_t _pid, int _cpu, int group_fd, bool quiet)
 {
-	fd = op_perf_event_open(&attr, _pid, _cpu, -1, 0);
+	fd = op_perf_event_open(&attr, _pid, _cpu, group_fd, 0);
 	if (fd < 0) {
 		int ret = -1;
+		int saved_errno = errno;
 		cverb << vdebug << "perf_event_open failed: " << strerror(errno) << endl;
-		if (errno == EBUSY) {
+		errno = saved_errno;
+		if (quiet) {
+			return ret;
+		} else if (errno == EBUSY) {
 			cerr << "The performance monitoring hardware reports EBUSY. Is another profiling tool in use?" << endl
 			     << "On some architectures, tools such as oprofile and perf being used in system-wide "
 			     << "mode can cause this problem." << endl;
@@ -111,26 +134,75 @@ int ocount_counter::perf_event_open(pid_t _pid, int _cpu)
 	}
 	pid = _pid;
 	cpu = _cpu;
+#ifdef PERF_EVENT_IOC_ID
+	// Without it, the counts of a group are matched by position.
+	if (ioctl(fd, PERF_EVENT_IOC_ID, &id) < 0)
+		id = 0ULL;
+#endif
 
 	cverb << vdebug << "perf_event_open returning fd " << fd << endl;
 	return fd;
 }
 
-int ocount_counter::read_count_data(ocount_accum_t * count_data)
+void ocount_counter::close_counter(void)
 {
-	size_t len = 3 * sizeof(u64);
-	char * buf = (char *)count_data;
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+}
+
+int ocount_counter::read_group_data(ocount_counter const * members, size_t nr_members,
+                                    ocount_accum_t * count_data)
+{
+	ocount_accum_t not_counted = {0ULL, 0ULL, 0ULL};
+
+	if (fd < 0) {
+		fill(count_data, count_data + nr_members, not_counted);
+		return 0;
+	}
+
+	/* The PERF_FORMAT_GROUP layout is: nr, time_enabled, time_running,
+	 * followed by a { value, id } pair for each event of the group. Without
+	 * it, it is: value, time_enabled, time_running, id.
+	 */
+	bool grouped = attr.read_format & PERF_FORMAT_GROUP;
+	vector<u64> values(grouped ? 3 + 2 * nr_members : 4);
+	size_t len = values.size() * sizeof(u64);
+	char * buf = (char *)&values[0];
 
 	while (len) {
 		int ret = read(fd, buf, len);
 
 		if (ret <= 0)
-			return ret;
+			return -1;
 
 		len -= ret;
 		buf += ret;
 	}
 
+	if (!grouped) {
+		count_data[0].count = values[0];
+		count_data[0].enabled_time = values[1];
+		count_data[0].running_time = values[2];
+		return 0;
+	}
+
+	for (size_t i = 0; i < values[0] && i < nr_members; i++) {
+		u64 value = values[3 + 2 * i];
+		u64 value_id = values[4 + 2 * i];
+		size_t member = i;
+
+		for (size_t j = 0; value_id && j < nr_members; j++) {
+			if (members[j].id == value_id) {
+				member = j;
+				break;
+			}
+		}
+		count_data[member].count = value;
+		count_data[member].enabled_time = values[1];
+		count_data[member].running_time = values[2];
+	}
+
 	return 0;
 }
 
@@ -145,8 +217,26 @@ ocount_record::ocount_record(enum op_runmode _runmode, std::vector<operf_event_t
 	tasks_are_threads = false;
 	num_cpus = 0;
 	app_pid = -1;
+	count_per_cpu = false;
+	counting_start_ticks = 0ULL;
 	start_time = 0ULL;
 	total_bytes_recorded = 0;
+	for (size_t event = 0; event < evts.size(); event++) {
+		operf_event_t const & evt = evts[event];
+		event_labels.push_back(evt.name +
+		                       print_mask_modes(evt.mode_specified, evt.umask_specified,
+		                                        evt.no_kernel, evt.no_user,
+		                                        evt.um_numeric_val_as_str, evt.um_name));
+	}
+	// A group larger than the number of hardware counters would never be scheduled.
+	int nr_counters = op_get_nr_counters(cpu_type);
+	max_group_size = nr_counters > 0 ? nr_counters : 0;
+}
+
+ocount_record::~ocount_record()
+{
+	for (size_t i = 0; i < perfCounters.size(); i++)
+		perfCounters[i].close_counter();
 }
 
 bool ocount_record::start_counting_app_process(pid_t _pid)
@@ -194,7 +284,7 @@ bool ocount_record::start_counting_tasklist(std::vector<pid_t> _tasks, bool _are
 		}
 	}
 	setup();
-	if (tasks_to_count.empty()) {
+	if (elements.empty()) {
 		cerr << "No valid tasks to monitor -- quitting." << endl;
 		return false;
 	}
@@ -238,22 +328,18 @@ int ocount_record::do_counting_per_task(void)
 	string err_msg;
 	int rc = 0;
 
-	for (set<pid_t>::iterator it = tasks_to_count.begin(); it != tasks_to_count.end(); it++) {
-		pid_t the_pid = *it;
+	// The main thread of a process is also listed among its threads.
+	sort(tasks_to_count.begin(), tasks_to_count.end());
+	tasks_to_count.erase(unique(tasks_to_count.begin(), tasks_to_count.end()),
+	                     tasks_to_count.end());
+
+	for (size_t i = 0; i < tasks_to_count.size(); i++) {
+		pid_t the_pid = tasks_to_count[i];
 		bool inherit = are_tasks_processes();
 		cverb << vdebug << "calling perf_event_open for task " << the_pid << endl;
-		for (unsigned event = 0; event < evts.size(); event++) {
-			ocount_accum_t count_data = {0ULL, 0ULL, 0ULL};
-			accum_counts.push_back(count_data);
-			prev_accum_counts.push_back(0ULL);
-			ocount_counter op_ctr(ocount_counter(evts[event], false, inherit));
-			if ((rc = op_ctr.perf_event_open(the_pid, -1)) < 0) {
-				err_msg = "Internal Error.  Perf event setup failed.";
-				goto out;
-			} else {
-				rc = 0;
-			}
-			perfCounters.push_back(op_ctr);
+		if ((rc = add_counted_element(the_pid, -1, false, inherit)) < 0) {
+			err_msg = "Internal Error.  Perf event setup failed.";
+			goto out;
 		}
 	}
 out:
@@ -266,6 +352,7 @@ int ocount_record::do_counting_per_cpu(void)
 {
 	string err_msg;
 	int rc = 0;
+	vector<int> cpus_to_count;
 
 	/* We'll do this sanity check here, but we also do it at the front-end where user
 	 * args are being validated.  If we wait until we get here, the invalid CPU argument
@@ -282,28 +369,24 @@ int ocount_record::do_counting_per_cpu(void)
 				rc = -1;
 				goto out;
 			} else {
-				cpus_to_count.insert(specified_cpus[k]);
+				cpus_to_count.push_back(specified_cpus[k]);
 			}
 		}
+		sort(cpus_to_count.begin(), cpus_to_count.end());
+		cpus_to_count.erase(unique(cpus_to_count.begin(), cpus_to_count.end()),
+		                    cpus_to_count.end());
 	} else {
-		cpus_to_count = available_cpus;
+		cpus_to_count.assign(available_cpus.begin(), available_cpus.end());
 	}
 
-	for (set<pid_t>::iterator it = cpus_to_count.begin(); it != cpus_to_count.end(); it++) {
-		int the_cpu = *it;
+	count_per_cpu = true;
+	for (size_t i = 0; i < cpus_to_count.size(); i++) {
+		int the_cpu = cpus_to_count[i];
 		cverb << vdebug << "calling perf_event_open for cpu " << the_cpu << endl;
-		for (unsigned event = 0; event < evts.size(); event++) {
-			ocount_accum_t count_data = {0ULL, 0ULL, 0ULL};
-			accum_counts.push_back(count_data);
-			prev_accum_counts.push_back(0ULL);
-			ocount_counter op_ctr(ocount_counter(evts[event], false, true));
-			if ((rc = op_ctr.perf_event_open(-1, the_cpu)) < 0) {
-				err_msg = "Internal Error.  Perf event setup failed.";
-				goto out;
-			} else {
-				rc = 0;
-			}
-			perfCounters.push_back(op_ctr);
+		// inherit means nothing to a counter of all tasks on a cpu
+		if ((rc = add_counted_element(-1, the_cpu, false, false)) < 0) {
+			err_msg = "Internal Error.  Perf event setup failed.";
+			goto out;
 		}
 	}
 out:
@@ -312,6 +395,305 @@ out:
 	return rc;
 }
 
+/* Close and remove the counters from index first on, and the groups from
+ * index nr_groups on.
+ */
+void ocount_record::drop_counters(size_t first, size_t nr_groups)
+{
+	/* Closing the leader of a group that was partly opened also stops
+	 * it from counting on.
+	 */
+	for (size_t i = first; i < perfCounters.size(); i++)
+		perfCounters[i].close_counter();
+	perfCounters.erase(perfCounters.begin() + first, perfCounters.end());
+	group_leaders.resize(nr_groups);
+}
+
+/* Append a row to the counter matrix for one task or cpu. On failure, the matrix
+ * is left as it was.
+ */
+int ocount_record::add_counted_element(pid_t pid, int cpu, bool enable_on_exec, bool inherit,
+                                       bool quiet)
+{
+	size_t first = perfCounters.size();
+	size_t nr_groups = group_leaders.size();
+	int rc = open_counter_group(pid, cpu, enable_on_exec, inherit, quiet);
+
+	if (rc < 0) {
+		drop_counters(first, nr_groups);
+		return rc;
+	}
+
+	ocount_accum_t count_data = {0ULL, 0ULL, 0ULL};
+	elements.push_back(count_per_cpu ? cpu : pid);
+	counter_data.resize(perfCounters.size(), count_data);
+	prev_counts.resize(perfCounters.size(), 0ULL);
+	return 0;
+}
+
+/* Open the counters of all events for one task or cpu as perf event groups, the first
+ * counter of each group being its leader. If the kernel refuses a group as a whole,
+ * as it does when the group can't fit in the counters of the processor, the events
+ * are opened as counters of their own instead, for this and all later rows.
+ */
+int ocount_record::open_counter_group(pid_t pid, int cpu, bool enable_on_exec, bool inherit,
+                                      bool quiet)
+{
+	size_t first = perfCounters.size();
+	size_t nr_groups = group_leaders.size();
+	bool grouped = !inherit && max_group_size != 1 && evts.size() > 1;
+	int leader_fd = -1;
+	size_t group_size = 0;
+
+	for (unsigned event = 0; event < evts.size(); event++) {
+		if (!grouped || (max_group_size && group_size == max_group_size)) {
+			leader_fd = -1;
+			group_size = 0;
+		}
+		bool leader = leader_fd < 0;
+		ocount_counter op_ctr(ocount_counter(evts[event], enable_on_exec, inherit,
+		                                     leader, grouped));
+		int rc = op_ctr.perf_event_open(pid, cpu, leader_fd, quiet || !leader);
+		if (rc < 0 && !leader) {
+			if (errno == EINVAL || errno == ENOSPC) {
+				cverb << vdebug << "The kernel refused a group of " << group_size + 1
+				      << " events; counting the events separately" << endl;
+				drop_counters(first, nr_groups);
+				max_group_size = 1;
+				return open_counter_group(pid, cpu, enable_on_exec, inherit, quiet);
+			}
+			if (!quiet)
+				cerr << "perf_event_open failed with " << strerror(errno) << endl;
+		}
+		if (rc < 0)
+			return rc;
+		if (leader) {
+			leader_fd = rc;
+			group_leaders.push_back(perfCounters.size());
+		}
+		group_size++;
+		perfCounters.push_back(op_ctr);
+	}
+	return 0;
+}
+
+/* A group can be accepted by the kernel and yet never be scheduled, if another user,
+ * such as the NMI watchdog, holds one of the counters it needs. Its counters are
+ * reopened here as counters of their own, which the kernel multiplexes one by one.
+ * The group counted nothing so far, so no counts are lost.
+ */
+void ocount_record::split_group(size_t group)
+{
+	size_t first = group_leaders[group];
+	size_t end = group + 1 < group_leaders.size() ?
+		group_leaders[group + 1] : perfCounters.size();
+
+	cverb << vdebug << "The group of event " << perfCounters[first].get_event_name()
+	      << " was never scheduled; counting its events separately" << endl;
+	for (size_t i = first; i < end; i++) {
+		pid_t pid = perfCounters[i].get_pid();
+		int cpu = perfCounters[i].get_cpu();
+
+		perfCounters[i].close_counter();
+		// Grouped counters are never inherited.
+		ocount_counter op_ctr(evts[i % evts.size()], false, false, true, false);
+		// On failure, most likely because the task exited, the counter stays closed.
+		op_ctr.perf_event_open(pid, cpu, -1, true);
+		perfCounters[i] = op_ctr;
+	}
+	group_leaders.insert(group_leaders.begin() + group + 1, end - first - 1, 0);
+	for (size_t i = first + 1; i < end; i++)
+		group_leaders[group + i - first] = i;
+}
+
+/* Read the counts of all counters into counter_data, with one read() per group. */
+void ocount_record::read_counters(void)
+{
+	for (size_t group = 0; group < group_leaders.size(); group++) {
+		size_t first = group_leaders[group];
+		size_t end = group + 1 < group_leaders.size() ?
+			group_leaders[group + 1] : perfCounters.size();
+		errno = 0;
+		cverb << vdebug << "Reading counter data for the group of event "
+		      << perfCounters[first].get_event_name() << endl;
+		if (perfCounters[first].read_group_data(&perfCounters[first], end - first,
+		                                        &counter_data[first]) < 0) {
+			string err_msg = "Internal error: read of perfCounter fd failed with ";
+			err_msg += errno ? strerror(errno) : "unknown error";
+			throw runtime_error(err_msg);
+		}
+	}
+
+	// Backwards, so that splitting a group leaves the index of the others alone.
+	for (size_t group = group_leaders.size(); group-- > 0; ) {
+		size_t first = group_leaders[group];
+		size_t end = group + 1 < group_leaders.size() ?
+			group_leaders[group + 1] : perfCounters.size();
+		if (end - first > 1 && counter_data[first].enabled_time &&
+		    !counter_data[first].running_time)
+			split_group(group);
+	}
+}
+
+/* The time since boot in clock ticks, the unit of the start time of tasks in
+ * /proc/<pid>/stat.
+ */
+static unsigned long long _boot_ticks_now(void)
+{
+	struct timespec tspec;
+	long ticks_per_sec = sysconf(_SC_CLK_TCK);
+
+#ifdef CLOCK_BOOTTIME
+	if (clock_gettime(CLOCK_BOOTTIME, &tspec) < 0)
+#endif
+		clock_gettime(CLOCK_MONOTONIC, &tspec);
+	return tspec.tv_sec * ticks_per_sec + tspec.tv_nsec / (1000000000 / ticks_per_sec);
+}
+
+// Return false if the task has exited
+static bool _get_task_start_ticks(pid_t tid, unsigned long long & start_ticks)
+{
+	char fname[PATH_MAX];
+	char buf[1024];
+	bool ok = false;
+
+	snprintf(fname, sizeof(fname), "/proc/%d/stat", tid);
+	FILE * fp = fopen(fname, "r");
+	if (!fp)
+		return false;
+	if (fgets(buf, sizeof(buf), fp)) {
+		// The task name, between parentheses, may contain anything.
+		char const * fields = strrchr(buf, ')');
+		ok = fields && sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u "
+		                      "%*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+		                      &start_ticks) == 1;
+	}
+	fclose(fp);
+	return ok;
+}
+
+static vector<pid_t> _get_task_ids(pid_t pid)
+{
+	vector<pid_t> tids;
+	char fname[PATH_MAX];
+	struct dirent * dirent;
+
+	snprintf(fname, sizeof(fname), "/proc/%d/task", pid);
+	DIR * dir = opendir(fname);
+	if (!dir)
+		return tids;
+	while ((dirent = readdir(dir))) {
+		char * end;
+		pid_t tid = strtol(dirent->d_name, &end, 10);
+		if (!*end && tid > 0)
+			tids.push_back(tid);
+	}
+	closedir(dir);
+	return tids;
+}
+
+// Needs a kernel built with CONFIG_PROC_CHILDREN; no children are found otherwise
+static vector<pid_t> _get_children(pid_t pid, pid_t tid)
+{
+	vector<pid_t> children;
+	char fname[PATH_MAX];
+	int child;
+
+	snprintf(fname, sizeof(fname), "/proc/%d/task/%d/children", pid, tid);
+	FILE * fp = fopen(fname, "r");
+	if (!fp)
+		return children;
+	while (fscanf(fp, "%d", &child) == 1)
+		children.push_back(child);
+	fclose(fp);
+	return children;
+}
+
+// The number of file descriptors open in ocount, 0 if /proc/self/fd can't be read
+static size_t _count_open_fds(void)
+{
+	size_t nr_fds = 0;
+	DIR * dir = opendir("/proc/self/fd");
+
+	if (!dir)
+		return 0;
+	while (readdir(dir))
+		nr_fds++;
+	closedir(dir);
+	// less ".", ".." and the fd of dir itself
+	return nr_fds > 3 ? nr_fds - 3 : 0;
+}
+
+/* With --process-list, the counters of a task are inherited by the threads and processes
+ * it creates after they have been opened. This looks in /proc for the tasks that were
+ * created before that but were not counted: threads started while get_process_info()
+ * and do_counting_per_task() were running, and children of the given processes, with
+ * their own threads and children, that already existed when ocount started. A task
+ * started once the first counter was opened may already be counted through inherit,
+ * so it is left alone rather than risk counting it twice.
+ *
+ * The counters of the tasks found here take at most the file descriptors left under
+ * RLIMIT_NOFILE, less a few for ocount itself.
+ */
+void ocount_record::add_missed_tasks(void)
+{
+	size_t max_counters = (size_t)-1;
+	size_t first_counter = perfCounters.size();
+	struct rlimit rlim;
+	size_t nr_added = 0;
+
+	if (!getrlimit(RLIMIT_NOFILE, &rlim) && rlim.rlim_cur != RLIM_INFINITY) {
+		size_t nr_fds = _count_open_fds();
+		if (nr_fds < perfCounters.size())
+			nr_fds = perfCounters.size();
+		nr_fds += OCOUNT_RESERVED_FDS;
+		max_counters = rlim.rlim_cur > nr_fds ? rlim.rlim_cur - nr_fds : 0;
+	}
+
+	// counted_processes grows while the children found are scanned in turn.
+	for (size_t i = 0; i < counted_processes.size(); i++) {
+		pid_t pid = counted_processes[i];
+		vector<pid_t> tids = _get_task_ids(pid);
+
+		for (size_t j = 0; j < tids.size(); j++) {
+			pid_t tid = tids[j];
+			unsigned long long start_ticks;
+			vector<pid_t> children = _get_children(pid, tid);
+
+			for (size_t k = 0; k < children.size(); k++) {
+				if (_get_task_start_ticks(children[k], start_ticks) &&
+				    start_ticks < counting_start_ticks &&
+				    find(counted_processes.begin(), counted_processes.end(),
+				         children[k]) == counted_processes.end())
+					counted_processes.push_back(children[k]);
+			}
+
+			vector<pid_t>::iterator pos = lower_bound(tasks_to_count.begin(),
+			                                          tasks_to_count.end(), tid);
+			if (pos != tasks_to_count.end() && *pos == tid)
+				continue;
+			if (!_get_task_start_ticks(tid, start_ticks) ||
+			    start_ticks >= counting_start_ticks)
+				continue;
+
+			// A task that could not be counted had its counters closed.
+			if (perfCounters.size() - first_counter + evts.size() > max_counters) {
+				cerr << "ocount: too many open files to count all tasks of the given "
+				     << "process(es); raise the limit with 'ulimit -n'." << endl;
+				return;
+			}
+			if (add_counted_element(tid, -1, false, true, true) < 0) {
+				// most likely, the task has exited since
+				cverb << vdebug << "Unable to count task " << tid << endl;
+				continue;
+			}
+			tasks_to_count.insert(pos, tid);
+			nr_added++;
+		}
+	}
+	cverb << vdebug << "Found " << nr_added << " tasks not counted by inherit" << endl;
+}
+
 void ocount_record::setup()
 {
 	int rc = 0;
@@ -339,25 +721,29 @@ void ocount_record::setup()
 	if (system_wide || (runmode == OP_CPULIST)) {
 		rc = do_counting_per_cpu();
 	} else if (!specified_tasks.empty()) {
+		counting_start_ticks = _boot_ticks_now();
 		rc = do_counting_per_task();
+		if (!rc && are_tasks_processes()) {
+			counted_processes = specified_tasks;
+			add_missed_tasks();
+		}
 	} else {
 		cverb << vdebug << "calling perf_event_open for pid " << app_pid << endl;
-		for (unsigned event = 0; event < evts.size(); event++) {
-			ocount_accum_t count_data = {0ULL, 0ULL, 0ULL};
-			accum_counts.push_back(count_data);
-			prev_accum_counts.push_back(0ULL);
-			ocount_counter op_ctr(ocount_counter(evts[event], true, true));
-			if ((rc = op_ctr.perf_event_open(app_pid, -1)) < 0) {
-				err_msg = "Internal Error.  Perf event setup failed.";
-				goto error;
-			} else {
-				rc = 0;
-			}
-			perfCounters.push_back(op_ctr);
+		if ((rc = add_counted_element(app_pid, -1, true, true)) < 0) {
+			err_msg = "Internal Error.  Perf event setup failed.";
+			goto error;
 		}
 	}
 	if (!rc) {
 		cverb << vdebug << "perf counter setup complete" << endl;
+		/* Split the groups that are not scheduled at all now, rather than
+		 * find out when the counts are printed.
+		 */
+		if (group_leaders.size() < perfCounters.size()) {
+			struct timespec probe = {0, OCOUNT_GROUP_PROBE_NS};
+			nanosleep(&probe, NULL);
+			read_counters();
+		}
 		// Set bit to indicate we're set to go.
 		valid = true;
 		// Now that all events are programmed to start counting, init the start time
@@ -373,282 +759,11 @@ error:
 		throw runtime_error(err_msg);
 }
 
-void ocount_record::output_short_results(ostream & out, bool use_separation, bool scaled)
-{
-	size_t num_iterations = use_separation ? perfCounters.size() : evts.size();
-	out << endl;
-	for (size_t num = 0; num < num_iterations; num++) {
-		ostringstream count_str;
-		ocount_accum_t tmp_accum;
-		double fraction_time_running;
-		string qual_string;
-
-		if (use_separation) {
-			if (cpus_to_count.size()) {
-				out << perfCounters[num].get_cpu();
-			} else {
-				out << perfCounters[num].get_pid();
-			}
-			out << "," << perfCounters[num].get_event_name();
-
-			qual_string =
-			  print_mask_modes(perfCounters[num].get_mode_specified(),
-			                   perfCounters[num].get_um_specified(),
-			                   perfCounters[num].get_no_kernel(),
-			                   perfCounters[num].get_no_user(),
-			                   perfCounters[num].get_um_numeric_val_as_str(),
-			                   perfCounters[num].get_umask_value());
-			out << qual_string;
-			out  << ",";
-
-			errno = 0;
-			cverb << vdebug << "Reading counter data for event " << perfCounters[num].get_event_name() << endl;
-			if (perfCounters[num].read_count_data(&tmp_accum) < 0) {
-				string err_msg = "Internal error: read of perfCounter fd failed with ";
-				err_msg += errno ? strerror(errno) : "unknown error";
-				throw runtime_error(err_msg);
-			}
-			fraction_time_running = scaled ? (double)tmp_accum.running_time/tmp_accum.enabled_time : 1;
-			if (with_time_interval) {
-				u64 save_prev = prev_accum_counts[num];
-				prev_accum_counts[num] = tmp_accum.count;
-				tmp_accum.count -= save_prev;
-			}
-			u64 scaled_count = tmp_accum.count ? tmp_accum.count/fraction_time_running : 0;
-			out << dec << scaled_count << ",";
-		} else {
-			fraction_time_running = scaled ? (double)accum_counts[num].running_time/accum_counts[num].enabled_time : 1;
-			u64 scaled_count = accum_counts[num].count ? accum_counts[num].count/fraction_time_running : 0;
-			out << perfCounters[num].get_event_name();
-
-			qual_string = print_mask_modes(perfCounters[num].get_mode_specified(),
-			                               perfCounters[num].get_um_specified(),
-			                               perfCounters[num].get_no_kernel(),
-			                               perfCounters[num].get_no_user(),
-			                               perfCounters[num].get_um_numeric_val_as_str(),
-			                               perfCounters[num].get_umask_value());
-			out << qual_string;
-			out << "," << dec << scaled_count << ",";
-		}
-		ostringstream strm_tmp;
-		if (use_separation) {
-			if (!tmp_accum.enabled_time) {
-				out << 0 << endl;
-			} else {
-				strm_tmp.precision(2);
-				strm_tmp << fixed << fraction_time_running * 100
-				         << endl;
-				out << strm_tmp.str();
-			}
-		} else {
-			if (!accum_counts[num].enabled_time) {
-				out << "Event not counted" << endl;
-			} else {
-				strm_tmp.precision(2);
-				strm_tmp << fixed << fraction_time_running * 100
-				         << endl;
-				out << strm_tmp.str();
-			}
-		}
-	}
-}
-
-void ocount_record::output_long_results(ostream & out, bool use_separation,
-                                        int evt_name_col_size, bool scaled,
-                                        u64 time_enabled)
-{
-#define COUNT_COLUMN_WIDTH 25
-#define SEPARATION_ELEMENT_COLUMN_WIDTH 10
-#define MIN_NAME_COLUMN_SPACING 8
-
-	char space_padding[64], temp[64];
-	char const * cpu, * task, * scaling;
-	u64 num_seconds_enabled = time_enabled/1000000000;
-	unsigned int num_minutes_enabled = num_seconds_enabled/60;
-	cpu = "CPU";
-	task = "Task ID";
-	scaling = scaled ? "(scaled) " : "(actual) ";
-
-	unsigned int begin_second_col;
-	unsigned int num_pads;
-	ostringstream debug_string;
-
-	/* Need to account for any events that will be printing user/kernel
-	 * mode or unit mask names when setting up the columns of the data.
-	 */
-	begin_second_col = evt_name_col_size + MIN_NAME_COLUMN_SPACING;
-	num_pads = begin_second_col - strlen("Event");
-
-	memset(space_padding, ' ', 64);
-	strncpy(temp, space_padding, num_pads);
-	temp[num_pads] = '\0';
-	out << endl;
-	if (!with_time_interval) {
-		ostringstream strm;
-		strm << "Events were actively counted for ";
-		if (num_minutes_enabled) {
-			strm << " ";
-			strm << num_minutes_enabled;
-			if (num_minutes_enabled > 1)
-				strm << " minutes and ";
-			else
-				strm << " minute and ";
-			strm << num_seconds_enabled % 60;
-			strm << " seconds.";
-		} else {
-			if (num_seconds_enabled) {
-				// Show 1/10's of seconds
-				strm.precision(1);
-				strm << fixed << (double)time_enabled/1000000000;
-				strm << " seconds.";
-			} else {
-				// Show full nanoseconds
-				strm << time_enabled << " nanoseconds.";
-			}
-		}
-		out << strm.str() << endl;
-	}
-	out << "Event counts " << scaling;
-	if (app_name)
-		out << "for " << app_name << ":";
-	else if (system_wide)
-		out << "for the whole system:";
-	else if (!cpus_to_count.empty())
-		out << "for the specified CPU(s):";
-	else if (tasks_are_threads)
-		out << "for the specified thread(s):";
-	else
-		out << "for the specified process(es):";
-	out << endl;
-
-	out << "\tEvent" << temp;
-	if (use_separation) {
-		if (cpus_to_count.size()) {
-			out << cpu;
-			num_pads = SEPARATION_ELEMENT_COLUMN_WIDTH - strlen(cpu);
-		} else {
-			out << task;
-			num_pads = SEPARATION_ELEMENT_COLUMN_WIDTH - strlen(task);
-
-		}
-		strncpy(temp, space_padding, num_pads);
-		temp[num_pads] = '\0';
-		out << temp;
-	}
-	out << "Count";
-	num_pads = COUNT_COLUMN_WIDTH - strlen("Count");
-	strncpy(temp, space_padding, num_pads);
-	temp[num_pads] = '\0';
-	out << temp << "% time counted" << endl;
-
-	/* If counting per-cpu or per-thread, I refer generically to cpu or thread values
-	 * as "elements of separation".  We will have one ocount_counter object per element of
-	 * separation per event.  So if we're counting 2 events for 4 processes (or threads),
-	 * we'll have 2x4 (8) ocount_counter objects.
-	 *
-	 * If 'use_separation' is true, then we need to print individual counts for
-	 * each element of separation for each event; otherwise, we print aggregated counts
-	 * for each event.
-	 */
-	size_t num_iterations = use_separation ? perfCounters.size() : evts.size();
-	for (size_t num = 0; num < num_iterations; num++) {
-		double fraction_time_running;
-		string qual_string;
-
-		out << "\t" << perfCounters[num].get_event_name();
-		qual_string = print_mask_modes(perfCounters[num].get_mode_specified(),
-		                               perfCounters[num].get_um_specified(),
-		                               perfCounters[num].get_no_kernel(),
-		                               perfCounters[num].get_no_user(),
-		                               perfCounters[num].get_um_numeric_val_as_str(),
-		                               perfCounters[num].get_umask_value());
-		out << qual_string;
-		num_pads = begin_second_col - qual_string.size()
-			- perfCounters[num].get_event_name().size();
-
-		strncpy(temp, space_padding, num_pads);
-		temp[num_pads] = '\0';
-		out << temp;
-
-		ostringstream count_str;
-		ocount_accum_t tmp_accum;
-		if (use_separation) {
-			ostringstream separation_element_str;
-			strncpy(temp, space_padding, num_pads);
-			temp[num_pads] = '\0';
-			if (cpus_to_count.size()) {
-				separation_element_str << dec << perfCounters[num].get_cpu();
-				out << perfCounters[num].get_cpu();
-			} else {
-				separation_element_str << dec << perfCounters[num].get_pid();
-				out << perfCounters[num].get_pid();
-			}
-			num_pads = SEPARATION_ELEMENT_COLUMN_WIDTH - separation_element_str.str().length();
-			strncpy(temp, space_padding, num_pads);
-			temp[num_pads] = '\0';
-			out << temp;
-
-			errno = 0;
-			cverb << vdebug << "Reading counter data for event " << perfCounters[num].get_event_name() << endl;
-			if (perfCounters[num].read_count_data(&tmp_accum) < 0) {
-				string err_msg = "Internal error: read of perfCounter fd failed with ";
-				err_msg += errno ? strerror(errno) : "unknown error";
-				throw runtime_error(err_msg);
-			}
-			fraction_time_running = scaled ? (double)tmp_accum.running_time/tmp_accum.enabled_time : 1;
-
-			if (with_time_interval) {
-				u64 save_prev = prev_accum_counts[num];
-				prev_accum_counts[num] = tmp_accum.count;
-				tmp_accum.count -= save_prev;
-			}
-			u64 scaled_count = tmp_accum.count ? tmp_accum.count/fraction_time_running : 0;
-			count_str << dec << scaled_count;
-		} else {
-			fraction_time_running = scaled ? (double)accum_counts[num].running_time/accum_counts[num].enabled_time : 1;
-			u64 scaled_count = accum_counts[num].count ? accum_counts[num].count/fraction_time_running : 0;
-			count_str << dec << scaled_count;
-		}
-		string count = count_str.str();
-		for (int i = count.size() - 3; i > 0; i-=3) {
-			count.insert(i, 1, ',');
-		}
-		out << count;
-		num_pads = COUNT_COLUMN_WIDTH - count.size();
-		strncpy(temp, space_padding, num_pads);
-		temp[num_pads] = '\0';
-		out << temp;
-		ostringstream strm_tmp;
-		if (use_separation) {
-			if (!tmp_accum.enabled_time) {
-				out << "Event not counted" << endl;
-			} else {
-				strm_tmp.precision(2);
-				strm_tmp << fixed << fraction_time_running * 100
-				         << endl;
-				out << strm_tmp.str();
-			}
-		} else {
-			if (!accum_counts[num].enabled_time) {
-				out << "Event not counted" << endl;
-			} else {
-				strm_tmp.precision(2);
-				strm_tmp << fixed << fraction_time_running * 100
-				         << endl;
-				out << strm_tmp.str();
-			}
-		}
-	}
-}
-
-void ocount_record::output_results(ostream & out, bool use_separation, bool short_format)
+size_t ocount_record::event_name_col_size(void) const
 {
 #define MODE_FIELD_SIZE  3    /* space for :KU in the output */
 
 	size_t evt_name_col_size = 0;
-	u64 time_enabled = 0ULL;
-	bool scaled = false;
-	bool mode_specified = false;
 
 	for (unsigned long evt_num = 0; evt_num < evts.size(); evt_num++) {
 		unsigned int length = 0;
@@ -667,66 +782,68 @@ void ocount_record::output_results(ostream & out, bool use_separation, bool shor
 
 		if (length > evt_name_col_size)
 			evt_name_col_size = length;
-
-		mode_specified = mode_specified ||
-			evts[evt_num].mode_specified;
 	}
+	return evt_name_col_size;
+}
 
-	if (with_time_interval) {
-		// reset the accum count values
-		for (size_t i = 0; i < evts.size(); i++) {
-			ocount_accum_t accum = accum_counts[i];
-			accum.count = 0ULL;
-			accum_counts[i] = accum;
-		}
-	}
+/* Read the counters and print them with ocount_output_results(). With time
+ * intervals, the counts printed are the ones since the previous call.
+ */
+void ocount_record::output_results(ostream & out, bool use_separation, bool short_format)
+{
+	ocount_output_info info;
+	u64 time_enabled = 0ULL;
 
-	/* We need to inspect all of the count data now to ascertain if scaling
-	 * is required, so we also collect aggregated counts into the accum_counts
-	 * vector (if needed).
-	 */
-	for (unsigned long ocounter = 0; ocounter < perfCounters.size(); ocounter++) {
-		ocount_accum_t tmp_accum;
-		int evt_key = ocounter % evts.size();
-		errno = 0;
-		cverb << vdebug << "Reading counter data for event " << evts[evt_key].name << endl;
-		if (perfCounters[ocounter].read_count_data(&tmp_accum) < 0) {
-			string err_msg = "Internal error: read of perfCounter fd failed with ";
-			err_msg += errno ? strerror(errno) : "unknown error";
-			throw runtime_error(err_msg);
-		}
-		if (!use_separation) {
-			ocount_accum_t real_accum = accum_counts[evt_key];
-			real_accum.count += tmp_accum.count;
-			real_accum.enabled_time += tmp_accum.enabled_time;
-			real_accum.running_time += tmp_accum.running_time;
-			accum_counts[evt_key] = real_accum;
-		}
-		if (tmp_accum.enabled_time != tmp_accum.running_time) {
-			if (((double)(tmp_accum.enabled_time - tmp_accum.running_time)/tmp_accum.enabled_time) > 0.01)
-				scaled = true;
+	read_counters();
+	vector<ocount_accum_t> counts = counter_data;
+	if (with_time_interval) {
+		for (size_t i = 0; i < counts.size(); i++) {
+			counts[i].count -= prev_counts[i];
+			prev_counts[i] = counter_data[i].count;
 		}
 	}
 
-	if (with_time_interval && !use_separation) {
-		for (size_t i = 0; i < evts.size(); i++) {
-			u64 save_prev = prev_accum_counts[i];
-			ocount_accum_t real_accum = accum_counts[i];
-			prev_accum_counts[i] = real_accum.count;
-			real_accum.count -= save_prev;
-			accum_counts[i] = real_accum;
-		}
-	}
 	struct timespec tspec;
 	clock_gettime(CLOCK_MONOTONIC, &tspec);
 	time_enabled = (tspec.tv_sec * 1000000000ULL + tspec.tv_nsec) - start_time;
 
+	info.runmode = runmode;
+	if (app_name)
+		info.app_name = app_name;
+	info.event_labels = event_labels;
+	info.elements = elements;
+	info.count_per_cpu = count_per_cpu;
+	info.evt_name_col_size = event_name_col_size();
+	info.with_time_interval = with_time_interval;
+	ocount_output_results(out, info, counts, use_separation, short_format,
+	                      time_enabled);
+}
+
+void ocount_record::output_binary_header(int fd, u64 interval_ns)
+{
+	struct ocount_binary_header header;
+	struct timespec tspec;
+
+	clock_gettime(CLOCK_REALTIME, &tspec);
+	memset(&header, 0, sizeof(header));
+	header.runmode = runmode;
+	header.separation = count_per_cpu ? OCOUNT_BINARY_CPU : OCOUNT_BINARY_TASK;
+	header.name_col_size = event_name_col_size();
+	header.interval_ns = interval_ns;
+	header.start_time = tspec.tv_sec * 1000000000ULL + tspec.tv_nsec;
+
+	ocount_write_binary_header(fd, header, event_labels, app_name ? app_name : "",
+	                           elements);
+}
 
-	if (short_format)
-		output_short_results(out, use_separation, scaled);
-	else
-		output_long_results(out, use_separation, evt_name_col_size,
-				    scaled, time_enabled);
+/* One fixed size record per call. Nothing is formatted here: scaling and per
+ * interval differences are left to the reader.
+ */
+void ocount_record::output_binary_results(int fd, struct timespec const & timestamp)
+{
+	read_counters();
+	ocount_write_binary_record(fd, timestamp.tv_sec * 1000000000ULL + timestamp.tv_nsec,
+	                           counter_data);
 }
 
 int ocount_record::_get_one_process_info(pid_t pid)
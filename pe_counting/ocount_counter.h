@@ -19,7 +19,6 @@
 #include <sys/syscall.h>
 
 #include <vector>
-#include <set>
 #include <string>
 
 #include "operf_event.h"
@@ -54,10 +53,18 @@ op_perf_event_open(struct perf_event_attr * attr,
 class ocount_record;
 class ocount_counter {
 public:
+	/* A grouped counter uses PERF_FORMAT_GROUP, whose reads return the
+	 * counts of its whole group when it is the group leader.
+	 */
 	ocount_counter(operf_event_t & evt, bool enable_on_exec,
-	               bool inherit);
+	               bool inherit, bool group_leader, bool grouped);
 	~ocount_counter();
-	int perf_event_open(pid_t pid, int cpu);
+	// With quiet, failures are only reported with --verbose
+	int perf_event_open(pid_t pid, int cpu, int group_fd, bool quiet = false);
+	/* The counters are copied around in vectors, so the destructor leaves the
+	 * file descriptor alone; it is closed here by the owner of the counter.
+	 */
+	void close_counter(void);
 	int get_cpu(void) { return cpu; }
 	pid_t get_pid(void) { return pid; }
 	const std::string get_umask_value(void) const { return event.um_name; }
@@ -68,7 +75,13 @@ public:
 	int get_no_kernel(void) const { return attr.exclude_kernel; }
 	bool get_mode_specified(void) { return event.mode_specified; }
 	bool get_um_specified(void) { return event.umask_specified; }
-	int read_count_data(ocount_accum_t * accum);
+	/* Read the counts of the whole group led by this counter with a single
+	 * read(). 'members' are the nr_members counters of the group, this one
+	 * included; count_data[i] receives the counts of members[i]. An ungrouped
+	 * counter is its own group of one; a closed one reads as not counted.
+	 */
+	int read_group_data(ocount_counter const * members, size_t nr_members,
+	                    ocount_accum_t * count_data);
 
 private:
 	operf_event_t event;
@@ -76,6 +89,8 @@ private:
 	int fd;
 	int cpu;
 	pid_t pid;
+	// kernel ID of the event, as returned by PERF_FORMAT_ID; 0 if unknown
+	u64 id;
 };
 
 class ocount_record {
@@ -87,8 +102,11 @@ public:
 	bool start_counting_tasklist(std::vector<pid_t> _tasks, bool _are_threads);
 	bool start_counting_cpulist(std::vector<int> _cpus);
 	bool start_counting_syswide(void);
-	void add_process(pid_t proc) { tasks_to_count.insert(proc); }
+	void add_process(pid_t proc) { tasks_to_count.push_back(proc); }
 	void output_results(std::ostream & out, bool use_separation, bool short_format);
+	// The --binary-format output, see ocount_binary.h
+	void output_binary_header(int fd, u64 interval_ns);
+	void output_binary_results(int fd, struct timespec const & timestamp);
 	bool get_valid(void) { return valid; }
 	bool are_tasks_processes(void) { return !tasks_are_threads; }
 
@@ -98,32 +116,59 @@ private:
 	int _get_one_process_info(pid_t pid);
 	int do_counting_per_cpu(void);
 	int do_counting_per_task(void);
-	void output_short_results(std::ostream & out, bool use_separation, bool scaled);
-	void output_long_results(std::ostream & out, bool use_separation,
-                                 int longest_event_name,
-                                 bool scaled, u64 time_enabled);
+	int add_counted_element(pid_t pid, int cpu, bool enable_on_exec, bool inherit,
+	                        bool quiet = false);
+	int open_counter_group(pid_t pid, int cpu, bool enable_on_exec, bool inherit,
+	                       bool quiet);
+	void drop_counters(size_t first, size_t nr_groups);
+	void add_missed_tasks(void);
+	void split_group(size_t group);
+	void read_counters(void);
+	// width of the longest event name with its qualifiers
+	size_t event_name_col_size(void) const;
 
 	enum op_runmode runmode;
 	bool tasks_are_threads;
 	int num_cpus;
 	pid_t app_pid;
-	std::set<pid_t> tasks_to_count;
-	std::set<int> cpus_to_count;
+	// The tasks given by the user, plus the threads of the processes among them
+	std::vector<pid_t> tasks_to_count;
+	// With --process-list, the given processes plus their children found by add_missed_tasks()
+	std::vector<pid_t> counted_processes;
+	// Clock ticks since boot when the first counter was opened
+	unsigned long long counting_start_ticks;
 	bool system_wide;
-	std::vector<ocount_counter> perfCounters;
-	unsigned int total_bytes_recorded;
 	std::vector<operf_event_t> evts;
+	// The event names with their unit mask and mode qualifiers, as printed
+	std::vector<std::string> event_labels;
 	std::vector<pid_t> specified_tasks;
 	std::vector<int> specified_cpus;
-	std::vector<ocount_accum_t> accum_counts;  // accumulated across threads or cpus; one object per event
 
-	/* The prev_accum_counts vector is used with time intervals for computing count values for just
-	 * the current time interval. The number of elements in this vector depends on the run mode:
-	 *   - For <command> [args] : vector size == evts.size()
-	 *   - For system-wide or cpu list : vector size is number of processors
-	 *   - For process or thread list : vector size is number of tasks
+	/* The counts are kept in a dense matrix with one row per "element of separation"
+	 * (a cpu, or a task) and one column per event: the counter of event e for the
+	 * element in row r is perfCounters[r * evts.size() + e], and its counts are at
+	 * the same index of counter_data and prev_counts. Counting one more task just
+	 * appends a row.
 	 */
-	std::vector<u64> prev_accum_counts;
+	std::vector<ocount_counter> perfCounters;
+	// true if the rows are cpus, false if they are tasks
+	bool count_per_cpu;
+	// the cpu or task ID of each row
+	std::vector<int> elements;
+	/* The counters of each row are opened as perf event groups of at most
+	 * max_group_size events (0 for no limit), so all of their counts are read
+	 * at once and scaled alike. Inherited counters, and all counters once the
+	 * kernel refused a group, are groups of one. group_leaders holds the
+	 * perfCounters index of the first counter of each group.
+	 */
+	std::vector<size_t> group_leaders;
+	size_t max_group_size;
+	// The counts from the last read_counters()
+	std::vector<ocount_accum_t> counter_data;
+	// With time intervals, the counts printed for the previous interval
+	std::vector<u64> prev_counts;
+
+	unsigned int total_bytes_recorded;
 	bool valid;
 	bool with_time_interval;
 	u64 start_time;
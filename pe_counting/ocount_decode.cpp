@@ -0,0 +1,92 @@
+/**
+ * @file ocount_decode.cpp
+ * Print the output of ocount --binary-format in ocount's text formats
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include "config.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+
+#include <getopt.h>
+#include <stdlib.h>
+
+#include "ocount_binary.h"
+
+using namespace std;
+
+namespace ocount_decode_options {
+bool separate;
+bool csv_output;
+}
+
+struct option long_options [] =
+{
+ {"separate", no_argument, NULL, 's'},
+ {"brief-format", no_argument, NULL, 'b'},
+ {"help", no_argument, NULL, 'h'},
+ {"usage", no_argument, NULL, 'u'},
+ {"version", no_argument, NULL, 'v'},
+ {NULL, 9, NULL, 0}
+};
+
+const char * short_options = "sbhuv";
+
+static void __print_usage_and_exit(const char * extra_msg)
+{
+	if (extra_msg)
+		cerr << extra_msg << endl;
+	cerr << "usage: ocount-decode [ --separate ] [ --brief-format ] <file>" << endl;
+	cerr << "See ocount-decode man page for details." << endl;
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char * const argv[])
+{
+	int c;
+
+	while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+		switch (c) {
+		case 's':
+			ocount_decode_options::separate = true;
+			break;
+		case 'b':
+			ocount_decode_options::csv_output = true;
+			break;
+		case 'v':
+			cout << argv[0] << ": " << PACKAGE << " " << VERSION << " compiled on "
+			     << __DATE__ << " " << __TIME__ << endl;
+			exit(EXIT_SUCCESS);
+		case 'h':
+		case 'u':
+			__print_usage_and_exit(NULL);
+			break;
+		default:
+			__print_usage_and_exit("ocount-decode: invalid option");
+		}
+	}
+
+	if (optind != argc - 1)
+		__print_usage_and_exit(NULL);
+
+	ifstream in(argv[optind], ios::in | ios::binary);
+	if (!in) {
+		cerr << "Unable to open " << argv[optind] << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	try {
+		ocount_decode_binary(in, cout, ocount_decode_options::separate,
+		                     ocount_decode_options::csv_output);
+	} catch (const runtime_error & e) {
+		cerr << argv[optind] << ": " << e.what() << endl;
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
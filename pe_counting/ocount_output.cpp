@@ -0,0 +1,289 @@
+/**
+ * @file ocount_output.cpp
+ * The text formats of the ocount results, shared by ocount and ocount-decode
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <sstream>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ocount_output.h"
+
+using namespace std;
+
+#define OCOUNT_MSECS_PER_SEC 1000
+#define OCOUNT_NSECS_PER_MSEC 1000000ULL
+#define OCOUNT_NSECS_PER_SEC 1000000000ULL
+
+#define COUNT_COLUMN_WIDTH 25
+#define SEPARATION_ELEMENT_COLUMN_WIDTH 10
+#define MIN_NAME_COLUMN_SPACING 8
+
+namespace {
+
+/* Fill results and scaled_counts from counts: one element per counter with
+ * separation, or one per event summed over all rows without it. Returns true
+ * if any counter was multiplexed, in which case all counts are scaled by
+ * enabled_time/running_time.
+ */
+bool compute_results(ocount_output_info const & info,
+                     vector<ocount_accum_t> const & counts, bool use_separation,
+                     vector<ocount_accum_t> & results, vector<u64> & scaled_counts)
+{
+	size_t nr_events = info.event_labels.size();
+	size_t nr_counters = counts.size();
+	bool scaled = false;
+
+	for (size_t i = 0; i < nr_counters; i++) {
+		u64 enabled = counts[i].enabled_time;
+		u64 running = counts[i].running_time;
+		if (enabled != running && (double)(enabled - running)/enabled > 0.01)
+			scaled = true;
+	}
+
+	if (use_separation) {
+		results = counts;
+	} else {
+		ocount_accum_t count_data = {0ULL, 0ULL, 0ULL};
+		results.assign(nr_events, count_data);
+		for (size_t row = 0; row < nr_counters; row += nr_events) {
+			ocount_accum_t const * row_data = &counts[row];
+			for (size_t event = 0; event < nr_events; event++) {
+				results[event].count += row_data[event].count;
+				results[event].enabled_time += row_data[event].enabled_time;
+				results[event].running_time += row_data[event].running_time;
+			}
+		}
+	}
+
+	scaled_counts.resize(results.size());
+	for (size_t i = 0; i < results.size(); i++) {
+		ocount_accum_t const & result = results[i];
+		if (scaled && result.running_time)
+			scaled_counts[i] = (double)result.count * result.enabled_time /
+				result.running_time;
+		else
+			scaled_counts[i] = result.count;
+	}
+	return scaled;
+}
+
+void output_short_results(ostream & out, ocount_output_info const & info,
+                          vector<ocount_accum_t> const & results,
+                          vector<u64> const & scaled_counts,
+                          bool use_separation, bool scaled)
+{
+	size_t nr_events = info.event_labels.size();
+	out << endl;
+	for (size_t num = 0; num < results.size(); num++) {
+		ocount_accum_t const & result = results[num];
+		double fraction_time_running = scaled ? (double)result.running_time/result.enabled_time : 1;
+
+		if (use_separation)
+			out << info.elements[num / nr_events] << ",";
+		out << info.event_labels[num % nr_events] << "," << dec << scaled_counts[num] << ",";
+
+		ostringstream strm_tmp;
+		if (!result.enabled_time) {
+			if (use_separation)
+				out << 0 << endl;
+			else
+				out << "Event not counted" << endl;
+		} else {
+			strm_tmp.precision(2);
+			strm_tmp << fixed << fraction_time_running * 100
+			         << endl;
+			out << strm_tmp.str();
+		}
+	}
+}
+
+void output_long_results(ostream & out, ocount_output_info const & info,
+                         vector<ocount_accum_t> const & results,
+                         vector<u64> const & scaled_counts,
+                         bool use_separation, bool scaled, u64 time_enabled)
+{
+	char space_padding[64], temp[64];
+	char const * cpu, * task, * scaling;
+	u64 num_seconds_enabled = time_enabled/1000000000;
+	unsigned int num_minutes_enabled = num_seconds_enabled/60;
+	size_t nr_events = info.event_labels.size();
+	cpu = "CPU";
+	task = "Task ID";
+	scaling = scaled ? "(scaled) " : "(actual) ";
+
+	unsigned int begin_second_col;
+	unsigned int num_pads;
+
+	/* Need to account for any events that will be printing user/kernel
+	 * mode or unit mask names when setting up the columns of the data.
+	 */
+	begin_second_col = info.evt_name_col_size + MIN_NAME_COLUMN_SPACING;
+	num_pads = begin_second_col - strlen("Event");
+
+	memset(space_padding, ' ', 64);
+	strncpy(temp, space_padding, num_pads);
+	temp[num_pads] = '\0';
+	out << endl;
+	if (!info.with_time_interval) {
+		ostringstream strm;
+		strm << "Events were actively counted for ";
+		if (num_minutes_enabled) {
+			strm << " ";
+			strm << num_minutes_enabled;
+			if (num_minutes_enabled > 1)
+				strm << " minutes and ";
+			else
+				strm << " minute and ";
+			strm << num_seconds_enabled % 60;
+			strm << " seconds.";
+		} else {
+			if (num_seconds_enabled) {
+				// Show 1/10's of seconds
+				strm.precision(1);
+				strm << fixed << (double)time_enabled/1000000000;
+				strm << " seconds.";
+			} else {
+				// Show full nanoseconds
+				strm << time_enabled << " nanoseconds.";
+			}
+		}
+		out << strm.str() << endl;
+	}
+	out << "Event counts " << scaling;
+	switch (info.runmode) {
+	case OP_START_APP:
+		out << "for " << info.app_name << ":";
+		break;
+	case OP_SYSWIDE:
+		out << "for the whole system:";
+		break;
+	case OP_CPULIST:
+		out << "for the specified CPU(s):";
+		break;
+	case OP_THREADLIST:
+		out << "for the specified thread(s):";
+		break;
+	default:
+		out << "for the specified process(es):";
+		break;
+	}
+	out << endl;
+
+	out << "\tEvent" << temp;
+	if (use_separation) {
+		if (info.count_per_cpu) {
+			out << cpu;
+			num_pads = SEPARATION_ELEMENT_COLUMN_WIDTH - strlen(cpu);
+		} else {
+			out << task;
+			num_pads = SEPARATION_ELEMENT_COLUMN_WIDTH - strlen(task);
+
+		}
+		strncpy(temp, space_padding, num_pads);
+		temp[num_pads] = '\0';
+		out << temp;
+	}
+	out << "Count";
+	num_pads = COUNT_COLUMN_WIDTH - strlen("Count");
+	strncpy(temp, space_padding, num_pads);
+	temp[num_pads] = '\0';
+	out << temp << "% time counted" << endl;
+
+	/* If counting per-cpu or per-thread, I refer generically to cpu or thread values
+	 * as "elements of separation".  compute_results() left one result per element of
+	 * separation per event if 'use_separation' is true, and one aggregated result
+	 * per event otherwise.
+	 */
+	for (size_t num = 0; num < results.size(); num++) {
+		ocount_accum_t const & result = results[num];
+		string const & label = info.event_labels[num % nr_events];
+		double fraction_time_running = scaled ? (double)result.running_time/result.enabled_time : 1;
+
+		out << "\t" << label;
+		num_pads = begin_second_col - label.size();
+		strncpy(temp, space_padding, num_pads);
+		temp[num_pads] = '\0';
+		out << temp;
+
+		if (use_separation) {
+			ostringstream separation_element_str;
+			separation_element_str << dec << info.elements[num / nr_events];
+			out << separation_element_str.str();
+			num_pads = SEPARATION_ELEMENT_COLUMN_WIDTH - separation_element_str.str().length();
+			strncpy(temp, space_padding, num_pads);
+			temp[num_pads] = '\0';
+			out << temp;
+		}
+
+		ostringstream count_str;
+		count_str << dec << scaled_counts[num];
+		string count = count_str.str();
+		for (int i = count.size() - 3; i > 0; i-=3) {
+			count.insert(i, 1, ',');
+		}
+		out << count;
+		num_pads = COUNT_COLUMN_WIDTH - count.size();
+		strncpy(temp, space_padding, num_pads);
+		temp[num_pads] = '\0';
+		out << temp;
+		ostringstream strm_tmp;
+		if (!result.enabled_time) {
+			out << "Event not counted" << endl;
+		} else {
+			strm_tmp.precision(2);
+			strm_tmp << fixed << fraction_time_running * 100
+			         << endl;
+			out << strm_tmp.str();
+		}
+	}
+}
+
+} // anonymous namespace
+
+void ocount_output_results(ostream & out, ocount_output_info const & info,
+                           vector<ocount_accum_t> const & counts,
+                           bool use_separation, bool short_format, u64 time_enabled)
+{
+	vector<ocount_accum_t> results;
+	vector<u64> scaled_counts;
+	bool scaled = compute_results(info, counts, use_separation, results, scaled_counts);
+
+	if (short_format)
+		output_short_results(out, info, results, scaled_counts, use_separation, scaled);
+	else
+		output_long_results(out, info, results, scaled_counts, use_separation,
+		                    scaled, time_enabled);
+}
+
+void ocount_output_interval_start(ostream & out, enum op_runmode runmode,
+                                  bool short_format, u64 time_ns, long interval_msecs)
+{
+	char buf[64];
+
+	if (!short_format)
+		out << endl << "Current time (seconds since epoch): ";
+	else if (runmode == OP_START_APP)
+		out << endl << "timestamp,";
+	else
+		out << endl << "t:";
+
+	if (interval_msecs % OCOUNT_MSECS_PER_SEC == 0) {
+		snprintf(buf, sizeof(buf), "%llu", time_ns / OCOUNT_NSECS_PER_SEC);
+	} else if (interval_msecs % 100 == 0) {
+		u64 tenths = (time_ns + 50 * OCOUNT_NSECS_PER_MSEC) /
+			(100 * OCOUNT_NSECS_PER_MSEC);
+		snprintf(buf, sizeof(buf), "%llu.%llu", tenths / 10, tenths % 10);
+	} else {
+		u64 msecs = (time_ns + OCOUNT_NSECS_PER_MSEC / 2) / OCOUNT_NSECS_PER_MSEC;
+		snprintf(buf, sizeof(buf), "%llu.%03llu", msecs / OCOUNT_MSECS_PER_SEC,
+		         msecs % OCOUNT_MSECS_PER_SEC);
+	}
+	out << buf;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file ocount_output.h
+ * The text formats of the ocount results, shared by ocount and ocount-decode
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#ifndef OCOUNT_OUTPUT_H_
+#define OCOUNT_OUTPUT_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ocount_counter.h"
+
+/* What the text formats need to know about what was counted */
+struct ocount_output_info {
+	enum op_runmode runmode;
+	// the counted app, with OP_START_APP
+	std::string app_name;
+	// The event names with their unit mask and mode qualifiers, as printed
+	std::vector<std::string> event_labels;
+	// the cpu or task ID of each row of counts
+	std::vector<int> elements;
+	// true if the rows are cpus, false if they are tasks
+	bool count_per_cpu;
+	// width of the event names, the Event column is a bit wider
+	size_t evt_name_col_size;
+	bool with_time_interval;
+};
+
+/* Print the counts of one interval, or of the whole run without time
+ * intervals. counts has one element per counter, element major as in
+ * ocount_record: the count since the previous interval and the enabled and
+ * running times since counting started. time_enabled is the time elapsed since
+ * counting started, printed in the long format without time intervals.
+ */
+void ocount_output_results(std::ostream & out, ocount_output_info const & info,
+                           std::vector<ocount_accum_t> const & counts,
+                           bool use_separation, bool short_format, u64 time_enabled);
+
+/* Print what precedes the counts of an interval ending at time_ns, in
+ * nanoseconds since the epoch: the time stamp with as many decimals as needed
+ * to tell consecutive intervals apart.
+ */
+void ocount_output_interval_start(std::ostream & out, enum op_runmode runmode,
+                                  bool short_format, u64 time_ns, long interval_msecs);
+
+#endif /* OCOUNT_OUTPUT_H_ */
@@ -0,0 +1,220 @@
+/**
+ * @file ocount_binary_tests.cpp
+ *
+ * @remark Copyright 2013 OProfile authors
+ * @remark Read the file COPYING
+ *
+ * @author OProfile authors
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "ocount_binary.h"
+#include "ocount_output.h"
+
+using namespace std;
+
+#define NSECS_PER_MSEC 1000000ULL
+#define NSECS_PER_SEC 1000000000ULL
+
+/// nr. of rows of counts: cpus or tasks
+static size_t const nr_elements = 3;
+
+/// nr. of records written
+static size_t const nr_records = 4;
+
+static char const * const event_labels[] = {
+	"CPU_CLK_UNHALTED", "INST_RETIRED:u", "LLC_MISSES:0x41:k"
+};
+static size_t const nr_events = sizeof(event_labels) / sizeof(event_labels[0]);
+
+
+/*
+ * The raw counts of record r, as read from the kernel: growing from one record
+ * to the next, with one event multiplexed on the first cpu, one never counted
+ * and one count large enough to need thousands separators.
+ */
+static vector<ocount_accum_t> raw_counts(size_t r)
+{
+	vector<ocount_accum_t> counts(nr_elements * nr_events);
+	u64 const enabled = (r + 1) * 100 * NSECS_PER_MSEC;
+
+	for (size_t i = 0; i < counts.size(); i++) {
+		counts[i].count = (r + 1) * (i + 1) * 1234567ULL;
+		counts[i].enabled_time = enabled;
+		counts[i].running_time = enabled;
+	}
+	counts[1].running_time = enabled / 3;
+	counts[nr_events + 2].count = 0;
+	counts[nr_events + 2].enabled_time = 0;
+	counts[nr_events + 2].running_time = 0;
+	return counts;
+}
+
+
+/*
+ * Write nr_records records to a binary file, decode it, and check the output
+ * is the one ocount prints when it formats the same counts itself.
+ */
+static void check_round_trip(ocount_output_info const & info, u64 interval_ns,
+                             bool use_separation, bool short_format)
+{
+	char path[] = "/tmp/ocount_binary_testsXXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		exit(EXIT_FAILURE);
+	}
+
+	u64 const start_time = 1370000000ULL * NSECS_PER_SEC;
+	struct ocount_binary_header header;
+	memset(&header, 0, sizeof(header));
+	header.runmode = info.runmode;
+	header.separation = info.count_per_cpu ? OCOUNT_BINARY_CPU : OCOUNT_BINARY_TASK;
+	header.name_col_size = info.evt_name_col_size;
+	header.interval_ns = interval_ns;
+	header.start_time = start_time;
+
+	ostringstream expected;
+	vector<u64> prev_counts(nr_elements * nr_events);
+	ocount_write_binary_header(fd, header,
+		vector<string>(event_labels, event_labels + nr_events),
+		info.app_name, info.elements);
+	for (size_t r = 0; r < nr_records; r++) {
+		u64 const time_ns = start_time + (r + 1) * 1234 * NSECS_PER_MSEC;
+		vector<ocount_accum_t> counts = raw_counts(r);
+		ocount_write_binary_record(fd, time_ns, counts);
+
+		if (info.with_time_interval) {
+			for (size_t i = 0; i < counts.size(); i++) {
+				u64 const count = counts[i].count;
+				counts[i].count -= prev_counts[i];
+				prev_counts[i] = count;
+			}
+			ocount_output_interval_start(expected, info.runmode, short_format,
+			                             time_ns, interval_ns / NSECS_PER_MSEC);
+		}
+		ocount_output_results(expected, info, counts, use_separation,
+		                      short_format, time_ns - start_time);
+	}
+	close(fd);
+
+	ostringstream decoded;
+	ifstream in(path, ios::in | ios::binary);
+	try {
+		ocount_decode_binary(in, decoded, use_separation, short_format);
+	} catch (runtime_error const & e) {
+		cerr << "ocount_decode_binary: " << e.what() << endl;
+		exit(EXIT_FAILURE);
+	}
+	unlink(path);
+
+	if (decoded.str() != expected.str()) {
+		cerr << "decoded output differs, expected:\n" << expected.str()
+		     << "\ndecoded:\n" << decoded.str() << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+/// decoding data must fail with a runtime_error, not a bad_alloc
+static void check_bad_file(string const & data, char const * what)
+{
+	istringstream in(data);
+	ostringstream out;
+	try {
+		ocount_decode_binary(in, out, false, false);
+	} catch (runtime_error const &) {
+		return;
+	}
+	cerr << what << " not detected" << endl;
+	exit(EXIT_FAILURE);
+}
+
+
+static void check_truncated(void)
+{
+	ocount_binary_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, OCOUNT_BINARY_MAGIC, sizeof(header.magic));
+	header.version = OCOUNT_BINARY_VERSION;
+	header.nr_events = 1;
+
+	string const data((char const *)&header, sizeof(header));
+	check_bad_file(data, "truncated header");
+
+	// corrupted counts and lengths, far larger than the file
+	header.nr_events = 0xffffffff;
+	check_bad_file(string((char const *)&header, sizeof(header)) +
+	               string(64, '\0'), "huge nr_events");
+
+	u32 const huge_len = 0xfffffff0;
+	header.nr_events = 1;
+	check_bad_file(data + string((char const *)&huge_len, sizeof(huge_len)) +
+	               string(64, 'x'), "huge string length");
+
+	u32 const no_len = 0;
+	header.nr_events = 0;
+	header.nr_elements = 0x40000000;
+	check_bad_file(string((char const *)&header, sizeof(header)) +
+	               string((char const *)&no_len, sizeof(no_len)) +
+	               string(64, '\0'), "huge nr_elements");
+
+	// a valid schema whose records would need 96GB each
+	u64 const time_ns = 0;
+	header.nr_events = 0x10000;
+	header.nr_elements = 0x10000;
+	string schema;
+	for (u32 i = 0; i < header.nr_events; i++)
+		schema.append((char const *)&no_len, sizeof(no_len));
+	schema.append((char const *)&no_len, sizeof(no_len));
+	schema.append(header.nr_elements * sizeof(int), '\0');
+	check_bad_file(string((char const *)&header, sizeof(header)) + schema +
+	               string((char const *)&time_ns, sizeof(time_ns)),
+	               "truncated record");
+}
+
+
+int main()
+{
+	ocount_output_info info;
+	info.runmode = OP_START_APP;
+	info.app_name = "/bin/true";
+	info.event_labels.assign(event_labels, event_labels + nr_events);
+	info.elements.push_back(0);
+	info.elements.push_back(1);
+	info.elements.push_back(3);
+	info.count_per_cpu = true;
+	info.evt_name_col_size = strlen("LLC_MISSES:0x41:k") + 3;
+
+	for (int separate = 0; separate < 2; separate++) {
+		for (int short_format = 0; short_format < 2; short_format++) {
+			info.with_time_interval = false;
+			check_round_trip(info, 0, separate, short_format);
+
+			info.with_time_interval = true;
+			check_round_trip(info, 1000 * NSECS_PER_MSEC, separate, short_format);
+			check_round_trip(info, 250 * NSECS_PER_MSEC, separate, short_format);
+		}
+	}
+
+	info.runmode = OP_THREADLIST;
+	info.app_name.clear();
+	info.count_per_cpu = false;
+	info.elements[2] = 4242;
+	info.with_time_interval = true;
+	check_round_trip(info, 100 * NSECS_PER_MSEC, true, false);
+	check_round_trip(info, 100 * NSECS_PER_MSEC, true, true);
+
+	check_truncated();
+
+	return EXIT_SUCCESS;
+}
@@ -15,6 +15,8 @@
 #include <iomanip>
 #include <fstream>
 #include <utility>
+#include <set>
+#include <vector>
 
 #include "op_exception.h"
 #include "op_header.h"
@@ -25,6 +27,7 @@
 #include "string_manip.h"
 #include "demangle_symbol.h"
 #include "child_reader.h"
+#include "op_disassembler.h"
 #include "op_file.h"
 #include "file_manip.h"
 #include "arrange_profiles.h"
@@ -32,6 +35,7 @@
 #include "profile_container.h"
 #include "symbol_sort.h"
 #include "image_errors.h"
+#include "op_parallel.h"
 
 using namespace std;
 using namespace options;
@@ -56,6 +60,12 @@ string const end_comment(" */");
 /// field width for the sample count
 unsigned int const count_width = 6;
 
+/**
+ * Up to this nr. of symbols, objdump is run once per symbol, in the order
+ * of the symbols; above it, once for the whole image, in address order.
+ */
+size_t const max_objdump_exec = 50;
+
 string get_annotation_fill()
 {
 	string str;
@@ -459,6 +469,89 @@ void do_one_output_objdump(symbol_collection const & symbols,
 }
 
 
+bool less_sample_vma(symbol_entry const * lhs, symbol_entry const * rhs)
+{
+	return lhs->sample.vma < rhs->sample.vma;
+}
+
+
+/**
+ * Disassemble the selected symbols in-process, in the same layout
+ * objdump -d --no-show-raw-insn would give, annotating each instruction
+ * with the samples falling in its address range. The symbols come in the
+ * order the objdump path would give them. Return false if the image can't
+ * be disassembled this way.
+ */
+bool output_disassembled_asm(symbol_collection const & symbols,
+                             string const & image)
+{
+	op_disassembler disasm(image);
+	if (!disasm.valid())
+		return false;
+
+	symbol_collection ordered(symbols);
+	if (symbols.size() > max_objdump_exec)
+		sort(ordered.begin(), ordered.end(), less_sample_vma);
+
+	string const nr_events_fill(2 * (nr_events - 1), ' ');
+	vector<op_disassembler::insn> insns;
+
+	for (size_t i = 0; i < ordered.size(); ++i) {
+		symbol_entry const * symbol = ordered[i];
+		bfd_vma const vma_adj = symbol->vma_adj;
+		bfd_vma const start = symbol->sample.vma + vma_adj;
+
+		insns.clear();
+		if (!disasm.disassemble(start, start + symbol->size, insns)) {
+			if (i == 0)
+				return false;
+			cerr << "opannotate (warning): unable to disassemble "
+			     << symbol_names.name(symbol->name) << " in "
+			     << image << endl;
+			continue;
+		}
+
+		ostringstream sym_line;
+		sym_line << hex << setfill('0') << setw(disasm.address_digits())
+		         << start << " <" << symbol_names.name(symbol->name)
+		         << ">:";
+		cout << annotation_fill << '\n'
+		     << sym_line.str() << symbol_annotation(symbol) << '\n';
+
+		sample_container::samples_iterator samp_it =
+			samples->begin(symbol);
+		sample_container::samples_iterator const samp_end =
+			samples->end(symbol);
+
+		for (size_t j = 0; j < insns.size(); ++j) {
+			op_disassembler::insn const & insn = insns[j];
+			bfd_vma const insn_end = insn.vma + insn.size - vma_adj;
+
+			// samples not aligned on an instruction, e.g. with
+			// AMD IBS fetch sampling, belong to the instruction
+			// containing them
+			count_array_t counts;
+			for (; samp_it != samp_end &&
+			     samp_it->second.vma < insn_end; ++samp_it)
+				counts += samp_it->second.counts;
+
+			if (counts.zero()) {
+				cout << annotation_fill;
+			} else {
+				cout << count_str(counts, samples->samples_count())
+				     << nr_events_fill << " :";
+			}
+
+			ostringstream insn_line;
+			insn_line << hex << setw(8) << insn.vma;
+			cout << insn_line.str() << ":\t" << insn.text << '\n';
+		}
+	}
+
+	return true;
+}
+
+
 void output_objdump_asm(symbol_collection const & symbols,
 			string const & app_name)
 {
@@ -467,13 +560,18 @@ void output_objdump_asm(symbol_collection const & symbols,
 		classes.extra_found_images.find_image_path(app_name, error,
 							   true);
 
+	// mixed source / assembly and user supplied objdump parameters
+	// need objdump itself
+	if (!source && objdump_params.empty() && error == image_ok &&
+	    output_disassembled_asm(symbols, image))
+		return;
+
 	// this is only an optimisation, we can either filter output by
 	// directly calling objdump and rely on the symbol filtering or
 	// we can call objdump with the right parameter to just disassemble
 	// the needed part. This is a real win only when calling objdump
 	// a medium number of times, I dunno if the used threshold is optimal
 	// but it is a conservative value.
-	size_t const max_objdump_exec = 50;
 	if (symbols.size() <= max_objdump_exec || error != image_ok) {
 		symbol_collection::const_iterator cit = symbols.begin();
 		symbol_collection::const_iterator end = symbols.end();
@@ -514,13 +612,32 @@ bool output_asm(string const & app_name)
 }
 
 
-string const source_line_annotation(debug_name_id filename, size_t linenr)
+/// what the annotation of a source file needs from the profile
+struct source_file {
+	debug_name_id filename;
+	/// the located source file
+	string source;
+	/// samples count of the file
+	count_array_t total;
+	/// samples count by line nr, owned by the profile
+	vector<count_array_t> const * line_counts;
+	/// symbols of the file, sorted by line nr
+	symbol_collection symbols;
+};
+
+
+/// serialize the messages of the threads writing the annotated files
+op_mutex output_mutex;
+
+
+string const source_line_annotation(source_file const & file, size_t linenr)
 {
 	string str;
 
-	count_array_t counts = samples->samples_count(filename, linenr);
-	if (!counts.zero()) {
-		str += count_str(counts, samples->samples_count());
+	if (linenr < file.line_counts->size() &&
+	    !(*file.line_counts)[linenr].zero()) {
+		str += count_str((*file.line_counts)[linenr],
+		                 samples->samples_count());
 		for (size_t i = 1; i < nr_events; ++i)
 			str += "  ";
 		str += " :";
@@ -532,31 +649,40 @@ string const source_line_annotation(debug_name_id filename, size_t linenr)
 }
 
 
-string source_symbol_annotation(debug_name_id filename, size_t linenr)
+string source_symbol_annotation(source_file const & file, size_t linenr)
 {
-	symbol_collection const symbols = samples->find_symbol(filename, linenr);
+	symbol_entry line;
+	line.sample.file_loc.filename = file.filename;
+	line.sample.file_loc.linenr = linenr;
+
+	pair<symbol_collection::const_iterator,
+	     symbol_collection::const_iterator> const symbols =
+		equal_range(file.symbols.begin(), file.symbols.end(),
+		            &line, less_by_file_loc());
 
-	if (symbols.empty())
+	size_t const nr_symbols = symbols.second - symbols.first;
+	if (!nr_symbols)
 		return string();
 
 	string str = " " + begin_comment;
 
 	count_array_t counts;
-	for (size_t i = 0; i < symbols.size(); ++i) {
-		str += symbol_names.demangle(symbols[i]->name);
-		if (symbols.size() == 1)
+	symbol_collection::const_iterator it = symbols.first;
+	for (; it != symbols.second; ++it) {
+		str += symbol_names.demangle((*it)->name);
+		if (nr_symbols == 1)
 			str += " total: ";
 		else
 			str += " ";
-		str += count_str(symbols[i]->sample.counts,
+		str += count_str((*it)->sample.counts,
 		          samples->samples_count());
-		if (symbols.size() != 1)
+		if (nr_symbols != 1)
 			str += ", ";
 
-		counts += symbols[i]->sample.counts;
+		counts += (*it)->sample.counts;
 	}
 
-	if (symbols.size() > 1)
+	if (nr_symbols > 1)
 		str += "total: " + count_str(counts, samples->samples_count());
 	str += end_comment;
 
@@ -564,23 +690,22 @@ string source_symbol_annotation(debug_name_id filename, size_t linenr)
 }
 
 
-void output_per_file_info(ostream & out, debug_name_id filename,
-			  count_array_t const & total_file_count)
+void output_per_file_info(ostream & out, source_file const & file)
 {
 	out << begin_comment << '\n'
 	     << in_comment << "Total samples for file : "
-	     << '"' << debug_names.name(filename) << '"'
+	     << '"' << debug_names.name(file.filename) << '"'
 	     << '\n';
 	out << in_comment << '\n' << in_comment
-	    << count_str(total_file_count, samples->samples_count())
+	    << count_str(file.total, samples->samples_count())
 	    << '\n';
 	out << end_comment << '\n' << '\n';
 }
 
 
-string const line0_info(debug_name_id filename)
+string const line0_info(source_file const & file)
 {
-	string annotation = source_line_annotation(filename, 0);
+	string annotation = source_line_annotation(file, 0);
 	if (trim(annotation, " \t:").empty())
 		return string();
 
@@ -590,14 +715,12 @@ string const line0_info(debug_name_id filename)
 }
 
 
-void do_output_one_file(ostream & out, istream & in, debug_name_id filename,
+void do_output_one_file(ostream & out, istream & in, source_file const & file,
                         bool header)
 {
-	count_array_t count = samples->samples_count(filename);
-
 	if (header) {
-		output_per_file_info(out, filename, count);
-		out << line0_info(filename) << '\n';
+		output_per_file_info(out, file);
+		out << line0_info(file) << '\n';
 	}
 
 
@@ -605,8 +728,8 @@ void do_output_one_file(ostream & out, istream & in, debug_name_id filename,
 		string str;
 
 		for (size_t linenr = 1 ; getline(in, str) ; ++linenr) {
-			out << source_line_annotation(filename, linenr) << str
-			    << source_symbol_annotation(filename, linenr)
+			out << source_line_annotation(file, linenr) << str
+			    << source_symbol_annotation(file, linenr)
 			    << '\n';
 		}
 
@@ -615,27 +738,38 @@ void do_output_one_file(ostream & out, istream & in, debug_name_id filename,
 		// symbols belonging to this file. This make more visible the
 		// problem of having less samples for a given file than the
 		// sum of all symbols samples for this file due to inlining
-		symbol_collection const symbols = samples->select_symbols(filename);
-		for (size_t i = 0; i < symbols.size(); ++i)
-			out << symbol_annotation(symbols[i]) << endl;
+		for (size_t i = 0; i < file.symbols.size(); ++i)
+			out << symbol_annotation(file.symbols[i]) << endl;
 	}
 
 	if (!header) {
-		output_per_file_info(out, filename, count);
-		out << line0_info(filename) << '\n';
+		output_per_file_info(out, file);
+		out << line0_info(file) << '\n';
 	}
 }
 
 
-void output_one_file(istream & in, debug_name_id filename,
-                     string const & source)
+/// This doesn't use the profile, so it can run on several threads
+void output_one_file(source_file const & file)
 {
+	ifstream in(file.source.c_str());
+
+	// it is common to have empty filename due to the lack
+	// of debug info (eg _init function) so warn only
+	// if the filename is non empty. The case: no debug
+	// info at all has already been checked.
+	if (!in) {
+		op_lock lock(output_mutex);
+		cerr << "opannotate (warning): unable to open for "
+		     "reading: " << file.source << endl;
+	}
+
 	if (output_dir.empty()) {
-		do_output_one_file(cout, in, filename, true);
+		do_output_one_file(cout, in, file, true);
 		return;
 	}
 
-	string const out_file = op_realpath(output_dir + source);
+	string const out_file = op_realpath(output_dir + file.source);
 
 	/* Just because you're paranoid doesn't mean they're not out to
 	 * get you ...
@@ -649,12 +783,14 @@ void output_one_file(istream & in, debug_name_id filename,
 	 */
 	if (out_file.find("/../") != string::npos) {
 		if (in) {
+			op_lock lock(output_mutex);
 			cerr << "refusing to create non-canonical filename "
 			     << out_file  << endl;
 		}
 		return;
 	} else if (!is_prefix(out_file, output_dir)) {
 		if (in) {
+			op_lock lock(output_mutex);
 			cerr << "refusing to create file " << out_file
 			     << " outside of output directory " << output_dir
 			     << endl;
@@ -662,13 +798,15 @@ void output_one_file(istream & in, debug_name_id filename,
 		return;
 	}
 
-	if (is_files_identical(out_file, source)) {
+	if (is_files_identical(out_file, file.source)) {
+		op_lock lock(output_mutex);
 		cerr << "input and output files are identical: "
 		     << out_file << endl;
 		return;
 	}
 
 	if (create_path(out_file.c_str())) {
+		op_lock lock(output_mutex);
 		cerr << "unable to create file: "
 		     << '"' << op_dirname(out_file) << '"' << endl;
 		return;
@@ -676,15 +814,28 @@ void output_one_file(istream & in, debug_name_id filename,
 
 	ofstream out(out_file.c_str());
 	if (!out) {
+		op_lock lock(output_mutex);
 		cerr << "unable to open output file "
 		     << '"' << out_file << '"' << endl;
 	} else {
-		do_output_one_file(out, in, filename, false);
+		do_output_one_file(out, in, file, false);
 		output_info(out);
 	}
 }
 
 
+struct output_files_task : parallel_task {
+	output_files_task(vector<source_file const *> const & f)
+		: files(f) {}
+
+	void run(size_t i) {
+		output_one_file(*files[i]);
+	}
+
+	vector<source_file const *> const & files;
+};
+
+
 /* Locate a source file from debug info, which may be relative */
 string const locate_source_file(debug_name_id filename_id)
 {
@@ -726,36 +877,67 @@ string const locate_source_file(debug_name_id filename_id)
 }
 
 
-void output_source(path_filter const & filter)
+/// gather the data needed to annotate the selected source files
+void select_source_files(vector<source_file> & files,
+                         path_filter const & filter)
 {
-	bool const separate_file = !output_dir.empty();
-
-	if (!separate_file)
-		output_info(cout);
-
 	vector<debug_name_id> filenames =
 		samples->select_filename(options::threshold);
 
+	vector<symbol_name_id> names;
+
 	for (size_t i = 0 ; i < filenames.size() ; ++i) {
 		string const & source = locate_source_file(filenames[i]);
 
-		if (!filter.match(source))
+		if (!filter.match(source) || source.empty())
 			continue;
 
-		ifstream in(source.c_str());
+		files.push_back(source_file());
+		source_file & file = files.back();
+		file.filename = filenames[i];
+		file.source = source;
+		file.total = samples->samples_count(filenames[i]);
+		file.line_counts = &samples->samples_count_by_line(filenames[i]);
+		// sorted by file location
+		file.symbols = samples->select_symbols(filenames[i]);
+
+		for (size_t j = 0; j < file.symbols.size(); ++j)
+			names.push_back(file.symbols[j]->name);
+	}
 
-		// it is common to have empty filename due to the lack
-		// of debug info (eg _init function) so warn only
-		// if the filename is non empty. The case: no debug
-		// info at all has already been checked.
-		if (!in && source.length()) {
-			cerr << "opannotate (warning): unable to open for "
-			     "reading: " << source << endl;
-		}
+	// demangle() must not update the names once the output started
+	symbol_names.demangle(names);
+}
+
+
+void output_source(path_filter const & filter)
+{
+	bool const separate_file = !output_dir.empty();
 
-		if (source.length())
-			output_one_file(in, filenames[i], source);
+	if (!separate_file)
+		output_info(cout);
+
+	vector<source_file> files;
+	select_source_files(files, filter);
+
+	if (!separate_file) {
+		for (size_t i = 0 ; i < files.size() ; ++i)
+			output_one_file(files[i]);
+		return;
 	}
+
+	// Several debug filenames can be located to the same source, only
+	// the last one was kept when the files were written in order.
+	set<string> sources;
+	vector<source_file const *> to_output;
+	for (size_t i = files.size(); i-- > 0; ) {
+		if (sources.insert(files[i].source).second)
+			to_output.push_back(&files[i]);
+	}
+	reverse(to_output.begin(), to_output.end());
+
+	output_files_task task(to_output);
+	parallel_for(to_output.size(), task, op_nr_cpus());
 }
 
 
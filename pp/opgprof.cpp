@@ -18,6 +18,7 @@
 #include "op_fileio.h"
 #include "string_filter.h"
 #include "profile_container.h"
+#include "op_bfd_cache.h"
 #include "arrange_profiles.h"
 #include "image_errors.h"
 #include "opgprof_options.h"
@@ -286,8 +287,8 @@ int opgprof(options::spec const & spec)
 
 	bool ok = image_profile.error == image_ok;
 	// FIXME: symbol_filter would be allowed through option
-	op_bfd abfd(image_profile.image, string_filter(),
-		    classes.extra_found_images, ok);
+	shared_op_bfd abfd(image_profile.image, string_filter(),
+	                   classes.extra_found_images, ok);
 	if (!ok && image_profile.error == image_ok)
 		image_profile.error = image_format_failure;
 
@@ -302,12 +303,12 @@ int opgprof(options::spec const & spec)
 	image_group_set const & groups = image_profile.groups[0];
 	image_group_set::const_iterator it;
 	for (it = groups.begin(); it != groups.end(); ++it) {
-		load_samples(abfd, it->files, image_profile.image, samples);
+		load_samples(*abfd, it->files, image_profile.image, samples);
 
 		load_cg(cg_db, it->files);
 	}
 
-	output_gprof(abfd, samples, cg_db, options::gmon_filename);
+	output_gprof(*abfd, samples, cg_db, options::gmon_filename);
 
 	return 0;
 }
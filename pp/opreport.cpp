@@ -413,8 +413,30 @@ void output_symbols(profile_container const & pc, bool multiple_apps)
 }
 
 
-void output_diff_symbols(profile_container const & pc1,
-                         profile_container const & pc2, bool multiple_apps)
+/**
+ * Summarize the profile of iprofiles for diffing, one image at a time, so
+ * that only one image's profile_container is alive at once.
+ */
+void summarize_profile(diff_summary & summary,
+                       list<inverted_profile> const & iprofiles,
+                       extra_images const & extra)
+{
+	list<inverted_profile>::const_iterator it = iprofiles.begin();
+	list<inverted_profile>::const_iterator const end = iprofiles.end();
+
+	for (; it != end; ++it) {
+		profile_container pc(options::debug_info, options::details,
+		                     extra);
+		populate_for_image(pc, *it, options::symbol_filter, 0);
+		summary.add(pc);
+	}
+
+	summary.sort();
+}
+
+
+void output_diff_symbols(diff_summary const & pc1,
+                         diff_summary const & pc2, bool multiple_apps)
 {
 	diff_container dc(pc1, pc2);
 
@@ -430,7 +452,7 @@ void output_diff_symbols(profile_container const & pc1,
 	// With diff profile we output only filename coming from the first
 	// profile session, internally we use only name derived from the sample
 	// filename so image name can match.
-	format_output::diff_formatter out(dc, pc1.extra_found_images);
+	format_output::diff_formatter out(dc, classes.extra_found_images);
 
 	out.set_nr_classes(nr_classes);
 	out.show_long_filenames(options::long_filenames);
@@ -533,31 +555,19 @@ int opreport(options::spec const & spec)
 				multiple_apps |= true;
 		}
 
-		profile_container pc1(options::debug_info, options::details,
-				      classes.extra_found_images);
-
-		list<inverted_profile>::iterator it = iprofiles.begin();
-		list<inverted_profile>::iterator const end = iprofiles.end();
-
-		for (; it != end; ++it)
-			populate_for_image(pc1, *it,
-					   options::symbol_filter, 0);
+		diff_summary summary1;
+		summarize_profile(summary1, iprofiles,
+		                  classes.extra_found_images);
 
 		list<inverted_profile> iprofiles2 = invert_profiles(classes2);
 
 		report_image_errors(iprofiles2, classes2.extra_found_images);
 
-		profile_container pc2(options::debug_info, options::details,
-				      classes2.extra_found_images);
-
-		list<inverted_profile>::iterator it2 = iprofiles2.begin();
-		list<inverted_profile>::iterator const end2 = iprofiles2.end();
+		diff_summary summary2;
+		summarize_profile(summary2, iprofiles2,
+		                  classes2.extra_found_images);
 
-		for (; it2 != end2; ++it2)
-			populate_for_image(pc2, *it2,
-					   options::symbol_filter, 0);
-
-		output_diff_symbols(pc1, pc2, multiple_apps);
+		output_diff_symbols(summary1, summary2, multiple_apps);
 	} else if (options::callgraph) {
 		callgraph_container cg_container;
 		cg_container.populate(iprofiles, classes.extra_found_images,
@@ -569,6 +579,10 @@ int opreport(options::spec const & spec)
 		profile_container samples(options::debug_info,
 			options::details, classes.extra_found_images);
 
+		// drop early what --threshold or --top-symbols will drop
+		samples.limit_symbols(options::threshold / 100.0,
+		                      options::top_symbols);
+
 		list<inverted_profile>::iterator it = iprofiles.begin();
 		list<inverted_profile>::iterator const end = iprofiles.end();
 
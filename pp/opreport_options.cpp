@@ -9,6 +9,7 @@
  * @author Philippe Elie
  */
 
+#include <cstdlib>
 #include <vector>
 #include <list>
 #include <iostream>
@@ -23,6 +24,7 @@
 #include "popt_options.h"
 #include "string_filter.h"
 #include "file_manip.h"
+#include "gzip_stream.h"
 #include "xml_output.h"
 #include "xml_utils.h"
 #include "cverb.h"
@@ -50,12 +52,14 @@ namespace options {
 	bool global_percent;
 	bool xml;
 	string xml_options;
+	int top_symbols;
 }
 
 
 namespace {
 
 string outfile;
+bool gzip_output;
 vector<string> mergespec;
 vector<string> sort;
 vector<string> exclude_symbols;
@@ -72,6 +76,8 @@ popt::option options_array[] = {
 
 	popt::option(outfile, "output-file", 'o',
 	             "output to the given filename", "file"),
+	popt::option(gzip_output, "gzip", '\0',
+	             "gzip compress the output"),
 
 	popt::option(sort, "sort", 's',
 		     "sort by", "sample,image,app-name,symbol,debug,vma"),
@@ -88,6 +94,9 @@ popt::option options_array[] = {
 	popt::option(options::threshold_opt, "threshold", 't',
 		     "minimum percentage needed to produce output",
 		     "percent"),
+	popt::option(options::top_symbols, "top-symbols", '\0',
+		     "only output the given number of symbols with the most "
+		     "samples", "nr_symbols"),
 
 	popt::option(demangle_option, "demangle", 'D',
 		     "demangle GNU C++ symbol names (default normal)",
@@ -143,8 +152,46 @@ void handle_sort_option()
 }
 
 
+/// the --gzip output, closed at exit
+gzip_streambuf * gzip_buf;
+streambuf * saved_cout_buf;
+
+
+void close_gzip_output()
+{
+	cout.flush();
+	cout.rdbuf(saved_cout_buf);
+
+	if (!gzip_buf->close())
+		cerr << "error writing the compressed output" << endl;
+	delete gzip_buf;
+	gzip_buf = 0;
+}
+
+
 void handle_output_file()
 {
+	if (gzip_output) {
+		if (!gzip_streambuf::supported()) {
+			cerr << "--gzip is not supported, oprofile was built "
+			     << "without zlib" << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		gzip_buf = new gzip_streambuf(outfile);
+		if (!gzip_buf->is_open()) {
+			cerr << "Couldn't open \""
+			     << (outfile.empty() ? "stdout" : outfile)
+			     << "\" for writing." << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		// must run before the standard streams are flushed at exit
+		saved_cout_buf = cout.rdbuf(gzip_buf);
+		atexit(close_gzip_output);
+		return;
+	}
+
 	if (outfile.empty())
 		return;
 
@@ -222,6 +269,12 @@ void check_options(bool diff)
 			do_exit = true;
 		}
 
+		if (top_symbols) {
+			cerr << "--top-symbols is meaningless without --symbols"
+			     << endl;
+			do_exit = true;
+		}
+
 		if (find(sort_by.options.begin(), sort_by.options.end(), 
 			 sort_options::vma) != sort_by.options.end()) {
 			cerr << "--sort=vma is "
@@ -230,6 +283,17 @@ void check_options(bool diff)
 		}
 	}
 
+	if (top_symbols < 0) {
+		cerr << "illegal --top-symbols value: " << top_symbols << endl;
+		do_exit = true;
+	}
+
+	if (top_symbols && (callgraph || diff)) {
+		cerr << "--top-symbols is incompatible with --callgraph and "
+		        "differential profiles" << endl;
+		do_exit = true;
+	}
+
 	if (global_percent && symbols && !(details || callgraph)) {
 		cerr << "--global-percent is meaningless with --symbols "
 		        "and without --details or --callgraph" << endl;